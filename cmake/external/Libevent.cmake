@@ -7,6 +7,7 @@ set(LIBEVENT_CMAKE_ARGS
     -DEVENT__DISABLE_TESTS=ON
     -DEVENT__DISABLE_SAMPLES=ON
     -DEVENT__DISABLE_BENCHMARK=ON
+    -DOPENSSL_ROOT_DIR=${OPENSSL_PREFIX}
 )
 if(BUILD_DEPS_BOTH_STATIC_SHARED)
     set(_libevent_shared_dir ${CMAKE_BINARY_DIR}/external/libevent/build/libevent_shared)
@@ -30,3 +31,7 @@ ExternalProject_Add(
     LOG_BUILD ON
     LOG_INSTALL ON
 )
+
+if(OpenSSL_NEEDS_INSTALL)
+    add_dependencies(libevent_external openssl_external)
+endif()
@@ -47,7 +47,7 @@ ExecutionMultiQueue::ExecutionMultiQueue(const std::string& inName, std::size_t
     for (auto idx = 0; idx < _queueCount; ++idx)
     {
         auto qname = FormatString("%s-%d", _name.c_str(), idx);
-        _queues.push_back(std::make_shared<ExecutionQueue>(qname, _queueSize));
+        _queues.push_back(std::make_shared<ExecutionQueue>(qname, _queueSize, _consumerCount));
     }
 }
 
@@ -22,8 +22,13 @@
 #include <boost/uuid/uuid_io.hpp>
 
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
 namespace viper {
 namespace assist {
 
@@ -74,6 +79,98 @@ uint16_t CRC16(const char* buf, int len)
     return crc;
 }
 
+// slicing-by-8 tables of the reflected Castagnoli polynomial
+struct CRC32CTable
+{
+    uint32_t _slices[8][256];
+
+    CRC32CTable()
+    {
+        for (uint32_t idx = 0; idx < 256; ++idx)
+        {
+            uint32_t crc = idx;
+            for (int bit = 0; bit < 8; ++bit)
+            {
+                crc = (crc >> 1) ^ (0x82f63b78 & (0 - (crc & 1)));
+            }
+
+            _slices[0][idx] = crc;
+        }
+
+        for (uint32_t idx = 0; idx < 256; ++idx)
+        {
+            for (int slice = 1; slice < 8; ++slice)
+            {
+                uint32_t prev        = _slices[slice - 1][idx];
+                _slices[slice][idx] = (prev >> 8) ^ _slices[0][prev & 0xff];
+            }
+        }
+    }
+};
+
+static uint32_t CRC32CSoftware(uint32_t crc, const uint8_t* data, std::size_t len)
+{
+    static const CRC32CTable table;
+    const auto&              slices = table._slices;
+
+    for (; len >= 8; len -= 8, data += 8)
+    {
+        uint64_t word = 0;
+        memcpy(&word, data, sizeof(word));
+        word ^= crc;
+
+        crc = slices[7][word & 0xff] ^ slices[6][(word >> 8) & 0xff] ^ slices[5][(word >> 16) & 0xff] ^
+              slices[4][(word >> 24) & 0xff] ^ slices[3][(word >> 32) & 0xff] ^ slices[2][(word >> 40) & 0xff] ^
+              slices[1][(word >> 48) & 0xff] ^ slices[0][word >> 56];
+    }
+
+    for (; len > 0; --len, ++data)
+    {
+        crc = (crc >> 8) ^ slices[0][(crc ^ *data) & 0xff];
+    }
+
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) static uint32_t CRC32CHardware(uint32_t crc, const uint8_t* data, std::size_t len)
+{
+    uint64_t crc64 = crc;
+    for (; len >= 8; len -= 8, data += 8)
+    {
+        uint64_t word = 0;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+
+    crc = (uint32_t)crc64;
+    for (; len > 0; --len, ++data)
+    {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+
+    return crc;
+}
+#endif
+
+uint32_t CRC32C(const void* buf, std::size_t len, uint32_t crc)
+{
+    using Implementation = uint32_t (*)(uint32_t, const uint8_t*, std::size_t);
+
+    // the implementation is selected once, the software tables are only built when used
+    static const Implementation implementation = []() -> Implementation {
+#if defined(__x86_64__)
+        if (__builtin_cpu_supports("sse4.2"))
+        {
+            return &CRC32CHardware;
+        }
+#endif
+        return &CRC32CSoftware;
+    }();
+
+    return ~implementation(~crc, static_cast<const uint8_t*>(buf), len);
+}
+
 std::string UUID()
 {
     boost::uuids::uuid id = boost::uuids::random_generator()();
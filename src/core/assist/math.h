@@ -17,6 +17,7 @@
 #ifndef _VIPER_CORE_ASSIST_MATH_H_
 #define _VIPER_CORE_ASSIST_MATH_H_
 
+#include <cstddef>
 #include <cstdint>
 #include <string>
 
@@ -33,6 +34,18 @@ namespace assist {
  */
 uint16_t CRC16(const char* buf, int len);
 
+/**
+ * @brief CRC32C Castagnoli CRC, computed with the SSE4.2 crc32 instruction when
+ *        the CPU supports it and with slicing-by-8 tables otherwise
+ *
+ * @param buf the inputed buffer
+ * @param len the inputed buffer size
+ * @param crc the CRC of the preceding data, to checksum a buffer in several chunks
+ *
+ * @return uint32_t 32 bits checksum
+ */
+uint32_t CRC32C(const void* buf, std::size_t len, uint32_t crc = 0);
+
 /**
  * @brief UUID generate a new UUID string
  *
@@ -0,0 +1,203 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#ifndef _VIPER_CORE_CONTAINER_SLOT_MAP_H_
+#define _VIPER_CORE_CONTAINER_SLOT_MAP_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+namespace viper {
+namespace container {
+
+/**
+ * @brief SlotHandle the key of a SlotMap element: the slot index and the generation
+ *        of the slot when the element was inserted. A handle of a deleted element
+ *        never matches again, even when its slot is reused.
+ */
+struct SlotHandle
+{
+    uint32_t _index      = 0;
+    uint32_t _generation = 0; // 0 is never handed out
+
+    bool Valid() const
+    {
+        return _generation != 0;
+    }
+
+    uint64_t Value() const
+    {
+        return ((uint64_t)_generation << 32) | _index;
+    }
+
+    bool operator==(const SlotHandle& other) const
+    {
+        return _index == other._index && _generation == other._generation;
+    }
+
+    bool operator!=(const SlotHandle& other) const
+    {
+        return !(*this == other);
+    }
+};
+
+/**
+ * @brief SlotMap a map whose keys it hands out itself. Insert, Find and Delete are
+ *        O(1), the slots of deleted elements are reused, so once the map reached
+ *        its peak size nothing is allocated any more. It is not thread safe.
+ */
+template <typename VAL>
+class SlotMap final
+{
+public:
+    /**
+     * @brief Insert store the value in a free slot
+     *
+     * @param value the map value
+     * @return SlotHandle the key of the value
+     */
+    SlotHandle Insert(VAL value)
+    {
+        uint32_t index = 0;
+        if (!_free.empty())
+        {
+            index = _free.back();
+            _free.pop_back();
+        }
+        else
+        {
+            index = (uint32_t)_slots.size();
+            _slots.emplace_back();
+        }
+
+        auto& slot  = _slots[index];
+        slot._value = std::move(value);
+        slot._used  = true;
+        ++_count;
+
+        return SlotHandle{index, slot._generation};
+    }
+
+    /**
+     * @brief Find get the value by the handle
+     *
+     * @param handle the key returned by Insert
+     * @return VAL* nullptr when the value was deleted
+     */
+    VAL* Find(SlotHandle handle)
+    {
+        if (handle._index >= _slots.size())
+        {
+            return nullptr;
+        }
+
+        auto& slot = _slots[handle._index];
+        if (!slot._used || slot._generation != handle._generation)
+        {
+            return nullptr;
+        }
+
+        return &slot._value;
+    }
+
+    /**
+     * @brief Delete delete the value by the handle, the handle is invalid from now on
+     *
+     * @param handle the key returned by Insert
+     * @return true the value was deleted
+     * @return false the value was deleted before
+     */
+    bool Delete(SlotHandle handle)
+    {
+        if (!Find(handle))
+        {
+            return false;
+        }
+
+        auto& slot  = _slots[handle._index];
+        slot._value = VAL();
+        slot._used  = false;
+
+        // skips 0 on wrap around, so a slot never hands out an invalid handle
+        if (0 == ++slot._generation)
+        {
+            slot._generation = 1;
+        }
+
+        _free.push_back(handle._index);
+        --_count;
+        return true;
+    }
+
+    /**
+     * @brief Count return the element count of this map
+     *
+     * @return std::size_t
+     */
+    std::size_t Count() const
+    {
+        return _count;
+    }
+
+    /**
+     * @brief Foreach call callback function for each element in this map
+     *
+     * @param callback
+     */
+    void Foreach(std::function<void(SlotHandle, VAL&)> callback)
+    {
+        for (uint32_t index = 0; index < _slots.size(); ++index)
+        {
+            auto& slot = _slots[index];
+            if (slot._used)
+            {
+                callback(SlotHandle{index, slot._generation}, slot._value);
+            }
+        }
+    }
+
+    /**
+     * @brief Clean clean all elements from this map, the values are destroyed after
+     *        the map is empty
+     */
+    void Clean()
+    {
+        std::vector<Slot> slots;
+        slots.swap(_slots);
+        _free.clear();
+        _count = 0;
+    }
+
+private:
+    struct Slot
+    {
+        VAL      _value      = VAL();
+        uint32_t _generation = 1;
+        bool     _used       = false;
+    };
+
+    std::vector<Slot>     _slots;
+    std::vector<uint32_t> _free;
+    std::size_t           _count = 0;
+};
+
+} // namespace container
+} // namespace viper
+
+#endif
@@ -44,8 +44,13 @@ enum class ErrorCode : int32_t
     // net error code
     NET_MESSAGE_TOO_LARGE,
     NET_INVALID_MAGIC,
+    NET_CHECKSUM_MISMATCH,
     NET_SEND_FAILED,
     NET_DISCONNECTED,
+    NET_TIMEOUT,
+    NET_WOULD_BLOCK,
+    NET_COMPRESS_FAILED,
+    NET_DECOMPRESS_FAILED,
     NET_HTTP_INVALID_METHOD,
     NET_HTTP_REPEATED_URI,
     NET_HTTP_RESPOND_FAILED,
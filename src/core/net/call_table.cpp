@@ -0,0 +1,160 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#include "core/net/call_table.h"
+#include "core/error/error.h"
+#include "core/log/log.h"
+
+#include <utility>
+
+namespace viper {
+namespace net {
+
+// a slot whose fields are being written or read by the thread which claimed it
+static constexpr uint64_t SLOT_BUSY = UINT64_MAX;
+
+CallTable::CallTable(std::size_t size)
+{
+    std::size_t capacity = 1;
+    while (capacity < size)
+    {
+        capacity <<= 1;
+    }
+
+    _slots = std::make_unique<Slot[]>(capacity);
+    _mask  = capacity - 1;
+}
+
+std::error_code CallTable::Insert(uint64_t deadline, CallCallback callback, uint64_t& sequence)
+{
+    sequence = _nextSequence.fetch_add(1, std::memory_order_relaxed);
+
+    Slot&    slot     = _slots[sequence & _mask];
+    uint64_t expected = 0;
+    if (!slot._sequence.compare_exchange_strong(expected, SLOT_BUSY, std::memory_order_acquire))
+    {
+        LOG_WARN("too many calls in flight. sequence:{}, outstanding:{}", sequence, Outstanding());
+        return error::ErrorCode::QUEUE_OVERFLOW;
+    }
+
+    slot._deadline.store(deadline, std::memory_order_relaxed);
+    slot._callback = std::move(callback);
+    _outstanding.fetch_add(1, std::memory_order_relaxed);
+
+    // publish the call, a response may complete it from now on
+    slot._sequence.store(sequence, std::memory_order_release);
+    return error::ErrorCode::SUCCESS;
+}
+
+bool CallTable::Complete(uint64_t sequence, std::error_code errcode, MessagePtr response)
+{
+    Slot& slot = _slots[sequence & _mask];
+    if (!Acquire(slot, sequence))
+    {
+        return false;
+    }
+
+    Release(slot, errcode, std::move(response));
+    return true;
+}
+
+bool CallTable::Remove(uint64_t sequence)
+{
+    Slot& slot = _slots[sequence & _mask];
+    if (!Acquire(slot, sequence))
+    {
+        return false;
+    }
+
+    Release(slot, error::ErrorCode::SUCCESS, nullptr, false);
+    return true;
+}
+
+std::size_t CallTable::Expire(uint64_t now)
+{
+    // runs every tick on every connection, an idle table is not scanned; a call
+    // inserted meanwhile is counted before it is published and expires next tick
+    std::size_t expired = 0;
+    if (0 == Outstanding())
+    {
+        return expired;
+    }
+
+    for (std::size_t idx = 0; idx <= _mask; ++idx)
+    {
+        Slot&    slot     = _slots[idx];
+        uint64_t sequence = slot._sequence.load(std::memory_order_acquire);
+        if (0 == sequence || SLOT_BUSY == sequence || slot._deadline.load(std::memory_order_relaxed) > now)
+        {
+            continue;
+        }
+
+        // the slot may have been completed and reused since it was read
+        if (Acquire(slot, sequence))
+        {
+            Release(slot, error::ErrorCode::NET_TIMEOUT, nullptr);
+            ++expired;
+        }
+    }
+
+    return expired;
+}
+
+void CallTable::Cancel(std::error_code errcode)
+{
+    if (0 == Outstanding())
+    {
+        return;
+    }
+
+    for (std::size_t idx = 0; idx <= _mask; ++idx)
+    {
+        Slot&    slot     = _slots[idx];
+        uint64_t sequence = slot._sequence.load(std::memory_order_acquire);
+        if (0 != sequence && SLOT_BUSY != sequence && Acquire(slot, sequence))
+        {
+            Release(slot, errcode, nullptr);
+        }
+    }
+}
+
+std::size_t CallTable::Outstanding()
+{
+    return _outstanding.load(std::memory_order_relaxed);
+}
+
+bool CallTable::Acquire(Slot& slot, uint64_t sequence)
+{
+    return slot._sequence.compare_exchange_strong(sequence, SLOT_BUSY, std::memory_order_acq_rel);
+}
+
+void CallTable::Release(Slot& slot, std::error_code errcode, MessagePtr response, bool finish)
+{
+    CallCallback callback = std::move(slot._callback);
+    slot._callback        = nullptr;
+
+    _outstanding.fetch_sub(1, std::memory_order_relaxed);
+    slot._sequence.store(0, std::memory_order_release);
+
+    // the slot is free before the callback runs, so the callback may call again
+    if (callback && finish)
+    {
+        callback(errcode, std::move(response));
+    }
+}
+
+} // namespace net
+} // namespace viper
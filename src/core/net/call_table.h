@@ -0,0 +1,123 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#ifndef _VIPER_CORE_NET_CALL_TABLE_H_
+#define _VIPER_CORE_NET_CALL_TABLE_H_
+
+#include "core/net/message.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <system_error>
+
+namespace viper {
+namespace net {
+
+// clang-format off
+
+#define VIPER_NET_CALL_TABLE_SIZE_DFT      4096
+#define VIPER_NET_CALL_EXPIRE_INTERVAL_MS  10
+
+// clang-format on
+
+// called once with the response, or with an error and a null response
+using CallCallback = std::function<void(std::error_code errcode, MessagePtr response)>;
+
+/**
+ * @brief CallTable the requests in flight on one connection, keyed by sequence.
+ *
+ * The table is a fixed array of slots indexed by the low bits of the sequence.
+ * A slot is claimed and released with a CAS on its sequence, so callers on any
+ * thread insert while the event loop completes and expires calls without a lock.
+ * Every call is finished exactly once, by whoever wins the CAS.
+ */
+class CallTable final
+{
+public:
+    explicit CallTable(std::size_t size = VIPER_NET_CALL_TABLE_SIZE_DFT);
+
+    CallTable(const CallTable&)            = delete;
+    CallTable& operator=(const CallTable&) = delete;
+
+public:
+    /**
+     * @brief Insert register a call
+     *
+     * @param deadline the tick count in milliseconds the call expires at
+     * @param callback the completion
+     * @param sequence the sequence of the request
+     * @return std::error_code QUEUE_OVERFLOW when the slot of the sequence is still
+     *         held by an older call.
+     */
+    std::error_code Insert(uint64_t deadline, CallCallback callback, uint64_t& sequence);
+
+    /**
+     * @brief Complete finish the call of sequence
+     *
+     * @return true when the call was still in flight
+     */
+    bool Complete(uint64_t sequence, std::error_code errcode, MessagePtr response);
+
+    /**
+     * @brief Remove forget the call of sequence without finishing it, e.g. when the
+     *        request could not be sent
+     *
+     * @return true when the call was still in flight, false when a response, Expire
+     *         or Cancel finished it already
+     */
+    bool Remove(uint64_t sequence);
+
+    /**
+     * @brief Expire finish the calls whose deadline passed with NET_TIMEOUT
+     *
+     * @param now the tick count in milliseconds
+     * @return std::size_t the number of expired calls
+     */
+    std::size_t Expire(uint64_t now);
+
+    /**
+     * @brief Cancel finish every call in flight with errcode
+     */
+    void Cancel(std::error_code errcode);
+
+    std::size_t Outstanding();
+
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> _sequence = 0; // 0 is free
+        std::atomic<uint64_t> _deadline = 0;
+        CallCallback          _callback;
+    };
+
+    // claim the slot holding sequence, the caller owns its fields until Release
+    bool Acquire(Slot& slot, uint64_t sequence);
+    void Release(Slot& slot, std::error_code errcode, MessagePtr response, bool finish = true);
+
+private:
+    std::unique_ptr<Slot[]>  _slots;
+    std::size_t              _mask         = 0;
+    std::atomic<uint64_t>    _nextSequence = 1;
+    std::atomic<std::size_t> _outstanding  = 0;
+};
+
+} // namespace net
+} // namespace viper
+
+#endif
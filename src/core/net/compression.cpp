@@ -0,0 +1,298 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#include "core/net/compression.h"
+#include "core/error/error.h"
+#include "core/log/log.h"
+#include "core/net/message.h"
+
+#include <event2/buffer.h>
+
+#include <zstd.h>
+
+#include <algorithm>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace viper {
+namespace net {
+
+namespace {
+
+// ZSTD_FRAMEHEADERSIZE_MAX, which is only visible with ZSTD_STATIC_LINKING_ONLY
+constexpr std::size_t FRAME_HEADER_SIZE_MAX = 18;
+
+struct ContextDeleter
+{
+    void operator()(ZSTD_CCtx* cctx) const
+    {
+        ZSTD_freeCCtx(cctx);
+    }
+
+    void operator()(ZSTD_DCtx* dctx) const
+    {
+        ZSTD_freeDCtx(dctx);
+    }
+
+    void operator()(evbuffer* buffer) const
+    {
+        evbuffer_free(buffer);
+    }
+};
+
+// The contexts keep their work memory between frames, one per event loop thread.
+ZSTD_CCtx* ThreadCCtx()
+{
+    thread_local std::unique_ptr<ZSTD_CCtx, ContextDeleter> cctx(ZSTD_createCCtx());
+    return cctx.get();
+}
+
+ZSTD_DCtx* ThreadDCtx()
+{
+    thread_local std::unique_ptr<ZSTD_DCtx, ContextDeleter> dctx(ZSTD_createDCtx());
+    return dctx.get();
+}
+
+evbuffer* ThreadScratch()
+{
+    thread_local std::unique_ptr<evbuffer, ContextDeleter> scratch(evbuffer_new());
+    return scratch.get();
+}
+
+} // namespace
+
+Compressor::Compressor(const CompressionConfig& config)
+{
+    _config = config;
+    if (_config._dictionary.empty())
+    {
+        return;
+    }
+
+    _cdict = ZSTD_createCDict(_config._dictionary.data(), _config._dictionary.size(), _config._level);
+    _ddict = ZSTD_createDDict(_config._dictionary.data(), _config._dictionary.size());
+    if (!_cdict || !_ddict)
+    {
+        throw std::bad_alloc();
+    }
+
+    // raw content dictionaries have no id and can not be negotiated
+    _dictionaryID = ZSTD_getDictID_fromDict(_config._dictionary.data(), _config._dictionary.size());
+    if (0 == _dictionaryID)
+    {
+        LOG_WARN("the compression dictionary has no id, it is not used");
+    }
+}
+
+Compressor::~Compressor()
+{
+    ZSTD_freeCDict(_cdict);
+    ZSTD_freeDDict(_ddict);
+}
+
+const CompressionConfig& Compressor::Config() const
+{
+    return _config;
+}
+
+uint32_t Compressor::DictionaryID() const
+{
+    return _dictionaryID;
+}
+
+CompressionStats Compressor::Stats() const
+{
+    CompressionStats stats;
+    stats._rawFrames          = _rawFrames.load(std::memory_order_relaxed);
+    stats._rawBytes           = _rawBytes.load(std::memory_order_relaxed);
+    stats._compressedFrames   = _compressedFrames.load(std::memory_order_relaxed);
+    stats._compressedInBytes  = _compressedInBytes.load(std::memory_order_relaxed);
+    stats._compressedOutBytes = _compressedOutBytes.load(std::memory_order_relaxed);
+    stats._decompressedFrames = _decompressedFrames.load(std::memory_order_relaxed);
+    stats._decompressedBytes  = _decompressedBytes.load(std::memory_order_relaxed);
+    stats._rejectedFrames     = _rejectedFrames.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void Compressor::CountRaw(uint32_t payloadSize)
+{
+    _rawFrames.fetch_add(1, std::memory_order_relaxed);
+    _rawBytes.fetch_add(payloadSize, std::memory_order_relaxed);
+}
+
+std::error_code Compressor::Compress(const iovec* iov, int iovcnt, uint32_t peerDictionaryID, evbuffer* output)
+{
+    std::size_t rawSize = 0;
+    for (int idx = 0; idx < iovcnt; ++idx)
+    {
+        rawSize += iov[idx].iov_len;
+    }
+
+    ZSTD_CCtx* cctx = ThreadCCtx();
+    ZSTD_CCtx_reset(cctx, ZSTD_reset_session_and_parameters);
+    if (_cdict && _dictionaryID != 0 && _dictionaryID == peerDictionaryID)
+    {
+        ZSTD_CCtx_refCDict(cctx, _cdict);
+    }
+    else
+    {
+        ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, _config._level);
+    }
+
+    // the content size goes into the frame header, the receiver allocates it once
+    ZSTD_CCtx_setPledgedSrcSize(cctx, rawSize);
+
+    // a frame that does not shrink is sent raw, so the output never exceeds the input
+    evbuffer_iovec space;
+    if (evbuffer_reserve_space(output, rawSize, &space, 1) != 1)
+    {
+        return error::ErrorCode::NET_COMPRESS_FAILED;
+    }
+
+    ZSTD_outBuffer out = {space.iov_base, rawSize, 0};
+    for (int idx = 0; idx <= iovcnt; ++idx)
+    {
+        bool              last = idx == iovcnt;
+        ZSTD_inBuffer     in   = {last ? nullptr : iov[idx].iov_base, last ? 0 : iov[idx].iov_len, 0};
+        ZSTD_EndDirective mode = last ? ZSTD_e_end : ZSTD_e_continue;
+
+        std::size_t remaining = 0;
+        do {
+            remaining = ZSTD_compressStream2(cctx, &out, &in, mode);
+            if (ZSTD_isError(remaining) || (out.pos == out.size && (remaining != 0 || in.pos < in.size)))
+            {
+                LOG_DEBUG("payload is not compressible. size:{}", rawSize);
+                return error::ErrorCode::NET_COMPRESS_FAILED;
+            }
+        } while (last ? remaining != 0 : in.pos < in.size);
+    }
+
+    if (out.pos >= rawSize)
+    {
+        return error::ErrorCode::NET_COMPRESS_FAILED;
+    }
+
+    space.iov_len = out.pos;
+    evbuffer_commit_space(output, &space, 1);
+
+    _compressedFrames.fetch_add(1, std::memory_order_relaxed);
+    _compressedInBytes.fetch_add(rawSize, std::memory_order_relaxed);
+    _compressedOutBytes.fetch_add(out.pos, std::memory_order_relaxed);
+    return error::ErrorCode::SUCCESS;
+}
+
+std::error_code Compressor::Decompress(Message& msg)
+{
+    Header header = msg.GetHeader();
+
+    // the compressed payload is streamed segment by segment, it is never linearized
+    std::vector<evbuffer_iovec> chunks;
+    if (msg.IsChained())
+    {
+        // the zstd frame header must be contiguous
+        evbuffer* payload = msg.GetPayloadBuffer();
+        evbuffer_pullup(payload, std::min<std::size_t>(FRAME_HEADER_SIZE_MAX, msg.GetPayloadSize()));
+
+        int count = evbuffer_peek(payload, -1, nullptr, nullptr, 0);
+        chunks.resize(count);
+        evbuffer_peek(payload, -1, nullptr, chunks.data(), count);
+    }
+    else
+    {
+        chunks.push_back({(void*)msg.GetPayload(), msg.GetPayloadSize()});
+    }
+
+    if (chunks.empty())
+    {
+        return error::ErrorCode::NET_DECOMPRESS_FAILED;
+    }
+
+    unsigned long long contentSize = ZSTD_getFrameContentSize(chunks[0].iov_base, chunks[0].iov_len);
+    if (ZSTD_CONTENTSIZE_ERROR == contentSize || ZSTD_CONTENTSIZE_UNKNOWN == contentSize || 0 == contentSize ||
+        contentSize + Message::MESSAGE_HEADER_SIZE > Message::MAX_MESSAGE_SIZE)
+    {
+        LOG_WARN("invalid compressed frame. content size:{}", contentSize);
+        return error::ErrorCode::NET_DECOMPRESS_FAILED;
+    }
+
+    // the content size is the peer's word, a few bytes may declare a gigabyte
+    if (contentSize > _config._maxDecompressedSize)
+    {
+        LOG_WARN("compressed frame declares too much. content size:{}, limit:{}", contentSize,
+                 _config._maxDecompressedSize);
+        _rejectedFrames.fetch_add(1, std::memory_order_relaxed);
+        return error::ErrorCode::NET_MESSAGE_TOO_LARGE;
+    }
+
+    ZSTD_DCtx* dctx = ThreadDCtx();
+    ZSTD_DCtx_reset(dctx, ZSTD_reset_session_and_parameters);
+
+    uint32_t frameDictionaryID = ZSTD_getDictID_fromFrame(chunks[0].iov_base, chunks[0].iov_len);
+    if (frameDictionaryID != 0)
+    {
+        if (frameDictionaryID != _dictionaryID)
+        {
+            LOG_WARN("unknown compression dictionary. id:{}, local id:{}", frameDictionaryID, _dictionaryID);
+            return error::ErrorCode::NET_DECOMPRESS_FAILED;
+        }
+
+        ZSTD_DCtx_refDDict(dctx, _ddict);
+    }
+
+    evbuffer*      scratch = ThreadScratch();
+    evbuffer_iovec space;
+    if (evbuffer_reserve_space(scratch, contentSize, &space, 1) != 1)
+    {
+        return error::ErrorCode::NET_DECOMPRESS_FAILED;
+    }
+
+    ZSTD_outBuffer out       = {space.iov_base, contentSize, 0};
+    std::size_t    remaining = 1;
+    for (auto& chunk : chunks)
+    {
+        ZSTD_inBuffer in = {chunk.iov_base, chunk.iov_len, 0};
+        while (in.pos < in.size)
+        {
+            remaining = ZSTD_decompressStream(dctx, &out, &in);
+            if (ZSTD_isError(remaining) || (out.pos == out.size && remaining != 0 && in.pos < in.size))
+            {
+                LOG_WARN("failed to decompress the payload. error:{}", ZSTD_getErrorName(remaining));
+                return error::ErrorCode::NET_DECOMPRESS_FAILED;
+            }
+        }
+    }
+
+    if (remaining != 0 || out.pos != contentSize)
+    {
+        LOG_WARN("truncated compressed payload. size:{}, content size:{}", out.pos, contentSize);
+        return error::ErrorCode::NET_DECOMPRESS_FAILED;
+    }
+
+    space.iov_len = out.pos;
+    evbuffer_commit_space(scratch, &space, 1);
+
+    header._version &= ~VIPER_NET_MESSAGE_FLAG_COMPRESSED;
+    header._dataSize = contentSize;
+    msg.Reset(header, scratch, contentSize);
+
+    _decompressedFrames.fetch_add(1, std::memory_order_relaxed);
+    _decompressedBytes.fetch_add(contentSize, std::memory_order_relaxed);
+    return error::ErrorCode::SUCCESS;
+}
+
+} // namespace net
+} // namespace viper
@@ -0,0 +1,139 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#ifndef _VIPER_CORE_NET_COMPRESSION_H_
+#define _VIPER_CORE_NET_COMPRESSION_H_
+
+#include "core/net/message.h"
+#include "core/net/message_pool.h"
+
+#include <event2/buffer.h>
+
+#include <sys/uio.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <system_error>
+
+struct ZSTD_CDict_s;
+struct ZSTD_DDict_s;
+
+namespace viper {
+namespace net {
+
+// clang-format off
+
+#define VIPER_NET_COMPRESSION_LEVEL_DFT            1
+#define VIPER_NET_COMPRESSION_THRESHOLD_DFT        512
+#define VIPER_NET_COMPRESSION_MAX_DECOMPRESSED_DFT (64 * 1024 * 1024)
+
+// clang-format on
+
+struct CompressionConfig
+{
+    bool        _enable     = false;
+    int         _level      = VIPER_NET_COMPRESSION_LEVEL_DFT;
+    uint32_t    _threshold  = VIPER_NET_COMPRESSION_THRESHOLD_DFT; // smaller payloads are sent raw
+    std::string _dictionary = "";                                  // trained with `zstd --train`, optional
+
+    // A received frame declaring a larger payload is rejected before anything is
+    // allocated for it, larger payloads are sent raw. Both sides use the same limit.
+    uint32_t _maxDecompressedSize = VIPER_NET_COMPRESSION_MAX_DECOMPRESSED_DFT;
+};
+
+struct CompressionStats
+{
+    uint64_t _rawFrames          = 0; // frames sent uncompressed, below the threshold or incompressible
+    uint64_t _rawBytes           = 0; // the payload bytes of _rawFrames
+    uint64_t _compressedFrames   = 0;
+    uint64_t _compressedInBytes  = 0; // the payload bytes before compression
+    uint64_t _compressedOutBytes = 0; // the payload bytes on the wire
+    uint64_t _decompressedFrames = 0;
+    uint64_t _decompressedBytes  = 0;
+    uint64_t _rejectedFrames     = 0; // received frames declaring more than _maxDecompressedSize
+};
+
+/**
+ * @brief Compressor zstd payload compression shared by the connections of one
+ *        server or client.
+ *
+ * The compression and decompression contexts are cached per thread, so a
+ * Compressor can be used from every event loop at the same time. A dictionary
+ * is only used for a peer which announced the same dictionary id.
+ */
+class Compressor final
+{
+public:
+    explicit Compressor(const CompressionConfig& config);
+    ~Compressor();
+
+    Compressor(const Compressor&)            = delete;
+    Compressor& operator=(const Compressor&) = delete;
+
+public:
+    const CompressionConfig& Config() const;
+    uint32_t                 DictionaryID() const;
+    CompressionStats         Stats() const;
+
+    /**
+     * @brief Compress compress the payload chunks into output as one zstd frame
+     *
+     * @param iov the payload chunks
+     * @param iovcnt the chunk count
+     * @param peerDictionaryID the dictionary id announced by the peer
+     * @param output the compressed frame is appended to it
+     * @return std::error_code NET_COMPRESS_FAILED when the payload did not shrink,
+     *         output is left untouched and the payload is expected to be sent raw.
+     */
+    std::error_code Compress(const iovec* iov, int iovcnt, uint32_t peerDictionaryID, evbuffer* output);
+
+    /**
+     * @brief Decompress replace the compressed payload of msg with the original one
+     *
+     * @param msg a received message with VIPER_NET_MESSAGE_FLAG_COMPRESSED, the
+     *            flag is cleared and _dataSize updated on success
+     * @return std::error_code NET_MESSAGE_TOO_LARGE when the frame declares more
+     *         than _maxDecompressedSize
+     */
+    std::error_code Decompress(Message& msg);
+
+    void CountRaw(uint32_t payloadSize);
+
+private:
+    CompressionConfig _config;
+    ZSTD_CDict_s*     _cdict        = nullptr;
+    ZSTD_DDict_s*     _ddict        = nullptr;
+    uint32_t          _dictionaryID = 0;
+
+    std::atomic<uint64_t> _rawFrames          = 0;
+    std::atomic<uint64_t> _rawBytes           = 0;
+    std::atomic<uint64_t> _compressedFrames   = 0;
+    std::atomic<uint64_t> _compressedInBytes  = 0;
+    std::atomic<uint64_t> _compressedOutBytes = 0;
+    std::atomic<uint64_t> _decompressedFrames = 0;
+    std::atomic<uint64_t> _decompressedBytes  = 0;
+    std::atomic<uint64_t> _rejectedFrames     = 0;
+};
+
+using CompressorPtr = std::shared_ptr<Compressor>;
+
+} // namespace net
+} // namespace viper
+
+#endif
@@ -0,0 +1,255 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+
+#include "core/net/frame_decoder.h"
+#include "core/assist/math.h"
+#include "core/error/error.h"
+#include "core/log/log.h"
+#include "core/net/message.h"
+
+#include <event2/buffer.h>
+
+#include <arpa/inet.h>
+
+#include <algorithm>
+
+namespace viper {
+namespace net {
+
+FrameDecoder::~FrameDecoder()
+{
+    if (_fragments)
+    {
+        evbuffer_free(_fragments);
+        _fragments = nullptr;
+    }
+}
+
+std::error_code FrameDecoder::Decode(evbuffer* input, MessagePool* pool, std::vector<MessagePtr>& frames)
+{
+    while (true)
+    {
+        if (!_hasHeader)
+        {
+            std::size_t headerSize = 0;
+            auto        errcode    = PeekHeader(input, _header, headerSize);
+            if (!error::IsSuccess(errcode))
+            {
+                LOG_WARN("invalid frame header. first byte:0x{:02X}", (uint32_t)*evbuffer_pullup(input, 1));
+                return errcode;
+            }
+
+            if (0 == headerSize)
+            {
+                return error::ErrorCode::SUCCESS;
+            }
+
+            evbuffer_drain(input, headerSize);
+
+            uint64_t totalSize = (uint64_t)_header._dataSize + headerSize;
+            if (totalSize > Message::MAX_MESSAGE_SIZE)
+            {
+                LOG_WARN("total size {} more than max message size {}.", totalSize, (uint64_t)Message::MAX_MESSAGE_SIZE);
+                return error::ErrorCode::NET_MESSAGE_TOO_LARGE;
+            }
+
+            _hasHeader = true;
+        }
+
+        // a file frame waits until its owner chose where the payload goes
+        bool file = (_header._version & VIPER_NET_MESSAGE_FLAG_FILE) && !(_header._version & VIPER_NET_MESSAGE_FLAG_FRAGMENT);
+        if (file && !_fileDecode)
+        {
+            _filePending = true;
+            return error::ErrorCode::SUCCESS;
+        }
+
+        if (_header._dataSize > evbuffer_get_length(input))
+        {
+            return error::ErrorCode::SUCCESS;
+        }
+
+        LOG_DEBUG("received, body size:{}", _header._dataSize);
+
+        Header    frame  = _header;
+        evbuffer* source = input;
+        if (_header._version & VIPER_NET_MESSAGE_FLAG_FRAGMENT)
+        {
+            auto errcode = Reassemble(input);
+            if (!error::IsSuccess(errcode))
+            {
+                return errcode;
+            }
+
+            _hasHeader = false;
+            if (!(_header._version & VIPER_NET_MESSAGE_FLAG_LAST_FRAGMENT))
+            {
+                continue;
+            }
+
+            // the collected frame goes on like one which arrived in one piece
+            frame        = _fragmentHeader;
+            source       = _fragments;
+            _fragmenting = false;
+        }
+
+        Header      header      = frame;
+        std::size_t payloadSize = frame._dataSize;
+        if (frame._version & VIPER_NET_MESSAGE_FLAG_CRC32C)
+        {
+            auto errcode = Verify(frame, source);
+            if (!error::IsSuccess(errcode))
+            {
+                return errcode;
+            }
+
+            // the application sees the frame as if it was sent without a trailer
+            payloadSize      = frame._dataSize - Message::MESSAGE_CHECKSUM_SIZE;
+            header._version  = frame._version & ~VIPER_NET_MESSAGE_FLAG_CRC32C;
+            header._dataSize = payloadSize;
+        }
+
+        // the payload segments are moved out of the input buffer, not copied
+        MessagePtr msg = pool->Acquire();
+        msg->Reset(header, source, payloadSize);
+        frames.push_back(std::move(msg));
+
+        if (payloadSize != frame._dataSize)
+        {
+            evbuffer_drain(source, Message::MESSAGE_CHECKSUM_SIZE);
+        }
+
+        _hasHeader  = false;
+        _fileDecode = false;
+    }
+}
+
+std::error_code FrameDecoder::Reassemble(evbuffer* input)
+{
+    if (!_fragmenting)
+    {
+        _fragmentHeader           = _header;
+        _fragmentHeader._version  = _header._version & ~(VIPER_NET_MESSAGE_FLAG_FRAGMENT | VIPER_NET_MESSAGE_FLAG_LAST_FRAGMENT);
+        _fragmentHeader._dataSize = 0;
+        _fragmenting              = true;
+    }
+
+    uint64_t totalSize = (uint64_t)_fragmentHeader._dataSize + _header._dataSize + Message::MESSAGE_HEADER_SIZE;
+    if (totalSize > Message::MAX_MESSAGE_SIZE)
+    {
+        LOG_WARN("fragmented size {} more than max message size {}.", totalSize, (uint64_t)Message::MAX_MESSAGE_SIZE);
+        return error::ErrorCode::NET_MESSAGE_TOO_LARGE;
+    }
+
+    if (!_fragments)
+    {
+        _fragments = evbuffer_new();
+    }
+
+    evbuffer_remove_buffer(input, _fragments, _header._dataSize);
+    _fragmentHeader._dataSize += _header._dataSize;
+    return error::ErrorCode::SUCCESS;
+}
+
+std::error_code FrameDecoder::Verify(const Header& header, evbuffer* input)
+{
+    if (header._dataSize < Message::MESSAGE_CHECKSUM_SIZE)
+    {
+        LOG_WARN("frame too short for a checksum. size:{}", header._dataSize);
+        return error::ErrorCode::NET_CHECKSUM_MISMATCH;
+    }
+
+    // the checksum covers the full form of the header, before it was fragmented
+    Header netHeader = header;
+    Hton(netHeader);
+
+    std::size_t payloadSize = header._dataSize - Message::MESSAGE_CHECKSUM_SIZE;
+    uint32_t    checksum    = assist::CRC32C(&netHeader, Message::MESSAGE_HEADER_SIZE);
+
+    int count = evbuffer_peek(input, payloadSize, nullptr, nullptr, 0);
+
+    std::vector<evbuffer_iovec> chunks(count);
+    evbuffer_peek(input, payloadSize, nullptr, chunks.data(), count);
+    for (auto& chunk : chunks)
+    {
+        std::size_t len = std::min(chunk.iov_len, payloadSize);
+        checksum        = assist::CRC32C(chunk.iov_base, len, checksum);
+
+        payloadSize -= len;
+    }
+
+    evbuffer_ptr position;
+    evbuffer_ptr_set(input, &position, header._dataSize - Message::MESSAGE_CHECKSUM_SIZE, EVBUFFER_PTR_SET);
+
+    uint32_t trailer = 0;
+    evbuffer_copyout_from(input, &position, &trailer, Message::MESSAGE_CHECKSUM_SIZE);
+    if (ntohl(trailer) != checksum)
+    {
+        LOG_WARN("checksum mismatch. expected:0x{:08X}, actual:0x{:08X}", ntohl(trailer), checksum);
+        return error::ErrorCode::NET_CHECKSUM_MISMATCH;
+    }
+
+    return error::ErrorCode::SUCCESS;
+}
+
+std::size_t FrameDecoder::Needed() const
+{
+    if (_hasHeader)
+    {
+        return _header._dataSize;
+    }
+
+    return _compact ? Message::MESSAGE_COMPACT_HEADER_MIN_SIZE : Message::MESSAGE_HEADER_SIZE;
+}
+
+void FrameDecoder::ExpectCompact(bool enable)
+{
+    _compact = enable;
+}
+
+const Header* FrameDecoder::PendingFile() const
+{
+    return _filePending ? &_header : nullptr;
+}
+
+void FrameDecoder::TakeFile()
+{
+    _filePending = false;
+    _hasHeader   = false;
+}
+
+void FrameDecoder::DecodeFile()
+{
+    _filePending = false;
+    _fileDecode  = true;
+}
+
+void FrameDecoder::Reset()
+{
+    _header      = Header();
+    _hasHeader   = false;
+    _filePending = false;
+    _fileDecode  = false;
+    _fragmenting = false;
+    if (_fragments)
+    {
+        evbuffer_drain(_fragments, evbuffer_get_length(_fragments));
+    }
+}
+
+} // namespace net
+} // namespace viper
@@ -0,0 +1,126 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+
+#ifndef _VIPER_CORE_NET_FRAME_DECODER_H_
+#define _VIPER_CORE_NET_FRAME_DECODER_H_
+
+#include "core/net/message.h"
+#include "core/net/message_pool.h"
+
+#include <event2/buffer.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+#include <vector>
+
+namespace viper {
+namespace net {
+
+/**
+ * @brief FrameDecoder incremental decoder of the frames of one connection.
+ *
+ * The header of the current frame is parsed once, full or compact as its first
+ * byte tells, then drained from the input; the decoder remembers it until the
+ * payload is complete. Decode
+ * keeps going until the input runs out, so pipelined frames are all delivered
+ * from a single read event. Frames flagged with VIPER_NET_MESSAGE_FLAG_CRC32C are
+ * verified and delivered without their trailer. The fragments of a frame are
+ * collected until the last one arrived, the frames interleaved with them are
+ * delivered meanwhile, and the whole frame is delivered as if it came in one.
+ * Decode stops at the header of a file frame until its owner chose to take the
+ * payload itself or to have it decoded like any other frame.
+ */
+class FrameDecoder final
+{
+public:
+    FrameDecoder() = default;
+    ~FrameDecoder();
+
+    FrameDecoder(const FrameDecoder&)            = delete;
+    FrameDecoder& operator=(const FrameDecoder&) = delete;
+
+public:
+    /**
+     * @brief Decode move every complete frame of input into frames
+     *
+     * @param input the connection input buffer
+     * @param pool the pool the messages are acquired from
+     * @param frames the decoded messages are appended to it
+     * @return std::error_code SUCCESS when the input is exhausted (frames may be
+     *         empty), an error when the stream is corrupted; the frames decoded
+     *         before the error are still appended.
+     */
+    std::error_code Decode(evbuffer* input, MessagePool* pool, std::vector<MessagePtr>& frames);
+
+    /**
+     * @brief Needed return the number of bytes the current frame still waits for
+     *
+     * @return std::size_t the smallest header size when no header is pending, the
+     *         payload size of the pending frame otherwise.
+     */
+    std::size_t Needed() const;
+
+    /**
+     * @brief ExpectCompact the peer may send compact headers, a frame is then
+     *        waited for from the size of the smallest compact header on
+     *
+     * @param enable
+     */
+    void ExpectCompact(bool enable);
+
+    /**
+     * @brief PendingFile the header of the file frame Decode stopped at, its payload
+     *        is still in the input
+     *
+     * @return const Header* nullptr when Decode did not stop at a file frame
+     */
+    const Header* PendingFile() const;
+
+    /**
+     * @brief TakeFile the caller consumes the payload of the pending file frame from
+     *        the input, DecodeFile the next Decode delivers it as a message
+     */
+    void TakeFile();
+    void DecodeFile();
+
+    void Reset();
+
+private:
+    // check the CRC32C trailer of a frame, the input holds the whole frame
+    std::error_code Verify(const Header& header, evbuffer* input);
+
+    // append the payload of the pending fragment to the frame it belongs to
+    std::error_code Reassemble(evbuffer* input);
+
+private:
+    Header _header;
+    bool   _hasHeader   = false;
+    bool   _filePending = false;
+    bool   _fileDecode  = false;
+    bool   _compact     = false;
+
+    // the frame the fragments are collected for, _fragmentHeader._dataSize grows with them
+    Header    _fragmentHeader;
+    evbuffer* _fragments   = nullptr;
+    bool      _fragmenting = false;
+};
+
+} // namespace net
+} // namespace viper
+
+#endif
@@ -0,0 +1,287 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#include "core/net/io_uring.h"
+#include "core/error/error.h"
+#include "core/log/log.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace viper {
+namespace net {
+
+IOUring::~IOUring()
+{
+    // the kernel cancels what is still in flight before the memory goes away
+    if (_fd >= 0)
+    {
+        close(_fd);
+    }
+
+    if (_buffers)
+    {
+        munmap(_buffers, (std::size_t)_bufCount * _bufSize);
+    }
+
+    if (_sqes)
+    {
+        munmap(_sqes, _sqesSize);
+    }
+
+    if (_cqRing && _cqRing != _sqRing)
+    {
+        munmap(_cqRing, _cqRingSize);
+    }
+
+    if (_sqRing)
+    {
+        munmap(_sqRing, _sqRingSize);
+    }
+}
+
+std::error_code IOUring::Init(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+
+    _fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (_fd < 0)
+    {
+        LOG_ERROR("failed to set up io_uring. errno:{}", errno);
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    _sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    _sqesSize   = params.sq_entries * sizeof(io_uring_sqe);
+
+    // both rings share one mapping on every kernel with multishot receives
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single)
+    {
+        _sqRingSize = _cqRingSize = std::max(_sqRingSize, _cqRingSize);
+    }
+
+    _sqRing = mmap(nullptr, _sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (MAP_FAILED == _sqRing)
+    {
+        _sqRing = nullptr;
+        LOG_ERROR("failed to map the io_uring submission queue. errno:{}", errno);
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    _cqRing = single ? _sqRing
+                     : mmap(nullptr, _cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd,
+                            IORING_OFF_CQ_RING);
+    if (MAP_FAILED == _cqRing)
+    {
+        _cqRing = nullptr;
+        LOG_ERROR("failed to map the io_uring completion queue. errno:{}", errno);
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    auto sqes = mmap(nullptr, _sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+    if (MAP_FAILED == sqes)
+    {
+        LOG_ERROR("failed to map the io_uring submission entries. errno:{}", errno);
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    char* sq   = static_cast<char*>(_sqRing);
+    char* cq   = static_cast<char*>(_cqRing);
+    _sqes      = static_cast<io_uring_sqe*>(sqes);
+    _sqEntries = params.sq_entries;
+    _sqHead    = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    _sqTail    = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    _sqMask    = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    _sqArray   = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    _cqHead    = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    _cqTail    = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    _cqMask    = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    _cqes      = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    return error::ErrorCode::SUCCESS;
+}
+
+std::error_code IOUring::RegisterEventFd(int fd)
+{
+    if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_EVENTFD, &fd, 1) < 0)
+    {
+        LOG_ERROR("failed to register the io_uring eventfd. errno:{}", errno);
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    return error::ErrorCode::SUCCESS;
+}
+
+std::error_code IOUring::SetupBuffers(uint16_t group, uint16_t count, uint32_t size)
+{
+    auto buffers = mmap(nullptr, (std::size_t)count * size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (MAP_FAILED == buffers)
+    {
+        LOG_ERROR("failed to allocate the io_uring buffers. errno:{}", errno);
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    _buffers  = static_cast<char*>(buffers);
+    _bufCount = count;
+    _bufSize  = size;
+    _bufGroup = group;
+
+    // all buffers are handed over with one entry, the kernel numbers them from 0
+    io_uring_sqe* sqe = GetSQE();
+    sqe->opcode       = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd           = count;
+    sqe->addr         = (uint64_t)_buffers;
+    sqe->len          = size;
+    sqe->off          = 0;
+    sqe->buf_group    = group;
+
+    // Reap skips the completions of the provided buffers, this one is waited for
+    // here, without the buffers every receive would fail with ENOBUFS
+    int submitted = Submit();
+    if (submitted >= 0 && syscall(__NR_io_uring_enter, _fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0)
+    {
+        submitted = -errno;
+    }
+
+    if (submitted < 0)
+    {
+        LOG_ERROR("failed to provide the io_uring buffers. errno:{}", -submitted);
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    unsigned     head = *_cqHead;
+    io_uring_cqe cqe  = _cqes[head & *_cqMask];
+    std::atomic_ref<unsigned>(*_cqHead).store(head + 1, std::memory_order_release);
+    if (cqe.res < 0)
+    {
+        LOG_ERROR("the kernel did not take the io_uring buffers. errno:{}", -cqe.res);
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    return error::ErrorCode::SUCCESS;
+}
+
+io_uring_sqe* IOUring::GetSQE()
+{
+    io_uring_sqe* sqe = TakeSQE();
+    if (!sqe)
+    {
+        Submit();
+        sqe = TakeSQE();
+    }
+
+    return sqe;
+}
+
+io_uring_sqe* IOUring::TakeSQE()
+{
+    unsigned head = std::atomic_ref<unsigned>(*_sqHead).load(std::memory_order_acquire);
+    unsigned tail = *_sqTail + _sqPending;
+    if (tail - head >= _sqEntries)
+    {
+        return nullptr;
+    }
+
+    unsigned idx  = tail & *_sqMask;
+    _sqArray[idx] = idx;
+    ++_sqPending;
+
+    memset(&_sqes[idx], 0, sizeof(io_uring_sqe));
+    return &_sqes[idx];
+}
+
+int IOUring::Submit()
+{
+    if (_sqPending > 0)
+    {
+        std::atomic_ref<unsigned>(*_sqTail).store(*_sqTail + _sqPending, std::memory_order_release);
+        _sqPending = 0;
+    }
+
+    // entries published by an earlier failed submit are handed over again
+    unsigned count = *_sqTail - std::atomic_ref<unsigned>(*_sqHead).load(std::memory_order_acquire);
+    if (0 == count)
+    {
+        return 0;
+    }
+
+    int submitted = (int)syscall(__NR_io_uring_enter, _fd, count, 0, 0, nullptr, 0);
+    if (submitted < 0)
+    {
+        return -errno;
+    }
+
+    // the kernel made space, the buffers recycled while the queue was full go with the next submit
+    while (!_recycled.empty())
+    {
+        io_uring_sqe* sqe = TakeSQE();
+        if (!sqe)
+        {
+            break;
+        }
+
+        ProvideBuffer(sqe, _recycled.back());
+        _recycled.pop_back();
+    }
+
+    return submitted;
+}
+
+char* IOUring::Buffer(uint16_t bid)
+{
+    return _buffers + (std::size_t)bid * _bufSize;
+}
+
+void IOUring::RecycleBuffer(uint16_t bid)
+{
+    io_uring_sqe* sqe = GetSQE();
+    if (!sqe)
+    {
+        LOG_WARN("the io_uring submission queue is full, buffer {} waits for the next submit", bid);
+        _recycled.push_back(bid);
+        return;
+    }
+
+    ProvideBuffer(sqe, bid);
+}
+
+void IOUring::ProvideBuffer(io_uring_sqe* sqe, uint16_t bid)
+{
+    // goes to the kernel with the next submit, ahead of the receives queued after it
+    sqe->opcode    = IORING_OP_PROVIDE_BUFFERS;
+    sqe->flags     = IOSQE_CQE_SKIP_SUCCESS;
+    sqe->fd        = 1;
+    sqe->addr      = (uint64_t)Buffer(bid);
+    sqe->len       = _bufSize;
+    sqe->off       = bid;
+    sqe->buf_group = _bufGroup;
+}
+
+uint16_t IOUring::BufferGroup()
+{
+    return _bufGroup;
+}
+
+} // namespace net
+} // namespace viper
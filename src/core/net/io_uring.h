@@ -0,0 +1,170 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#ifndef _VIPER_CORE_NET_IO_URING_H_
+#define _VIPER_CORE_NET_IO_URING_H_
+
+#include <linux/io_uring.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+#include <vector>
+
+namespace viper {
+namespace net {
+
+/**
+ * @brief IOUring a minimal io_uring instance on top of the raw system calls:
+ *        one submission and one completion queue plus one group of provided
+ *        receive buffers.
+ *
+ * It is not thread safe, it belongs to one event loop.
+ */
+class IOUring final
+{
+public:
+    IOUring() = default;
+    ~IOUring();
+
+    IOUring(const IOUring&)            = delete;
+    IOUring& operator=(const IOUring&) = delete;
+
+public:
+    /**
+     * @brief Init create the rings
+     *
+     * @param entries the submission queue size, a power of two
+     * @return std::error_code
+     */
+    std::error_code Init(unsigned entries);
+
+    /**
+     * @brief RegisterEventFd signal fd on every completion, so the ring can be
+     *        watched by an event loop
+     *
+     * @param fd an eventfd
+     * @return std::error_code
+     */
+    std::error_code RegisterEventFd(int fd);
+
+    /**
+     * @brief SetupBuffers provide a group of buffers the kernel picks receive
+     *        buffers from, the buffer ids are 0 to count - 1. Waits until the
+     *        kernel took them, called before anything else is submitted.
+     *
+     * @param group the buffer group id used with IOSQE_BUFFER_SELECT
+     * @param count the buffer count
+     * @param size the size of each buffer
+     * @return std::error_code
+     */
+    std::error_code SetupBuffers(uint16_t group, uint16_t count, uint32_t size);
+
+    /**
+     * @brief GetSQE return a cleared submission entry, submitting the queued ones
+     *        first when the queue is full
+     *
+     * @return io_uring_sqe* nullptr when the kernel did not take any entry
+     */
+    io_uring_sqe* GetSQE();
+
+    /**
+     * @brief Submit hand the queued submission entries to the kernel
+     *
+     * @return int the number of entries submitted or -errno
+     */
+    int Submit();
+
+    /**
+     * @brief Reap call fn with each completion entry and consume them
+     *
+     * @return unsigned the number of completions
+     */
+    template <typename FN>
+    unsigned Reap(FN&& fn)
+    {
+        unsigned head  = *_cqHead;
+        unsigned tail  = std::atomic_ref<unsigned>(*_cqTail).load(std::memory_order_acquire);
+        unsigned count = 0;
+        for (; head != tail; ++head, ++count)
+        {
+            // copied, the slot is reused once the head moves
+            io_uring_cqe cqe = _cqes[head & *_cqMask];
+            std::atomic_ref<unsigned>(*_cqHead).store(head + 1, std::memory_order_release);
+
+            // the buffers handed back only complete when they failed
+            if (0 == cqe.user_data)
+            {
+                continue;
+            }
+
+            fn(cqe);
+        }
+
+        return count;
+    }
+
+    char* Buffer(uint16_t bid);
+
+    /**
+     * @brief RecycleBuffer hand a buffer back to the kernel once its data was consumed,
+     *        with a full submission queue it is handed back after the next submit
+     *
+     * @param bid the buffer id of the completion
+     */
+    void     RecycleBuffer(uint16_t bid);
+    uint16_t BufferGroup();
+
+private:
+    io_uring_sqe* TakeSQE();
+    void          ProvideBuffer(io_uring_sqe* sqe, uint16_t bid);
+
+private:
+    int _fd = -1;
+
+    // the mapped rings
+    void*         _sqRing     = nullptr;
+    void*         _cqRing     = nullptr;
+    io_uring_sqe* _sqes       = nullptr;
+    std::size_t   _sqRingSize = 0;
+    std::size_t   _cqRingSize = 0;
+    std::size_t   _sqesSize   = 0;
+
+    unsigned      _sqEntries = 0;
+    unsigned*     _sqHead    = nullptr;
+    unsigned*     _sqTail    = nullptr;
+    unsigned*     _sqMask    = nullptr;
+    unsigned*     _sqArray   = nullptr;
+    unsigned      _sqPending = 0; // the local tail, published by Submit
+    unsigned*     _cqHead    = nullptr;
+    unsigned*     _cqTail    = nullptr;
+    unsigned*     _cqMask    = nullptr;
+    io_uring_cqe* _cqes      = nullptr;
+
+    // the provided buffers
+    char*    _buffers  = nullptr;
+    uint16_t _bufCount = 0;
+    uint32_t _bufSize  = 0;
+    uint16_t _bufGroup = 0;
+
+    std::vector<uint16_t> _recycled; // the buffers which did not get an entry yet
+};
+
+} // namespace net
+} // namespace viper
+
+#endif
@@ -15,9 +15,12 @@
 **/
 
 #include "core/net/message.h"
+#include "core/error/error.h"
+#include "core/net/message_pool.h"
 
 #include <cstdint>
 #include <cstring>
+#include <limits>
 #include <new>
 
 #include <arpa/inet.h>
@@ -28,20 +31,70 @@
 namespace viper {
 namespace net {
 
+static_assert(Message::MESSAGE_COMPACT_HEADER_MAX_SIZE >= Message::MESSAGE_HEADER_SIZE,
+              "a header of either form must fit into the peek buffer");
+
+namespace {
+
+uint8_t* PutVarint(uint8_t* out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value  = value >> 7;
+    }
+
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+// the bytes used, 0 when data ends first, -1 when the varint is longer than maxSize
+int GetVarint(const uint8_t* data, const uint8_t* end, std::size_t maxSize, uint64_t& value)
+{
+    value = 0;
+    for (std::size_t idx = 0; idx < maxSize; ++idx)
+    {
+        if (data + idx >= end)
+        {
+            return 0;
+        }
+
+        value = value | (uint64_t)(data[idx] & 0x7f) << (7 * idx);
+        if (!(data[idx] & 0x80))
+        {
+            return idx + 1;
+        }
+    }
+
+    return -1;
+}
+
+} // namespace
+
+Message::Message(MessagePool* pool)
+{
+    _pool = pool;
+}
+
 Message::Message(const Header& header, const char* payload, uint32_t payloadSize)
 {
     Reset(header, payload, payloadSize);
 }
 
+Message::Message(const Header& header, evbuffer* payload, uint32_t payloadSize)
+{
+    Reset(header, payload, payloadSize);
+}
+
 Message::~Message()
 {
-    if (_data)
+    Clear();
+
+    if (_payload)
     {
-        free(_data);
-        _data = nullptr;
+        evbuffer_free(_payload);
+        _payload = nullptr;
     }
-
-    _dataSize = 0;
 }
 
 void Message::Reset(const Header& header, const char* payload, uint32_t payloadSize)
@@ -50,28 +103,80 @@ void Message::Reset(const Header& header, const char* payload, uint32_t payloadS
     ResetPayload(payload, payloadSize);
 }
 
+void Message::Reset(const Header& header, evbuffer* payload, uint32_t payloadSize)
+{
+    ResetHeader(header);
+    ResetPayload(payload, payloadSize);
+}
+
 void Message::ResetHeader(const Header& header)
 {
     memcpy(&_header, &header, MESSAGE_HEADER_SIZE);
+
+    // the linearized copy of a chained message carries the old header
+    if (_chained && _data)
+    {
+        ReleaseData();
+    }
 }
 
 void Message::ResetPayload(const char* payload, uint32_t payloadSize)
 {
-    if (_data)
+    Clear();
+
+    _dataSize = MESSAGE_HEADER_SIZE + payloadSize;
+    _data     = AllocateData(_dataSize);
+
+    memcpy(_data, &_header, MESSAGE_HEADER_SIZE);
+    memcpy(_data + MESSAGE_HEADER_SIZE, payload, payloadSize);
+}
+
+void Message::ResetPayload(evbuffer* source, uint32_t payloadSize)
+{
+    Clear();
+
+    if (!_payload)
     {
-        free(_data);
-        _data = nullptr;
+        _payload = evbuffer_new();
+        if (!_payload)
+        {
+            throw std::bad_alloc();
+        }
     }
 
-    _dataSize = MESSAGE_HEADER_SIZE + payloadSize;
-    _data     = (char*)malloc(sizeof(char) * _dataSize);
-    if (!_data)
+    // Whole segments are moved from the source, only a partially consumed
+    // segment at the boundary is copied.
+    int moved = evbuffer_remove_buffer(source, _payload, payloadSize);
+    if (moved < 0)
     {
         throw std::bad_alloc();
     }
 
-    memcpy(_data, &_header, MESSAGE_HEADER_SIZE);
-    memcpy(_data + MESSAGE_HEADER_SIZE, payload, payloadSize);
+    _payloadSize = moved;
+    _chained     = true;
+}
+
+void Message::ResetPayloadReference(const char* payload, uint32_t payloadSize,
+                                    evbuffer_ref_cleanup_cb cleanup, void* cleanupArg)
+{
+    Clear();
+
+    if (!_payload)
+    {
+        _payload = evbuffer_new();
+        if (!_payload)
+        {
+            throw std::bad_alloc();
+        }
+    }
+
+    if (evbuffer_add_reference(_payload, payload, payloadSize, cleanup, cleanupArg) != 0)
+    {
+        throw std::bad_alloc();
+    }
+
+    _payloadSize = payloadSize;
+    _chained     = true;
 }
 
 const Header& Message::GetHeader() const
@@ -81,24 +186,120 @@ const Header& Message::GetHeader() const
 
 const char* Message::GetData() const
 {
+    if (_chained && !_data)
+    {
+        // linearize on demand, only callers which need the whole frame pay for the copy
+        _dataSize = MESSAGE_HEADER_SIZE + _payloadSize;
+        _data     = AllocateData(_dataSize);
+
+        memcpy(_data, &_header, MESSAGE_HEADER_SIZE);
+        evbuffer_copyout(_payload, _data + MESSAGE_HEADER_SIZE, _payloadSize);
+    }
+
     return _data;
 }
 
 uint32_t Message::GetDataSize() const
 {
+    if (_chained)
+    {
+        return MESSAGE_HEADER_SIZE + _payloadSize;
+    }
+
     return _dataSize;
 }
 
 const char* Message::GetPayload() const
 {
+    if (_chained && !_data)
+    {
+        if (0 == _payloadSize)
+        {
+            return "";
+        }
+
+        // a single segment is returned in place, a chain is linearized once
+        return (const char*)evbuffer_pullup(_payload, -1);
+    }
+
     return _data + MESSAGE_HEADER_SIZE;
 }
 
 uint32_t Message::GetPayloadSize() const
 {
+    if (_chained)
+    {
+        return _payloadSize;
+    }
+
     return _dataSize - MESSAGE_HEADER_SIZE;
 }
 
+bool Message::IsChained() const
+{
+    return _chained;
+}
+
+evbuffer* Message::GetPayloadBuffer() const
+{
+    return _chained ? _payload : nullptr;
+}
+
+char* Message::AllocateData(uint32_t size) const
+{
+    char* data = nullptr;
+    if (_pool)
+    {
+        data = _pool->Allocate(size, _capacity);
+    }
+    else
+    {
+        data      = (char*)malloc(sizeof(char) * size);
+        _capacity = size;
+    }
+
+    if (!data)
+    {
+        throw std::bad_alloc();
+    }
+
+    return data;
+}
+
+void Message::ReleaseData()
+{
+    if (_data)
+    {
+        if (_pool)
+        {
+            _pool->Deallocate(_data, _capacity);
+        }
+        else
+        {
+            free(_data);
+        }
+
+        _data = nullptr;
+    }
+
+    _dataSize = 0;
+    _capacity = 0;
+}
+
+void Message::Clear()
+{
+    ReleaseData();
+
+    // keep the evbuffer itself, it is reused by the next chained payload
+    if (_payload)
+    {
+        evbuffer_drain(_payload, evbuffer_get_length(_payload));
+    }
+
+    _payloadSize = 0;
+    _chained     = false;
+}
+
 void Hton(Header& header)
 {
     header._version  = htonl(header._version);
@@ -133,6 +334,126 @@ void Ntoh(Header& header)
     }
 }
 
+std::size_t EncodeHeader(const Header& header, bool compact, uint8_t* out)
+{
+    if (!compact)
+    {
+        Header netHeader = header;
+        Hton(netHeader);
+        memcpy(out, &netHeader, Message::MESSAGE_HEADER_SIZE);
+        return Message::MESSAGE_HEADER_SIZE;
+    }
+
+    uint8_t* control = out;
+    uint8_t* end     = PutVarint(out + 1, header._msgType);
+    end              = PutVarint(end, header._dataSize);
+
+    *control = VIPER_NET_MESSAGE_COMPACT_MARK;
+    if (header._version)
+    {
+        *control = *control | VIPER_NET_MESSAGE_COMPACT_VERSION;
+        end      = PutVarint(end, header._version);
+    }
+
+    if (header._tag)
+    {
+        *control = *control | VIPER_NET_MESSAGE_COMPACT_TAG;
+        end      = PutVarint(end, header._tag);
+    }
+
+    if (header._sequence)
+    {
+        *control = *control | VIPER_NET_MESSAGE_COMPACT_SEQUENCE;
+        end      = PutVarint(end, header._sequence);
+    }
+
+    if (header._timestamp)
+    {
+        *control = *control | VIPER_NET_MESSAGE_COMPACT_TIMESTAMP;
+        end      = PutVarint(end, header._timestamp);
+    }
+
+    return end - out;
+}
+
+std::error_code DecodeHeader(const uint8_t* data, std::size_t size, Header& header, std::size_t& headerSize)
+{
+    headerSize = 0;
+    if (0 == size)
+    {
+        return error::ErrorCode::SUCCESS;
+    }
+
+    if (!(data[0] & VIPER_NET_MESSAGE_COMPACT_MARK))
+    {
+        if (size < Message::MESSAGE_HEADER_SIZE)
+        {
+            return error::ErrorCode::SUCCESS;
+        }
+
+        memcpy(&header, data, Message::MESSAGE_HEADER_SIZE);
+        Ntoh(header);
+        if (header._magic != VIPER_NET_MESSAGE_MAGIC)
+        {
+            return error::ErrorCode::NET_INVALID_MAGIC;
+        }
+
+        headerSize = Message::MESSAGE_HEADER_SIZE;
+        return error::ErrorCode::SUCCESS;
+    }
+
+    uint8_t control = data[0];
+    if (control & VIPER_NET_MESSAGE_COMPACT_RESERVED)
+    {
+        return error::ErrorCode::NET_INVALID_MAGIC;
+    }
+
+    // msgType, dataSize, version, tag, sequence and timestamp in their wire order
+    uint64_t    values[6]  = {0};
+    bool        present[6] = {true, true, (bool)(control & VIPER_NET_MESSAGE_COMPACT_VERSION),
+                              (bool)(control & VIPER_NET_MESSAGE_COMPACT_TAG),
+                              (bool)(control & VIPER_NET_MESSAGE_COMPACT_SEQUENCE),
+                              (bool)(control & VIPER_NET_MESSAGE_COMPACT_TIMESTAMP)};
+    std::size_t offset     = 1;
+    for (std::size_t idx = 0; idx < 6; ++idx)
+    {
+        if (!present[idx])
+        {
+            continue;
+        }
+
+        bool wide = idx >= 4;
+        int  used = GetVarint(data + offset, data + size, wide ? 10 : 5, values[idx]);
+        if (0 == used)
+        {
+            return error::ErrorCode::SUCCESS;
+        }
+
+        if (used < 0 || (!wide && values[idx] > std::numeric_limits<uint32_t>::max()))
+        {
+            return error::ErrorCode::NET_INVALID_MAGIC;
+        }
+
+        offset += used;
+    }
+
+    header            = Header();
+    header._msgType   = values[0];
+    header._dataSize  = values[1];
+    header._version   = values[2];
+    header._tag       = values[3];
+    header._sequence  = values[4];
+    header._timestamp = values[5];
+    headerSize        = offset;
+    return error::ErrorCode::SUCCESS;
+}
+
+std::error_code PeekHeader(evbuffer* input, Header& header, std::size_t& headerSize)
+{
+    uint8_t    data[Message::MESSAGE_COMPACT_HEADER_MAX_SIZE];
+    ev_ssize_t size = evbuffer_copyout(input, data, sizeof(data));
+    return DecodeHeader(data, size > 0 ? size : 0, header, headerSize);
+}
+
 } // namespace net
 } // namespace viper
-
@@ -17,12 +17,18 @@
 #ifndef _VIPER_CORE_NET_MESSAGE_H_
 #define _VIPER_CORE_NET_MESSAGE_H_
 
+#include <event2/buffer.h>
+
+#include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <system_error>
 
 namespace viper {
 namespace net {
 
+class MessagePool;
+
 // clang-format off
 
 #define VIPER_NET_MESSAGE_MAGIC                   0xbeeabeaf
@@ -30,8 +36,36 @@ namespace net {
 #define VIPER_NET_MESSAGE_KEEPALIVE_PONG          "KEEPALIVE PONG"
 #define VIPER_NET_MESSAGE_PROTOCOL_KEEPALIVE_PING 0x0000
 #define VIPER_NET_MESSAGE_PROTOCOL_KEEPALIVE_PONG 0x0001
+#define VIPER_NET_MESSAGE_PROTOCOL_HELLO          0x0002 // _tag carries the capabilities
 #define VIPER_NET_MESSAGE_PROTOCOL_BASE           0x0010
 
+// the low 16 bits of Header._version are the version, the high ones are frame flags,
+// bits 24 to 31 stay clear: the first byte of a header tells its form by them
+#define VIPER_NET_MESSAGE_VERSION_MASK            0x0000ffff
+#define VIPER_NET_MESSAGE_FLAG_COMPRESSED         0x00010000 // the payload is one zstd frame
+#define VIPER_NET_MESSAGE_FLAG_CRC32C             0x00020000 // a CRC32C trailer follows the payload
+#define VIPER_NET_MESSAGE_FLAG_RESPONSE           0x00040000 // _sequence is the one of the request
+#define VIPER_NET_MESSAGE_FLAG_FRAGMENT           0x00080000 // the payload is a part of a larger frame
+#define VIPER_NET_MESSAGE_FLAG_LAST_FRAGMENT      0x00100000 // the part which completes the frame
+#define VIPER_NET_MESSAGE_FLAG_STREAM             0x00200000 // a chunk of a stream, _sequence is the stream id
+#define VIPER_NET_MESSAGE_FLAG_STREAM_END         0x00400000 // the last chunk of its stream
+#define VIPER_NET_MESSAGE_FLAG_FILE               0x00800000 // the payload is a file range, it may be landed in a file
+
+#define VIPER_NET_MESSAGE_CAPABILITY_ZSTD         0x00000001 // _sequence of the hello is the dictionary id
+#define VIPER_NET_MESSAGE_CAPABILITY_CRC32C       0x00000002
+#define VIPER_NET_MESSAGE_CAPABILITY_FRAGMENT     0x00000004 // large frames may arrive in fragments
+#define VIPER_NET_MESSAGE_CAPABILITY_COMPACT      0x00000008 // frames may arrive with a compact header
+
+// The compact header, a control byte followed by the varints of _msgType, _dataSize
+// and of the fields the control byte flags, the ones left out are 0. The magic is
+// not sent, the mark tells it from the first byte of a full header.
+#define VIPER_NET_MESSAGE_COMPACT_MARK            0x80
+#define VIPER_NET_MESSAGE_COMPACT_VERSION         0x40
+#define VIPER_NET_MESSAGE_COMPACT_TAG             0x20
+#define VIPER_NET_MESSAGE_COMPACT_SEQUENCE        0x10
+#define VIPER_NET_MESSAGE_COMPACT_TIMESTAMP       0x08
+#define VIPER_NET_MESSAGE_COMPACT_RESERVED        0x07
+
 // clang-format on
 
 struct Header
@@ -45,40 +79,104 @@ struct Header
     uint64_t _timestamp = 0;
 };
 
+/**
+ * @brief Message a frame header plus its payload.
+ *
+ * The payload is either a contiguous copy (ResetPayload with a pointer) or a
+ * chain of refcounted evbuffer segments (ResetPayload with an evbuffer and
+ * ResetPayloadReference). Chained payloads are moved or referenced, never
+ * copied, on the receive and send paths; GetPayload and GetData still return
+ * contiguous memory and only linearize the chain when they are called.
+ */
 class Message final
 {
 public:
     Message() = default;
+    explicit Message(MessagePool* pool);
     Message(const Header& header, const char* payload, uint32_t payloadSize);
+    Message(const Header& header, evbuffer* payload, uint32_t payloadSize);
     ~Message();
 
+    Message(const Message&)            = delete;
+    Message& operator=(const Message&) = delete;
+
 public:
     enum
     {
-        MESSAGE_HEADER_SIZE = sizeof(Header),
-        MAX_MESSAGE_SIZE    = 1024 * 1024 * 1024
+        MESSAGE_HEADER_SIZE   = sizeof(Header),
+        MESSAGE_CHECKSUM_SIZE = sizeof(uint32_t), // the CRC32C of the header and the payload
+        MAX_MESSAGE_SIZE      = 1024 * 1024 * 1024,
+
+        // the control byte, then 4 varints of 32 bits and 2 of 64 bits at most
+        MESSAGE_COMPACT_HEADER_MIN_SIZE = 3,
+        MESSAGE_COMPACT_HEADER_MAX_SIZE = 1 + 4 * 5 + 2 * 10
 
     };
 
 public:
     void          Reset(const Header& header, const char* payload, uint32_t payloadSize);
+    void          Reset(const Header& header, evbuffer* payload, uint32_t payloadSize);
     void          ResetHeader(const Header& header);
     void          ResetPayload(const char* data, uint32_t dataSize);
+    void          ResetPayload(evbuffer* source, uint32_t dataSize);
+    void          ResetPayloadReference(const char* data, uint32_t dataSize,
+                                        evbuffer_ref_cleanup_cb cleanup = nullptr, void* cleanupArg = nullptr);
     const Header& GetHeader() const;
     const char*   GetData() const;
     uint32_t      GetDataSize() const;
     const char*   GetPayload() const;
     uint32_t      GetPayloadSize() const;
+    bool          IsChained() const;
+    evbuffer*     GetPayloadBuffer() const;
+
+private:
+    friend class MessagePool;
+
+    char* AllocateData(uint32_t size) const;
+    void  ReleaseData();
+    void  Clear();
 
 private:
-    Header   _header;
-    char*    _data     = nullptr; // The header is already included in the data.
-    uint32_t _dataSize = 0;
+    MessagePool*     _pool = nullptr; // Contiguous data comes from the pool size classes when set.
+    Header           _header;
+    mutable char*    _data        = nullptr; // The header is already included in the data.
+    mutable uint32_t _dataSize    = 0;
+    mutable uint32_t _capacity    = 0;
+    evbuffer*        _payload     = nullptr; // The chained payload, the header is not included.
+    uint32_t         _payloadSize = 0;
+    bool             _chained     = false;
 };
 
 void Hton(Header& header);
 void Ntoh(Header& header);
 
+/**
+ * @brief EncodeHeader write a header in its wire form
+ *
+ * @param header the header in host byte order
+ * @param compact the compact form instead of the full one
+ * @param out room for MESSAGE_COMPACT_HEADER_MAX_SIZE bytes
+ * @return std::size_t the size written
+ */
+std::size_t EncodeHeader(const Header& header, bool compact, uint8_t* out);
+
+/**
+ * @brief DecodeHeader read the header at the start of data, full or compact as
+ *        its first byte tells
+ *
+ * @param data the received bytes
+ * @param size the received size
+ * @param header the header in host byte order
+ * @param headerSize the size of the header on the wire, 0 when data does not hold all of it yet
+ * @return std::error_code NET_INVALID_MAGIC when data does not start with a header
+ */
+std::error_code DecodeHeader(const uint8_t* data, std::size_t size, Header& header, std::size_t& headerSize);
+
+/**
+ * @brief PeekHeader DecodeHeader on the start of a buffer, which is left as it is
+ */
+std::error_code PeekHeader(evbuffer* input, Header& header, std::size_t& headerSize);
+
 using MessagePtr = std::shared_ptr<Message>;
 
 } // namespace net
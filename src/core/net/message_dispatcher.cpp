@@ -0,0 +1,146 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#include "core/net/message_dispatcher.h"
+#include "core/error/error.h"
+#include "core/log/log.h"
+
+#include <utility>
+
+namespace viper {
+namespace net {
+
+MessageDispatcher::MessageDispatcher(std::size_t workerQueues, std::size_t queueSize)
+{
+    // one consumer a queue, which keeps the offloaded messages of a connection in order
+    _workers = std::make_shared<assist::ExecutionMultiQueue>("dispatch", queueSize, workerQueues, 1);
+}
+
+std::error_code MessageDispatcher::RegisterHandler(uint32_t msgType, MessageHandler handler, ExecutionMode mode)
+{
+    if (msgType <= VIPER_NET_MESSAGE_PROTOCOL_BASE || msgType >= VIPER_NET_DISPATCH_MAX_MSG_TYPE || !handler)
+    {
+        LOG_ERROR("invalid handler registration. msg type:{}", msgType);
+        return error::ErrorCode::INVALID_PARAMETER;
+    }
+
+    if (msgType >= _routes.size())
+    {
+        _routes.resize(msgType + 1);
+    }
+
+    _routes[msgType]._handler = std::move(handler);
+    _routes[msgType]._mode    = mode;
+    return error::ErrorCode::SUCCESS;
+}
+
+void MessageDispatcher::SetFallback(MessageHandler handler)
+{
+    _fallback = std::move(handler);
+}
+
+DispatchStats MessageDispatcher::Stats()
+{
+    DispatchStats stats;
+    stats._inline    = _inline.load(std::memory_order_relaxed);
+    stats._offloaded = _offloaded.load(std::memory_order_relaxed);
+    stats._dropped   = _dropped.load(std::memory_order_relaxed);
+    stats._unhandled = _unhandled.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void MessageDispatcher::HandleData(TCPConnectionPtr conn, const MessagePtr msg)
+{
+    auto route = Find(msg->GetHeader()._msgType);
+    if (!route)
+    {
+        _unhandled.fetch_add(1, std::memory_order_relaxed);
+        if (_fallback)
+        {
+            _fallback(conn, msg);
+        }
+
+        return;
+    }
+
+    if (ExecutionMode::OFFLOAD == route->_mode)
+    {
+        Offload(conn, {{route, msg}});
+        return;
+    }
+
+    _inline.fetch_add(1, std::memory_order_relaxed);
+    route->_handler(conn, msg);
+}
+
+void MessageDispatcher::HandleBatch(TCPConnectionPtr conn, const std::vector<MessagePtr>& msgs)
+{
+    // the offloaded messages of a read event go to the worker as one task
+    std::vector<std::pair<const Route*, MessagePtr>> offload;
+    for (const auto& msg : msgs)
+    {
+        auto route = Find(msg->GetHeader()._msgType);
+        if (route && ExecutionMode::OFFLOAD == route->_mode)
+        {
+            offload.emplace_back(route, msg);
+            continue;
+        }
+
+        HandleData(conn, msg);
+    }
+
+    if (!offload.empty())
+    {
+        Offload(conn, std::move(offload));
+    }
+}
+
+const MessageDispatcher::Route* MessageDispatcher::Find(uint32_t msgType)
+{
+    if (msgType >= _routes.size() || !_routes[msgType]._handler)
+    {
+        return nullptr;
+    }
+
+    return &_routes[msgType];
+}
+
+void MessageDispatcher::Offload(TCPConnectionPtr conn, std::vector<std::pair<const Route*, MessagePtr>>&& msgs)
+{
+    std::size_t count = msgs.size();
+    auto        batch = std::make_shared<std::vector<std::pair<const Route*, MessagePtr>>>(std::move(msgs));
+    auto        hash  = static_cast<uint32_t>(std::hash<TCPConnection*>()(conn.get()));
+
+    auto errcode = _workers->Enqueue(hash, [conn, batch]() {
+        for (const auto& [route, msg] : *batch)
+        {
+            route->_handler(conn, msg);
+        }
+    });
+
+    if (errcode)
+    {
+        _dropped.fetch_add(count, std::memory_order_relaxed);
+        LOG_WARN("the dispatch worker queue is full, messages dropped. {}, count:{}, error:{}", conn->ID(), count,
+                 errcode.message());
+        return;
+    }
+
+    _offloaded.fetch_add(count, std::memory_order_relaxed);
+}
+
+} // namespace net
+} // namespace viper
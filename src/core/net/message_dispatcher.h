@@ -0,0 +1,132 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#ifndef _VIPER_CORE_NET_MESSAGE_DISPATCHER_H_
+#define _VIPER_CORE_NET_MESSAGE_DISPATCHER_H_
+
+#include "core/assist/execution_multi_queue.h"
+#include "core/net/message.h"
+#include "core/net/tcp_connection.h"
+#include "core/net/tcp_handler.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace viper {
+namespace net {
+
+// clang-format off
+
+#define VIPER_NET_DISPATCH_MAX_MSG_TYPE     65536 // the size limit of the handler table
+#define VIPER_NET_DISPATCH_WORKER_QUEUES    4
+#define VIPER_NET_DISPATCH_WORKER_QUEUE_MAX (64 * 1024)
+
+// clang-format on
+
+enum class ExecutionMode : int
+{
+    INLINE,  // on the loop thread of the connection
+    OFFLOAD, // on the worker queue the connection hashes to
+};
+
+using MessageHandler = std::function<void(TCPConnectionPtr conn, const MessagePtr msg)>;
+
+struct DispatchStats
+{
+    uint64_t _inline    = 0;
+    uint64_t _offloaded = 0;
+    uint64_t _dropped   = 0; // offloaded messages whose worker queue was full
+    uint64_t _unhandled = 0; // messages without a handler, passed to the fallback
+};
+
+/**
+ * @brief MessageDispatcher a TCPHandlerCallback which routes every message to the
+ *        handler registered for its _msgType.
+ *
+ * The handlers sit in a flat table indexed by the message type. An inline handler
+ * runs on the loop thread like HandleData. An offloaded handler runs on one of the
+ * worker queues, picked by a hash of the connection with a single consumer each,
+ * so the offloaded messages of a connection are handled in the order they arrived
+ * while the loop goes back to its I/O. The order between inline and offloaded
+ * messages is not kept. Handlers are registered before the server or client runs.
+ *
+ * The connection callbacks stay empty, derive from the dispatcher to override them.
+ */
+class MessageDispatcher : public TCPHandlerCallback
+{
+public:
+    explicit MessageDispatcher(std::size_t workerQueues = VIPER_NET_DISPATCH_WORKER_QUEUES,
+                               std::size_t queueSize    = VIPER_NET_DISPATCH_WORKER_QUEUE_MAX);
+    ~MessageDispatcher() override = default;
+
+public:
+    /**
+     * @brief RegisterHandler route the messages of one type to handler
+     *
+     * @param msgType above VIPER_NET_MESSAGE_PROTOCOL_BASE and below VIPER_NET_DISPATCH_MAX_MSG_TYPE
+     * @param handler called with the connection and the message
+     * @param mode where the handler runs
+     * @return std::error_code INVALID_PARAMETER for a type outside the table
+     */
+    std::error_code RegisterHandler(uint32_t msgType, MessageHandler handler, ExecutionMode mode = ExecutionMode::INLINE);
+
+    /**
+     * @brief SetFallback handle the messages of the types without a handler, they
+     *        are dropped without one
+     *
+     * @param handler called inline with the connection and the message
+     */
+    void          SetFallback(MessageHandler handler);
+    DispatchStats Stats();
+
+public:
+    void OnConnection(TCPConnectionPtr conn) override {}
+    void OnDisconnection(TCPConnectionPtr conn) override {}
+    void HandleData(TCPConnectionPtr conn, const MessagePtr msg) override;
+    void HandleBatch(TCPConnectionPtr conn, const std::vector<MessagePtr>& msgs) override;
+
+private:
+    struct Route
+    {
+        MessageHandler _handler = nullptr;
+        ExecutionMode  _mode    = ExecutionMode::INLINE;
+    };
+
+    const Route* Find(uint32_t msgType);
+    void         Offload(TCPConnectionPtr conn, std::vector<std::pair<const Route*, MessagePtr>>&& msgs);
+
+private:
+    std::vector<Route>             _routes;
+    MessageHandler                 _fallback  = nullptr;
+    assist::ExecutionMultiQueuePtr _workers   = nullptr;
+    std::atomic<uint64_t>          _inline    = 0;
+    std::atomic<uint64_t>          _offloaded = 0;
+    std::atomic<uint64_t>          _dropped   = 0;
+    std::atomic<uint64_t>          _unhandled = 0;
+};
+
+using MessageDispatcherPtr = std::shared_ptr<MessageDispatcher>;
+
+} // namespace net
+} // namespace viper
+
+#endif
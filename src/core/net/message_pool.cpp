@@ -0,0 +1,277 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+
+#include "core/net/message_pool.h"
+#include "core/net/message.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace viper {
+namespace net {
+
+/**
+ * @brief BlockAllocator serves the shared_ptr control blocks of pooled messages
+ * from the pool size classes. It keeps the pool alive until the control block
+ * has been given back.
+ */
+template <typename T>
+class MessagePool::BlockAllocator
+{
+public:
+    using value_type = T;
+
+    explicit BlockAllocator(MessagePoolPtr pool)
+        : _pool(std::move(pool))
+    {
+    }
+
+    template <typename U>
+    BlockAllocator(const BlockAllocator<U>& other)
+        : _pool(other._pool)
+    {
+    }
+
+    T* allocate(std::size_t n)
+    {
+        uint32_t capacity = 0;
+        return reinterpret_cast<T*>(_pool->Allocate(n * sizeof(T), capacity));
+    }
+
+    void deallocate(T* p, std::size_t n)
+    {
+        uint32_t capacity = n * sizeof(T);
+        int      index    = _pool->SizeClass(capacity);
+        if (index >= 0)
+        {
+            capacity = SIZE_CLASS_MIN << (2 * index);
+        }
+
+        _pool->Deallocate(reinterpret_cast<char*>(p), capacity);
+    }
+
+    template <typename U>
+    bool operator==(const BlockAllocator<U>& other) const
+    {
+        return _pool == other._pool;
+    }
+
+    template <typename U>
+    bool operator!=(const BlockAllocator<U>& other) const
+    {
+        return _pool != other._pool;
+    }
+
+public:
+    MessagePoolPtr _pool;
+};
+
+void MessagePool::Recycler::operator()(Message* msg) const
+{
+    _pool->Release(msg);
+}
+
+MessagePool::MessagePool(std::size_t maxCachedMessages)
+{
+    _maxCachedMessages = maxCachedMessages;
+    _owner             = std::this_thread::get_id();
+}
+
+MessagePool::~MessagePool()
+{
+    for (auto msg : _remoteReleased)
+    {
+        msg->_pool = nullptr;
+        delete msg;
+    }
+    _remoteReleased.clear();
+
+    for (auto msg : _messages)
+    {
+        msg->_pool = nullptr;
+        delete msg;
+    }
+    _messages.clear();
+
+    for (auto& blocks : _blocks)
+    {
+        for (auto block : blocks)
+        {
+            free(block);
+        }
+        blocks.clear();
+    }
+}
+
+void MessagePool::BindThread()
+{
+    _owner = std::this_thread::get_id();
+}
+
+MessagePtr MessagePool::Acquire()
+{
+    if (!IsOwnerThread())
+    {
+        _messageMisses.fetch_add(1, std::memory_order_relaxed);
+        return std::make_shared<Message>();
+    }
+
+    if (_remoteCount.load(std::memory_order_acquire) > 0)
+    {
+        DrainRemoteReleased();
+    }
+
+    Message* msg = nullptr;
+    if (!_messages.empty())
+    {
+        msg = _messages.back();
+        _messages.pop_back();
+        _cachedMessages.store(_messages.size(), std::memory_order_relaxed);
+        _messageHits.fetch_add(1, std::memory_order_relaxed);
+    }
+    else
+    {
+        msg = new Message(this);
+        _messageMisses.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    return MessagePtr(msg, Recycler{this}, BlockAllocator<Message>(shared_from_this()));
+}
+
+char* MessagePool::Allocate(uint32_t size, uint32_t& capacity)
+{
+    int index = SizeClass(size);
+    if (index < 0)
+    {
+        capacity = size;
+        return (char*)malloc(sizeof(char) * size);
+    }
+
+    capacity = SIZE_CLASS_MIN << (2 * index);
+
+    auto& blocks = _blocks[index];
+    if (IsOwnerThread() && !blocks.empty())
+    {
+        char* block = blocks.back();
+        blocks.pop_back();
+        _blockHits.fetch_add(1, std::memory_order_relaxed);
+        return block;
+    }
+
+    _blockMisses.fetch_add(1, std::memory_order_relaxed);
+    return (char*)malloc(sizeof(char) * capacity);
+}
+
+void MessagePool::Deallocate(char* block, uint32_t capacity)
+{
+    if (!block)
+    {
+        return;
+    }
+
+    int index = SizeClass(capacity);
+    if (index < 0 || (uint32_t)(SIZE_CLASS_MIN << (2 * index)) != capacity || !IsOwnerThread())
+    {
+        free(block);
+        return;
+    }
+
+    auto&       blocks    = _blocks[index];
+    std::size_t maxBlocks = std::max<std::size_t>(2, VIPER_NET_MESSAGE_POOL_MAX_CLASS_BYTES_DFT / capacity);
+    if (blocks.size() >= maxBlocks)
+    {
+        free(block);
+        return;
+    }
+
+    blocks.push_back(block);
+}
+
+MessagePoolStats MessagePool::Stats() const
+{
+    MessagePoolStats stats;
+    stats._messageHits    = _messageHits.load(std::memory_order_relaxed);
+    stats._messageMisses  = _messageMisses.load(std::memory_order_relaxed);
+    stats._blockHits      = _blockHits.load(std::memory_order_relaxed);
+    stats._blockMisses    = _blockMisses.load(std::memory_order_relaxed);
+    stats._remoteReleases = _remoteReleases.load(std::memory_order_relaxed);
+    stats._cachedMessages = _cachedMessages.load(std::memory_order_relaxed);
+    return stats;
+}
+
+void MessagePool::Release(Message* msg)
+{
+    if (!IsOwnerThread())
+    {
+        // the payload is cleared by the owner, the size classes are not thread safe
+        std::unique_lock<std::mutex> lock(_remoteMutex);
+        _remoteReleased.push_back(msg);
+        _remoteCount.fetch_add(1, std::memory_order_release);
+        _remoteReleases.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    msg->Clear();
+    msg->_header = Header();
+
+    if (_messages.size() >= _maxCachedMessages)
+    {
+        delete msg;
+        return;
+    }
+
+    _messages.push_back(msg);
+    _cachedMessages.store(_messages.size(), std::memory_order_relaxed);
+}
+
+void MessagePool::DrainRemoteReleased()
+{
+    std::vector<Message*> released;
+    {
+        std::unique_lock<std::mutex> lock(_remoteMutex);
+        released.swap(_remoteReleased);
+        _remoteCount.store(0, std::memory_order_release);
+    }
+
+    for (auto msg : released)
+    {
+        Release(msg);
+    }
+}
+
+bool MessagePool::IsOwnerThread() const
+{
+    return std::this_thread::get_id() == _owner;
+}
+
+int MessagePool::SizeClass(uint32_t size) const
+{
+    uint64_t classSize = SIZE_CLASS_MIN;
+    for (int index = 0; index < SIZE_CLASS_COUNT; ++index)
+    {
+        if (size <= classSize)
+        {
+            return index;
+        }
+        classSize <<= 2;
+    }
+
+    return -1;
+}
+
+} // namespace net
+} // namespace viper
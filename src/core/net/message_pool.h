@@ -0,0 +1,121 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+
+#ifndef _VIPER_CORE_NET_MESSAGE_POOL_H_
+#define _VIPER_CORE_NET_MESSAGE_POOL_H_
+
+#include "core/net/message.h"
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace viper {
+namespace net {
+
+// clang-format off
+
+#define VIPER_NET_MESSAGE_POOL_MAX_CACHED_DFT      4096
+#define VIPER_NET_MESSAGE_POOL_MAX_CLASS_BYTES_DFT (4 * 1024 * 1024)
+
+// clang-format on
+
+struct MessagePoolStats
+{
+    uint64_t _messageHits    = 0;
+    uint64_t _messageMisses  = 0;
+    uint64_t _blockHits      = 0;
+    uint64_t _blockMisses    = 0;
+    uint64_t _remoteReleases = 0;
+    uint64_t _cachedMessages = 0;
+};
+
+/**
+ * @brief MessagePool recycles messages and their payload blocks for one event loop.
+ *
+ * The pool is owned by a single loop thread (see BindThread). Messages released on
+ * the owner thread go straight back to its free list, messages released on other
+ * threads (e.g. after being handed to an ExecutionQueue) are parked on a locked
+ * list which the owner drains on its next Acquire. Contiguous payload blocks are
+ * cached in power-of-four size classes; larger blocks go to the allocator.
+ */
+class MessagePool final : public std::enable_shared_from_this<MessagePool>
+{
+public:
+    explicit MessagePool(std::size_t maxCachedMessages = VIPER_NET_MESSAGE_POOL_MAX_CACHED_DFT);
+    ~MessagePool();
+
+    MessagePool(const MessagePool&)            = delete;
+    MessagePool& operator=(const MessagePool&) = delete;
+
+public:
+    void             BindThread();
+    MessagePtr       Acquire();
+    char*            Allocate(uint32_t size, uint32_t& capacity);
+    void             Deallocate(char* block, uint32_t capacity);
+    MessagePoolStats Stats() const;
+
+private:
+    template <typename T>
+    class BlockAllocator;
+
+    struct Recycler
+    {
+        MessagePool* _pool = nullptr;
+        void         operator()(Message* msg) const;
+    };
+
+    void Release(Message* msg);
+    void DrainRemoteReleased();
+    bool IsOwnerThread() const;
+    int  SizeClass(uint32_t size) const;
+
+private:
+    enum
+    {
+        SIZE_CLASS_COUNT = 8,
+        SIZE_CLASS_MIN   = 256,
+    };
+
+    std::thread::id                                   _owner;
+    std::size_t                                       _maxCachedMessages = VIPER_NET_MESSAGE_POOL_MAX_CACHED_DFT;
+    std::vector<Message*>                             _messages;
+    std::array<std::vector<char*>, SIZE_CLASS_COUNT> _blocks;
+
+    std::mutex            _remoteMutex;
+    std::vector<Message*> _remoteReleased;
+    std::atomic_size_t    _remoteCount = 0;
+
+    std::atomic_uint64_t _messageHits    = 0;
+    std::atomic_uint64_t _messageMisses  = 0;
+    std::atomic_uint64_t _blockHits      = 0;
+    std::atomic_uint64_t _blockMisses    = 0;
+    std::atomic_uint64_t _remoteReleases = 0;
+    std::atomic_uint64_t _cachedMessages = 0;
+};
+
+using MessagePoolPtr = std::shared_ptr<MessagePool>;
+
+} // namespace net
+} // namespace viper
+
+#endif
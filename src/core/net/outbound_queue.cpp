@@ -0,0 +1,276 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#include "core/net/outbound_queue.h"
+#include "core/error/error.h"
+#include "core/log/log.h"
+#include "core/net/tcp_connection.h"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace viper {
+namespace net {
+
+OutboundQueue::OutboundQueue()
+{
+    _tail.store(&_stub);
+    _head = &_stub;
+}
+
+OutboundQueue::~OutboundQueue()
+{
+    Stop();
+}
+
+void OutboundQueue::WakeupCallback(evutil_socket_t fd, short events, void* ctx)
+{
+    auto queue = static_cast<OutboundQueue*>(ctx);
+
+    uint64_t count = 0;
+    if (fd >= 0 && read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    {
+        LOG_WARN("failed to read the outbound eventfd. errno:{}", errno);
+    }
+
+    // cleared before draining, a frame pushed from now on signals again
+    queue->_signaled.store(false, std::memory_order_seq_cst);
+    queue->Drain();
+}
+
+std::error_code OutboundQueue::Start(event_base* base, void* owner)
+{
+    _eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_eventFd < 0)
+    {
+        LOG_ERROR("failed to create the outbound eventfd. errno:{}", errno);
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    _owner = owner;
+    _event = event_new(base, _eventFd, EV_READ | EV_PERSIST, &OutboundQueue::WakeupCallback, this);
+    event_add(_event, nullptr);
+
+    return error::ErrorCode::SUCCESS;
+}
+
+void OutboundQueue::Stop()
+{
+    if (_event)
+    {
+        event_free(_event);
+        _event = nullptr;
+    }
+
+    if (_eventFd != EVUTIL_INVALID_SOCKET)
+    {
+        close(_eventFd);
+        _eventFd = EVUTIL_INVALID_SOCKET;
+    }
+
+    for (auto frame : _parked)
+    {
+        Free(frame);
+    }
+    _parked.clear();
+
+    while (auto frame = Pop())
+    {
+        Free(frame);
+    }
+}
+
+void OutboundQueue::BindThread()
+{
+    _loopThread.store(std::this_thread::get_id(), std::memory_order_release);
+}
+
+bool OutboundQueue::InLoopThread()
+{
+    return _loopThread.load(std::memory_order_acquire) == std::this_thread::get_id();
+}
+
+void OutboundQueue::Push(std::shared_ptr<TCPConnection> conn, const Header& header, evbuffer* payload)
+{
+    auto frame      = new Frame();
+    frame->_conn    = std::move(conn);
+    frame->_header  = header;
+    frame->_payload = payload;
+    frame->_size    = payload ? Message::MESSAGE_HEADER_SIZE + evbuffer_get_length(payload) : 0;
+    Enqueue(frame);
+}
+
+void OutboundQueue::Enqueue(Frame* frame)
+{
+    Link(frame);
+
+    // one wakeup per batch, the loop clears the flag before it drains
+    if (!_signaled.exchange(true, std::memory_order_seq_cst) && _eventFd != EVUTIL_INVALID_SOCKET)
+    {
+        uint64_t one = 1;
+        if (write(_eventFd, &one, sizeof(one)) < 0)
+        {
+            LOG_WARN("failed to wake up the outbound queue. errno:{}", errno);
+        }
+    }
+}
+
+std::size_t OutboundQueue::Drain()
+{
+    std::size_t count = 0;
+
+    // connections which arrived meanwhile get their frames first
+    if (!_parked.empty())
+    {
+        std::vector<Frame*> parked;
+        parked.swap(_parked);
+        for (auto frame : parked)
+        {
+            Deliver(frame);
+            ++count;
+        }
+    }
+
+    while (count < VIPER_NET_OUTBOUND_BATCH)
+    {
+        Frame* frame = Pop();
+        if (!frame)
+        {
+            return count;
+        }
+
+        Deliver(frame);
+        ++count;
+    }
+
+    // the rest waits for the next iteration, so the other events are not starved
+    if (_event)
+    {
+        event_active(_event, EV_READ, 0);
+    }
+
+    return count;
+}
+
+void OutboundQueue::Link(Frame* frame)
+{
+    frame->_next.store(nullptr, std::memory_order_relaxed);
+    Frame* prev = _tail.exchange(frame, std::memory_order_acq_rel);
+    prev->_next.store(frame, std::memory_order_release);
+}
+
+OutboundQueue::Frame* OutboundQueue::Pop()
+{
+    Frame* head = _head;
+    Frame* next = head->_next.load(std::memory_order_acquire);
+    if (head == &_stub)
+    {
+        if (!next)
+        {
+            return nullptr;
+        }
+
+        _head = next;
+        head  = next;
+        next  = next->_next.load(std::memory_order_acquire);
+    }
+
+    if (next)
+    {
+        _head = next;
+        return head;
+    }
+
+    // a producer swapped the tail but did not link yet, its frame comes with its wakeup
+    if (head != _tail.load(std::memory_order_acquire))
+    {
+        return nullptr;
+    }
+
+    // the last frame, the stub takes its place so the frame can be handed out
+    Link(&_stub);
+    next = head->_next.load(std::memory_order_acquire);
+    if (next)
+    {
+        _head = next;
+        return head;
+    }
+
+    return nullptr;
+}
+
+void OutboundQueue::Deliver(Frame* frame)
+{
+    auto& conn  = frame->_conn;
+    auto  state = conn->State();
+    if (state != ConnectionState::CONNECTED && state != ConnectionState::CONNECTING)
+    {
+        LOG_DEBUG("drop a queued frame of a closed connection. connection:{}", conn->ID());
+        if (frame->_payload)
+        {
+            ++conn->_droppedFrames;
+        }
+
+        Free(frame);
+        return;
+    }
+
+    // the connection moved to another loop, its frames follow it
+    OutboundQueue* queue = conn->Outbound();
+    if (queue && queue != this)
+    {
+        queue->Enqueue(frame);
+        return;
+    }
+
+    // still on its way here, written once the loop adopted it
+    if (conn->GetHandler() != _owner)
+    {
+        _parked.push_back(frame);
+        return;
+    }
+
+    if (!frame->_payload)
+    {
+        conn->Overflow();
+        Free(frame);
+        return;
+    }
+
+    // admitted against an output which may have grown since, the policy can still refuse it
+    auto errcode = conn->SendBuffer(frame->_header, frame->_payload);
+    if (!error::IsSuccess(errcode))
+    {
+        LOG_WARN("failed to write a queued frame. errcode:{}, connection:{}", errcode.value(), conn->ID());
+        ++conn->_droppedFrames;
+    }
+
+    Free(frame);
+}
+
+void OutboundQueue::Free(Frame* frame)
+{
+    if (frame->_payload)
+    {
+        evbuffer_free(frame->_payload);
+    }
+
+    frame->_conn->_queuedBytes.fetch_sub(frame->_size, std::memory_order_seq_cst);
+    delete frame;
+}
+
+} // namespace net
+} // namespace viper
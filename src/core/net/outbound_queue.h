@@ -0,0 +1,140 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#ifndef _VIPER_CORE_NET_OUTBOUND_QUEUE_H_
+#define _VIPER_CORE_NET_OUTBOUND_QUEUE_H_
+
+#include "core/net/message.h"
+
+#include <event2/buffer.h>
+#include <event2/event.h>
+#include <event2/util.h>
+
+#include <atomic>
+#include <memory>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace viper {
+namespace net {
+
+// clang-format off
+
+#define VIPER_NET_OUTBOUND_BATCH 1024
+
+// clang-format on
+
+class TCPConnection;
+
+/**
+ * @brief OutboundQueue the frames sent by other threads on the connections of one
+ *        event loop.
+ *
+ * A bufferevent belongs to its loop thread, so a send from any other thread
+ * pushes the frame here instead of writing it. Producers never lock: the queue
+ * is an intrusive MPSC list, and the eventfd is only written when the queue
+ * turns non empty. The loop writes up to VIPER_NET_OUTBOUND_BATCH frames per
+ * wakeup through the regular send path, so compression, checksums, corking and
+ * backpressure apply unchanged. The connection admits a frame before it is
+ * pushed, the bytes it reserved are released once the loop took the frame.
+ */
+class OutboundQueue final
+{
+public:
+    OutboundQueue();
+    ~OutboundQueue();
+
+    OutboundQueue(const OutboundQueue&)            = delete;
+    OutboundQueue& operator=(const OutboundQueue&) = delete;
+
+public:
+    static void WakeupCallback(evutil_socket_t fd, short events, void* ctx);
+
+public:
+    /**
+     * @brief Start watch the queue from a loop
+     *
+     * @param base the event base of the loop
+     * @param owner the handler the connections of the loop are bound to
+     * @return std::error_code
+     */
+    std::error_code Start(event_base* base, void* owner);
+
+    /**
+     * @brief Stop free the frames which were not written, called after the loop exited
+     */
+    void Stop();
+
+    /**
+     * @brief BindThread make the calling thread the loop thread, sends on it write directly
+     */
+    void BindThread();
+    bool InLoopThread();
+
+    /**
+     * @brief Push queue a frame, called from any thread
+     *
+     * @param conn the connection to write to
+     * @param header the frame header in host byte order
+     * @param payload the frame payload, owned by the queue from now on; null asks
+     *        the loop to close the connection for its overflowed output
+     */
+    void Push(std::shared_ptr<TCPConnection> conn, const Header& header, evbuffer* payload);
+
+    /**
+     * @brief Drain write the queued frames, called on the loop thread
+     *
+     * @return std::size_t the number of frames handled
+     */
+    std::size_t Drain();
+
+private:
+    struct Frame
+    {
+        std::atomic<Frame*>            _next = nullptr;
+        std::shared_ptr<TCPConnection> _conn = nullptr;
+        Header                         _header;
+        evbuffer*                      _payload = nullptr;
+        std::size_t                    _size    = 0; // the bytes reserved by TCPConnection::AdmitQueued
+    };
+
+    void   Enqueue(Frame* frame);
+    void   Link(Frame* frame);
+    Frame* Pop();
+    void   Deliver(Frame* frame);
+    void   Free(Frame* frame);
+
+private:
+    // the producers swap the tail, the loop thread pops at the head
+    Frame               _stub;
+    std::atomic<Frame*> _tail = nullptr;
+    Frame*              _head = nullptr;
+    std::atomic_bool    _signaled = false;
+
+    evutil_socket_t              _eventFd = EVUTIL_INVALID_SOCKET;
+    event*                       _event   = nullptr;
+    void*                        _owner   = nullptr;
+    std::atomic<std::thread::id> _loopThread;
+
+    // frames of connections which are still moving to this loop
+    std::vector<Frame*> _parked;
+};
+
+} // namespace net
+} // namespace viper
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#include "core/net/rtt_estimator.h"
+
+#include <algorithm>
+#include <bit>
+#include <limits>
+
+namespace viper {
+namespace net {
+
+uint64_t RTTStats::BucketBound(std::size_t bucket)
+{
+    if (bucket + 1 >= VIPER_NET_RTT_HISTOGRAM_BUCKETS)
+    {
+        return std::numeric_limits<uint64_t>::max();
+    }
+
+    return 16ull << bucket;
+}
+
+void RTTEstimator::Sample(uint64_t rttUs)
+{
+    // the writer is the loop thread only, the atomics are for the readers of Stats
+    uint64_t samples = _samples.load(std::memory_order_relaxed);
+    if (0 == samples)
+    {
+        _srttUs.store(rttUs, std::memory_order_relaxed);
+        _rttvarUs.store(rttUs / 2, std::memory_order_relaxed);
+        _minUs.store(rttUs, std::memory_order_relaxed);
+        _maxUs.store(rttUs, std::memory_order_relaxed);
+    }
+    else
+    {
+        // rttvar = 3/4 rttvar + 1/4 |srtt - rtt|, srtt = 7/8 srtt + 1/8 rtt
+        uint64_t srtt   = _srttUs.load(std::memory_order_relaxed);
+        uint64_t rttvar = _rttvarUs.load(std::memory_order_relaxed);
+        uint64_t delta  = srtt > rttUs ? srtt - rttUs : rttUs - srtt;
+        _rttvarUs.store((rttvar * 3 + delta) / 4, std::memory_order_relaxed);
+        _srttUs.store((srtt * 7 + rttUs) / 8, std::memory_order_relaxed);
+        _minUs.store(std::min(_minUs.load(std::memory_order_relaxed), rttUs), std::memory_order_relaxed);
+        _maxUs.store(std::max(_maxUs.load(std::memory_order_relaxed), rttUs), std::memory_order_relaxed);
+    }
+
+    // bucket i holds [16us << (i - 1), 16us << i)
+    std::size_t bucket = rttUs < 16 ? 0 : std::bit_width(rttUs >> 4);
+    _histogram[std::min<std::size_t>(bucket, VIPER_NET_RTT_HISTOGRAM_BUCKETS - 1)].fetch_add(
+        1, std::memory_order_relaxed);
+    _samples.store(samples + 1, std::memory_order_release);
+}
+
+uint64_t RTTEstimator::Samples()
+{
+    return _samples.load(std::memory_order_acquire);
+}
+
+uint64_t RTTEstimator::Timeout(uint64_t fallbackUs)
+{
+    if (0 == Samples())
+    {
+        return fallbackUs;
+    }
+
+    uint64_t timeout = _srttUs.load(std::memory_order_relaxed) + 4 * _rttvarUs.load(std::memory_order_relaxed);
+    return std::max<uint64_t>(timeout, VIPER_NET_RTT_MIN_TIMEOUT_US);
+}
+
+RTTStats RTTEstimator::Stats()
+{
+    RTTStats stats;
+    stats._samples  = _samples.load(std::memory_order_acquire);
+    stats._srttUs   = _srttUs.load(std::memory_order_relaxed);
+    stats._rttvarUs = _rttvarUs.load(std::memory_order_relaxed);
+    stats._minUs    = _minUs.load(std::memory_order_relaxed);
+    stats._maxUs    = _maxUs.load(std::memory_order_relaxed);
+    for (std::size_t idx = 0; idx < _histogram.size(); ++idx)
+    {
+        stats._histogram[idx] = _histogram[idx].load(std::memory_order_relaxed);
+    }
+
+    return stats;
+}
+
+} // namespace net
+} // namespace viper
@@ -0,0 +1,90 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#ifndef _VIPER_CORE_NET_RTT_ESTIMATOR_H_
+#define _VIPER_CORE_NET_RTT_ESTIMATOR_H_
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace viper {
+namespace net {
+
+// clang-format off
+
+#define VIPER_NET_RTT_HISTOGRAM_BUCKETS 20     // bucket i holds the samples below 16us << i, the last one the rest
+#define VIPER_NET_RTT_MIN_TIMEOUT_US    200000 // the lower bound of Timeout, covers delayed acks and scheduling
+
+// clang-format on
+
+struct RTTStats
+{
+    uint64_t _samples  = 0;
+    uint64_t _srttUs   = 0; // smoothed round trip time
+    uint64_t _rttvarUs = 0; // smoothed mean deviation
+    uint64_t _minUs    = 0;
+    uint64_t _maxUs    = 0;
+
+    std::array<uint64_t, VIPER_NET_RTT_HISTOGRAM_BUCKETS> _histogram = {};
+
+    /**
+     * @brief BucketBound the exclusive upper bound of a histogram bucket
+     *
+     * @param bucket the bucket index
+     * @return uint64_t microseconds, UINT64_MAX for the last bucket
+     */
+    static uint64_t BucketBound(std::size_t bucket);
+};
+
+/**
+ * @brief RTTEstimator the round trip time of a connection, smoothed like the TCP
+ *        retransmission timer of RFC 6298.
+ *
+ * Samples are added by the event loop of the connection only, Stats may be read
+ * from any thread.
+ */
+class RTTEstimator final
+{
+public:
+    void     Sample(uint64_t rttUs);
+    uint64_t Samples();
+
+    /**
+     * @brief Timeout the time an answer may take before the peer is considered
+     *        lost, srtt + 4 * rttvar and at least VIPER_NET_RTT_MIN_TIMEOUT_US
+     *
+     * @param fallbackUs returned while there are no samples
+     * @return uint64_t microseconds
+     */
+    uint64_t Timeout(uint64_t fallbackUs);
+    RTTStats Stats();
+
+private:
+    std::atomic<uint64_t> _samples  = 0;
+    std::atomic<uint64_t> _srttUs   = 0;
+    std::atomic<uint64_t> _rttvarUs = 0;
+    std::atomic<uint64_t> _minUs    = 0;
+    std::atomic<uint64_t> _maxUs    = 0;
+
+    std::array<std::atomic<uint64_t>, VIPER_NET_RTT_HISTOGRAM_BUCKETS> _histogram = {};
+};
+
+} // namespace net
+} // namespace viper
+
+#endif
@@ -0,0 +1,549 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#include "core/net/shm_backend.h"
+#include "core/error/error.h"
+#include "core/log/log.h"
+
+#include <event2/buffer.h>
+
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+namespace viper {
+namespace net {
+
+namespace {
+
+// sent by the accepting side together with the memfd and the two eventfds
+struct ShmHello
+{
+    uint32_t _magic    = VIPER_NET_SHM_MAGIC;
+    uint32_t _version  = VIPER_NET_SHM_VERSION;
+    uint32_t _capacity = VIPER_NET_SHM_RING_CAPACITY;
+};
+
+enum : int
+{
+    SHM_FD_MEMORY    = 0,
+    SHM_FD_ACCEPTOR  = 1, // the eventfd the accepting side waits on
+    SHM_FD_CONNECTOR = 2, // the eventfd the connecting side waits on
+    SHM_FD_COUNT     = 3,
+};
+
+} // namespace
+
+struct ShmBackend::Channel
+{
+    ShmBackend*     _backend       = nullptr;
+    evutil_socket_t _fd            = EVUTIL_INVALID_SOCKET;
+    bufferevent*    _io            = nullptr; // the backend side of the pair
+    void*           _memory        = nullptr;
+    std::size_t     _memorySize    = 0;
+    ShmRing         _tx;
+    ShmRing         _rx;
+    int             _wakeFd        = -1; // written by the peer
+    int             _peerWakeFd    = -1;
+    event*          _wakeEvent     = nullptr;
+    event*          _socketEvent   = nullptr;
+    bool            _connecting    = false;
+    bool            _blocked       = false; // the tx ring is full, the peer wakes this side up
+    bool            _failed        = false; // a ring broke, the connection is being closed
+    short           _pendingEvents = 0;     // reported once the received data was consumed
+};
+
+ShmBackend::~ShmBackend()
+{
+    Stop();
+}
+
+std::error_code ShmBackend::Start(event_base* base)
+{
+    _base = base;
+    return error::ErrorCode::SUCCESS;
+}
+
+void ShmBackend::Stop()
+{
+    if (_stopped)
+    {
+        return;
+    }
+    _stopped = true;
+
+    while (!_channels.empty())
+    {
+        Free(*_channels.begin());
+    }
+}
+
+bufferevent* ShmBackend::Open(evutil_socket_t fd)
+{
+    Channel* chan = NewChannel(fd);
+    if (!chan)
+    {
+        return nullptr;
+    }
+
+    int memfd         = memfd_create("viper-shm", MFD_CLOEXEC);
+    chan->_wakeFd     = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    chan->_peerWakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    bool ready        = memfd >= 0 && chan->_wakeFd >= 0 && chan->_peerWakeFd >= 0 &&
+                        ftruncate(memfd, 2 * ShmRing::RegionSize(VIPER_NET_SHM_RING_CAPACITY)) == 0 &&
+                        Map(chan, memfd, VIPER_NET_SHM_RING_CAPACITY, true);
+
+    if (ready)
+    {
+        ShmHello hello;
+        iovec    iov = {&hello, sizeof(hello)};
+
+        int fds[SHM_FD_COUNT] = {0};
+        fds[SHM_FD_MEMORY]    = memfd;
+        fds[SHM_FD_ACCEPTOR]  = chan->_wakeFd;
+        fds[SHM_FD_CONNECTOR] = chan->_peerWakeFd;
+
+        char control[CMSG_SPACE(sizeof(fds))] = {0};
+
+        msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+
+        cmsghdr* cmsg    = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type  = SCM_RIGHTS;
+        cmsg->cmsg_len   = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+        // a new socket has an empty send buffer, the message fits at once
+        ready = sendmsg(fd, &msg, MSG_NOSIGNAL) == sizeof(hello);
+    }
+
+    if (memfd >= 0)
+    {
+        close(memfd);
+    }
+
+    if (!ready)
+    {
+        LOG_ERROR("failed to set up the shared memory rings. fd:{}, errno:{}", fd, errno);
+        Free(chan);
+        return nullptr;
+    }
+
+    chan->_wakeEvent = event_new(_base, chan->_wakeFd, EV_READ | EV_PERSIST, &ShmBackend::WakeupCallback, chan);
+    event_add(chan->_wakeEvent, nullptr);
+
+    return bufferevent_pair_get_partner(chan->_io);
+}
+
+bufferevent* ShmBackend::Connect(evutil_socket_t fd)
+{
+    Channel* chan = NewChannel(fd);
+    if (!chan)
+    {
+        return nullptr;
+    }
+
+    // the frames written meanwhile wait for the rings in the pair
+    chan->_connecting = true;
+    return bufferevent_pair_get_partner(chan->_io);
+}
+
+bool ShmBackend::Owns(bufferevent* bev)
+{
+    return Find(bev) != nullptr;
+}
+
+bool ShmBackend::Release(bufferevent* bev)
+{
+    Channel* chan = Find(bev);
+    if (!chan)
+    {
+        return false;
+    }
+
+    // the peer sees the socket close and reads what is left in the ring
+    chan->_backend->Free(chan);
+    return true;
+}
+
+ShmBackend::Channel* ShmBackend::Find(bufferevent* bev)
+{
+    // a socket bufferevent has no partner
+    bufferevent* io = bufferevent_pair_get_partner(bev);
+    if (!io)
+    {
+        return nullptr;
+    }
+
+    bufferevent_data_cb readcb = nullptr;
+    void*               ctx    = nullptr;
+    bufferevent_getcb(io, &readcb, nullptr, nullptr, &ctx);
+    if (readcb != &ShmBackend::SendCallback)
+    {
+        return nullptr;
+    }
+
+    return static_cast<Channel*>(ctx);
+}
+
+void ShmBackend::SendCallback(bufferevent* bev, void* ctx)
+{
+    auto chan = static_cast<Channel*>(ctx);
+
+    // libevent calls again while the input is above the watermark, so it is paused
+    if (chan->_connecting || chan->_blocked)
+    {
+        bufferevent_disable(bev, EV_READ);
+        return;
+    }
+
+    chan->_backend->Transmit(chan);
+}
+
+void ShmBackend::DrainCallback(bufferevent* bev, void* ctx)
+{
+    auto chan    = static_cast<Channel*>(ctx);
+    auto backend = chan->_backend;
+    backend->Receive(chan);
+
+    // the connection consumed what was received, an end of file can be reported now
+    if (chan->_pendingEvents)
+    {
+        short events         = chan->_pendingEvents;
+        chan->_pendingEvents = 0;
+        backend->Notify(chan, events);
+    }
+}
+
+void ShmBackend::WakeupCallback(evutil_socket_t fd, short events, void* ctx)
+{
+    auto chan    = static_cast<Channel*>(ctx);
+    auto backend = chan->_backend;
+
+    uint64_t count = 0;
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    {
+        LOG_WARN("failed to read the shared memory eventfd. errno:{}", errno);
+    }
+
+    backend->Receive(chan);
+    if (chan->_blocked)
+    {
+        backend->Transmit(chan);
+    }
+}
+
+void ShmBackend::SocketCallback(evutil_socket_t fd, short events, void* ctx)
+{
+    auto chan    = static_cast<Channel*>(ctx);
+    auto backend = chan->_backend;
+    if (chan->_connecting)
+    {
+        backend->Handshake(chan);
+        return;
+    }
+
+    // nothing is sent over the socket after the handshake, it only tells the peer is alive
+    char    scratch[64];
+    ssize_t count = recv(fd, scratch, sizeof(scratch), 0);
+    if (count > 0 || (count < 0 && (EAGAIN == errno || EINTR == errno)))
+    {
+        return;
+    }
+
+    // the peer wrote everything before it closed, that is delivered first
+    event_del(chan->_socketEvent);
+    backend->Receive(chan);
+    backend->Notify(chan, (0 == count ? BEV_EVENT_EOF : BEV_EVENT_ERROR) | BEV_EVENT_READING);
+}
+
+ShmBackend::Channel* ShmBackend::NewChannel(evutil_socket_t fd)
+{
+    bufferevent* pair[2] = {nullptr, nullptr};
+    if (bufferevent_pair_new(_base, 0, pair) != 0)
+    {
+        LOG_ERROR("failed to create the bufferevent pair. fd:{}", fd);
+        close(fd);
+        return nullptr;
+    }
+
+    auto chan      = new Channel();
+    chan->_backend = this;
+    chan->_fd      = fd;
+    chan->_io      = pair[1];
+
+    // the pair stops moving output over at the watermark, the rest stays with the
+    // connection, where its backpressure sees it
+    bufferevent_setcb(chan->_io, &ShmBackend::SendCallback, &ShmBackend::DrainCallback, nullptr, chan);
+    bufferevent_setwatermark(chan->_io, EV_READ, 0, VIPER_NET_SHM_SEND_BATCH);
+    bufferevent_enable(chan->_io, EV_READ | EV_WRITE);
+
+    chan->_socketEvent = event_new(_base, fd, EV_READ | EV_PERSIST, &ShmBackend::SocketCallback, chan);
+    event_add(chan->_socketEvent, nullptr);
+
+    _channels.insert(chan);
+    return chan;
+}
+
+bool ShmBackend::Map(Channel* chan, int memfd, uint32_t capacity, bool creator)
+{
+    std::size_t region = ShmRing::RegionSize(capacity);
+
+    // a memory smaller than the rings would fault on access
+    struct stat st;
+    if (0 == capacity || fstat(memfd, &st) != 0 || (std::size_t)st.st_size < 2 * region)
+    {
+        return false;
+    }
+
+    void* memory = mmap(nullptr, 2 * region, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+    if (MAP_FAILED == memory)
+    {
+        return false;
+    }
+
+    // the first ring carries the frames of the accepting side
+    char* rings       = static_cast<char*>(memory);
+    chan->_memory     = memory;
+    chan->_memorySize = 2 * region;
+    chan->_tx.Bind(creator ? rings : rings + region, capacity, creator);
+    chan->_rx.Bind(creator ? rings + region : rings, capacity, creator);
+    return true;
+}
+
+void ShmBackend::Handshake(Channel* chan)
+{
+    ShmHello hello;
+    iovec    iov = {&hello, sizeof(hello)};
+
+    int fds[SHM_FD_COUNT] = {-1, -1, -1};
+
+    char control[CMSG_SPACE(sizeof(fds))] = {0};
+
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t count = recvmsg(chan->_fd, &msg, MSG_CMSG_CLOEXEC);
+    if (count < 0 && (EAGAIN == errno || EINTR == errno))
+    {
+        return;
+    }
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg && SOL_SOCKET == cmsg->cmsg_level && SCM_RIGHTS == cmsg->cmsg_type &&
+        cmsg->cmsg_len == CMSG_LEN(sizeof(fds)))
+    {
+        memcpy(fds, CMSG_DATA(cmsg), sizeof(fds));
+    }
+
+    bool valid = sizeof(hello) == count && fds[SHM_FD_MEMORY] >= 0 && VIPER_NET_SHM_MAGIC == hello._magic &&
+                 VIPER_NET_SHM_VERSION == hello._version && Map(chan, fds[SHM_FD_MEMORY], hello._capacity, false);
+
+    if (fds[SHM_FD_MEMORY] >= 0)
+    {
+        close(fds[SHM_FD_MEMORY]);
+    }
+
+    chan->_peerWakeFd = fds[SHM_FD_ACCEPTOR];
+    chan->_wakeFd     = fds[SHM_FD_CONNECTOR];
+    chan->_connecting = false;
+
+    if (!valid)
+    {
+        LOG_ERROR("invalid shared memory handshake. fd:{}, size:{}, errno:{}", chan->_fd, count, errno);
+        event_del(chan->_socketEvent);
+        Notify(chan, BEV_EVENT_ERROR);
+        return;
+    }
+
+    chan->_wakeEvent = event_new(_base, chan->_wakeFd, EV_READ | EV_PERSIST, &ShmBackend::WakeupCallback, chan);
+    event_add(chan->_wakeEvent, nullptr);
+
+    Notify(chan, BEV_EVENT_CONNECTED);
+
+    // frames written while connecting, and the ones the peer wrote meanwhile
+    Transmit(chan);
+    Receive(chan);
+}
+
+void ShmBackend::Transmit(Channel* chan)
+{
+    evbuffer* input = bufferevent_get_input(chan->_io);
+    bool      wake  = false;
+
+    chan->_blocked = false;
+    while (evbuffer_get_length(input) > 0)
+    {
+        bool signal = false;
+        if (chan->_tx.Write(input, signal) > 0)
+        {
+            wake = wake || signal;
+            continue;
+        }
+
+        if (!chan->_tx.WaitForSpace())
+        {
+            chan->_blocked = true;
+            break;
+        }
+    }
+
+    if (wake)
+    {
+        Wake(chan);
+    }
+
+    if (chan->_tx.Broken())
+    {
+        Fail(chan);
+    }
+
+    // the rest stays with the connection until the peer made space; once it is
+    // written, enabling pulls what the connection wrote meanwhile
+    if (chan->_blocked)
+    {
+        bufferevent_disable(chan->_io, EV_READ);
+    }
+    else if (!(bufferevent_get_enabled(chan->_io) & EV_READ))
+    {
+        bufferevent_enable(chan->_io, EV_READ);
+    }
+}
+
+void ShmBackend::Receive(Channel* chan)
+{
+    if (chan->_connecting || !chan->_memory)
+    {
+        return;
+    }
+
+    // a connection which does not keep up leaves the data in the ring, which blocks the peer
+    evbuffer* output = bufferevent_get_output(chan->_io);
+    bool      wake   = false;
+    while (evbuffer_get_length(output) < VIPER_NET_SHM_RECV_BACKLOG)
+    {
+        bool signal = false;
+        if (0 == chan->_rx.Read(output, VIPER_NET_SHM_RECV_BACKLOG - evbuffer_get_length(output), signal))
+        {
+            break;
+        }
+
+        wake = wake || signal;
+    }
+
+    if (wake)
+    {
+        Wake(chan);
+    }
+
+    if (chan->_rx.Broken())
+    {
+        Fail(chan);
+    }
+}
+
+void ShmBackend::Wake(Channel* chan)
+{
+    uint64_t one = 1;
+    if (write(chan->_peerWakeFd, &one, sizeof(one)) < 0)
+    {
+        LOG_WARN("failed to wake up the shared memory peer. errno:{}", errno);
+    }
+}
+
+void ShmBackend::Notify(Channel* chan, short events)
+{
+    bufferevent* bev = bufferevent_pair_get_partner(chan->_io);
+    if (!bev)
+    {
+        return;
+    }
+
+    // the received data is delivered before the end of the stream
+    bool pending = evbuffer_get_length(bufferevent_get_output(chan->_io)) > 0 ||
+                   (chan->_memory && !chan->_rx.Empty());
+    if ((events & BEV_EVENT_READING) && pending)
+    {
+        chan->_pendingEvents = events;
+        return;
+    }
+
+    bufferevent_trigger_event(bev, events, 0);
+}
+
+void ShmBackend::Fail(Channel* chan)
+{
+    if (chan->_failed)
+    {
+        return;
+    }
+    chan->_failed = true;
+
+    LOG_WARN("the shared memory peer moved a ring position out of range. fd:{}", chan->_fd);
+
+    // the connection closes through its error path, outside of the callers, which
+    // still use the channel
+    bufferevent* bev = bufferevent_pair_get_partner(chan->_io);
+    if (bev)
+    {
+        bufferevent_trigger_event(bev, BEV_EVENT_ERROR, BEV_TRIG_DEFER_CALLBACKS);
+    }
+}
+
+void ShmBackend::Free(Channel* chan)
+{
+    for (auto ev : {chan->_wakeEvent, chan->_socketEvent})
+    {
+        if (ev)
+        {
+            event_free(ev);
+        }
+    }
+
+    for (int fd : {chan->_fd, chan->_wakeFd, chan->_peerWakeFd})
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    if (chan->_memory)
+    {
+        munmap(chan->_memory, chan->_memorySize);
+    }
+
+    bufferevent_free(chan->_io);
+    _channels.erase(chan);
+    delete chan;
+}
+
+} // namespace net
+} // namespace viper
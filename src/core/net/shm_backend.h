@@ -0,0 +1,140 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#ifndef _VIPER_CORE_NET_SHM_BACKEND_H_
+#define _VIPER_CORE_NET_SHM_BACKEND_H_
+
+#include "core/net/shm_ring.h"
+
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/util.h>
+
+#include <memory>
+#include <system_error>
+#include <unordered_set>
+
+namespace viper {
+namespace net {
+
+// clang-format off
+
+#define VIPER_NET_SHM_RING_CAPACITY (4 * 1024 * 1024)
+#define VIPER_NET_SHM_SEND_BATCH    (256 * 1024)
+#define VIPER_NET_SHM_RECV_BACKLOG  (4 * 1024 * 1024)
+#define VIPER_NET_SHM_MAGIC         0x5650534D // "VPSM"
+#define VIPER_NET_SHM_VERSION       1
+
+// clang-format on
+
+/**
+ * @brief ShmBackend the I/O of same host connections of one event loop over shared
+ *        memory.
+ *
+ * A connection starts as a UNIX socket. The accepting side creates a memfd with
+ * one ShmRing per direction plus an eventfd per side and passes them over the
+ * socket; from then on the frames only go through the rings, and the socket is
+ * kept to notice the peer going away. A side writes the eventfd of the other one
+ * only when that one may be waiting, for data or for space.
+ *
+ * Like with UringBackend, every connection is represented by a bufferevent pair:
+ * the connection uses one side exactly like a socket bufferevent, so framing,
+ * compression, backpressure and the TCPHandlerCallback contract are unchanged.
+ */
+class ShmBackend final
+{
+public:
+    ShmBackend() = default;
+    ~ShmBackend();
+
+    ShmBackend(const ShmBackend&)            = delete;
+    ShmBackend& operator=(const ShmBackend&) = delete;
+
+public:
+    std::error_code Start(event_base* base);
+
+    /**
+     * @brief Stop close every connection, called after the loop exited
+     */
+    void Stop();
+
+    /**
+     * @brief Open set up the rings of an accepted UNIX socket and pass them to the peer
+     *
+     * @param fd the accepted socket, owned by the backend from now on
+     * @return bufferevent* the bufferevent of the connection
+     */
+    bufferevent* Open(evutil_socket_t fd);
+
+    /**
+     * @brief Connect wait for the rings on a connected UNIX socket, the bufferevent
+     *        reports BEV_EVENT_CONNECTED or BEV_EVENT_ERROR like bufferevent_socket_connect
+     *
+     * @param fd a connected non blocking socket, owned by the backend from now on
+     * @return bufferevent* the bufferevent of the connection
+     */
+    bufferevent* Connect(evutil_socket_t fd);
+
+    /**
+     * @brief Owns check if a bufferevent belongs to a shared memory connection
+     *
+     * @param bev the bufferevent of a connection
+     * @return true
+     * @return false
+     */
+    static bool Owns(bufferevent* bev);
+
+    /**
+     * @brief Release close the connection behind a bufferevent returned by Open or
+     *        Connect, called before the bufferevent is freed
+     *
+     * @param bev the bufferevent of a connection
+     * @return true when bev belongs to a shared memory backend
+     */
+    static bool Release(bufferevent* bev);
+
+private:
+    struct Channel;
+
+    static void SendCallback(bufferevent* bev, void* ctx);
+    static void DrainCallback(bufferevent* bev, void* ctx);
+    static void WakeupCallback(evutil_socket_t fd, short events, void* ctx);
+    static void SocketCallback(evutil_socket_t fd, short events, void* ctx);
+    static Channel* Find(bufferevent* bev);
+
+private:
+    Channel* NewChannel(evutil_socket_t fd);
+    bool     Map(Channel* chan, int memfd, uint32_t capacity, bool creator);
+    void     Handshake(Channel* chan);
+    void     Transmit(Channel* chan);
+    void     Receive(Channel* chan);
+    void     Wake(Channel* chan);
+    void     Notify(Channel* chan, short events);
+    void     Fail(Channel* chan);
+    void     Free(Channel* chan);
+
+private:
+    event_base*                  _base    = nullptr;
+    bool                         _stopped = false;
+    std::unordered_set<Channel*> _channels;
+};
+
+using ShmBackendPtr = std::unique_ptr<ShmBackend>;
+
+} // namespace net
+} // namespace viper
+
+#endif
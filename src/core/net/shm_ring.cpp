@@ -0,0 +1,150 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#include "core/net/shm_ring.h"
+
+#include <algorithm>
+
+namespace viper {
+namespace net {
+
+std::size_t ShmRing::RegionSize(uint32_t capacity)
+{
+    // the data starts on its own page after the header
+    return 4096 + (std::size_t)capacity;
+}
+
+void ShmRing::Bind(void* memory, uint32_t capacity, bool init)
+{
+    static_assert(sizeof(Header) <= 4096, "the ring header must fit into a page");
+
+    _header   = static_cast<Header*>(memory);
+    _data     = static_cast<char*>(memory) + 4096;
+    _capacity = capacity;
+    _position = 0;
+    _broken   = false;
+
+    if (init)
+    {
+        _header->_tail.store(0, std::memory_order_relaxed);
+        _header->_head.store(0, std::memory_order_relaxed);
+        _header->_producerWaiting.store(0, std::memory_order_relaxed);
+    }
+}
+
+std::size_t ShmRing::Write(evbuffer* input, bool& wake)
+{
+    uint64_t tail = _position;
+    uint64_t head = _header->_head.load(std::memory_order_acquire);
+    if (!Check(tail, head))
+    {
+        return 0;
+    }
+
+    std::size_t count = std::min<std::size_t>(_capacity - (tail - head), evbuffer_get_length(input));
+    if (0 == count)
+    {
+        return 0;
+    }
+
+    std::size_t offset = tail % _capacity;
+    std::size_t first  = std::min<std::size_t>(count, _capacity - offset);
+    evbuffer_remove(input, _data + offset, first);
+    if (count > first)
+    {
+        evbuffer_remove(input, _data, count - first);
+    }
+
+    // Both positions are stored before the other one is loaded, so either the
+    // consumer sees the new tail after it caught up, or the producer sees that
+    // it caught up and wakes it.
+    _position = tail + count;
+    _header->_tail.store(_position, std::memory_order_seq_cst);
+    wake = _header->_head.load(std::memory_order_seq_cst) == tail;
+    return count;
+}
+
+bool ShmRing::WaitForSpace()
+{
+    _header->_producerWaiting.store(1, std::memory_order_seq_cst);
+
+    uint64_t tail = _position;
+    uint64_t head = _header->_head.load(std::memory_order_seq_cst);
+    if (Check(tail, head) && tail - head < _capacity)
+    {
+        _header->_producerWaiting.store(0, std::memory_order_relaxed);
+        return true;
+    }
+
+    return false;
+}
+
+std::size_t ShmRing::Read(evbuffer* output, std::size_t max, bool& wake)
+{
+    uint64_t head = _position;
+    uint64_t tail = _header->_tail.load(std::memory_order_seq_cst);
+    if (!Check(tail, head))
+    {
+        return 0;
+    }
+
+    std::size_t count = std::min<std::size_t>(tail - head, max);
+    if (0 == count)
+    {
+        return 0;
+    }
+
+    std::size_t offset = head % _capacity;
+    std::size_t first  = std::min<std::size_t>(count, _capacity - offset);
+    evbuffer_add(output, _data + offset, first);
+    if (count > first)
+    {
+        evbuffer_add(output, _data, count - first);
+    }
+
+    _position = head + count;
+    _header->_head.store(_position, std::memory_order_seq_cst);
+    wake = _header->_producerWaiting.load(std::memory_order_seq_cst) &&
+           _header->_producerWaiting.exchange(0, std::memory_order_seq_cst);
+    return count;
+}
+
+bool ShmRing::Empty()
+{
+    // a broken ring has nothing left to deliver
+    return _broken || _position == _header->_tail.load(std::memory_order_acquire);
+}
+
+bool ShmRing::Broken() const
+{
+    return _broken;
+}
+
+bool ShmRing::Check(uint64_t tail, uint64_t head)
+{
+    // the peer may write anything to its position, a ring holding more than its
+    // capacity would copy out of bounds
+    if (!_broken && tail - head <= _capacity)
+    {
+        return true;
+    }
+
+    _broken = true;
+    return false;
+}
+
+} // namespace net
+} // namespace viper
@@ -0,0 +1,123 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#ifndef _VIPER_CORE_NET_SHM_RING_H_
+#define _VIPER_CORE_NET_SHM_RING_H_
+
+#include <event2/buffer.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace viper {
+namespace net {
+
+/**
+ * @brief ShmRing a single producer, single consumer byte ring in memory shared by
+ *        two processes. The producer and the consumer only share the two positions,
+ *        each on its own cache line, and the flag of a producer waiting for space.
+ *
+ * A side which finds nothing to do goes back to its event loop. Write and Read
+ * tell the caller when the other side may have done so and has to be woken up.
+ *
+ * Each side keeps its own position locally and only loads the one of the peer,
+ * which is checked against the capacity on every load. A peer which moved it out
+ * of range breaks the ring, nothing is copied from or into it anymore.
+ */
+class ShmRing final
+{
+public:
+    /**
+     * @brief RegionSize the bytes a ring of capacity takes in the shared memory
+     *
+     * @param capacity the data bytes of the ring
+     * @return std::size_t
+     */
+    static std::size_t RegionSize(uint32_t capacity);
+
+public:
+    /**
+     * @brief Bind use the ring at memory
+     *
+     * @param memory the start of a region of RegionSize(capacity) bytes
+     * @param capacity the data bytes of the ring
+     * @param init reset the positions, done by the side which created the memory
+     */
+    void Bind(void* memory, uint32_t capacity, bool init);
+
+    /**
+     * @brief Write move as much of input into the ring as fits, called by the producer
+     *
+     * @param input the bytes to write, the written ones are drained
+     * @param wake set when the consumer has to be woken up
+     * @return std::size_t the bytes written, 0 when the ring is full or broken
+     */
+    std::size_t Write(evbuffer* input, bool& wake);
+
+    /**
+     * @brief WaitForSpace ask the consumer for a wakeup once it freed space, called by
+     *        the producer after Write found the ring full
+     *
+     * @return true there is space already, write again instead of waiting
+     * @return false the ring is full or broken
+     */
+    bool WaitForSpace();
+
+    /**
+     * @brief Read append up to max bytes of the ring to output, called by the consumer
+     *
+     * @param output the buffer the bytes are appended to
+     * @param max the bytes to read at most
+     * @param wake set when the producer waits for space and has to be woken up
+     * @return std::size_t the bytes read, 0 when the ring is empty or broken
+     */
+    std::size_t Read(evbuffer* output, std::size_t max, bool& wake);
+
+    bool Empty();
+
+    /**
+     * @brief Broken check if the peer moved its position out of the ring, the
+     *        connection has to be closed then
+     *
+     * @return true
+     * @return false
+     */
+    bool Broken() const;
+
+private:
+    bool Check(uint64_t tail, uint64_t head);
+
+private:
+    struct Header
+    {
+        alignas(64) std::atomic<uint64_t> _tail; // written by the producer
+        alignas(64) std::atomic<uint64_t> _head; // written by the consumer
+        alignas(64) std::atomic<uint32_t> _producerWaiting;
+    };
+
+private:
+    Header*  _header   = nullptr;
+    char*    _data     = nullptr;
+    uint32_t _capacity = 0;
+    uint64_t _position = 0; // the tail of the producer, the head of the consumer
+    bool     _broken   = false;
+};
+
+} // namespace net
+} // namespace viper
+
+#endif
@@ -15,6 +15,7 @@
 **/
 
 #include "core/net/tcp_client.h"
+#include "core/assist/time.h"
 #include "core/error/error.h"
 #include "core/log/log.h"
 #include "core/net/message.h"
@@ -25,15 +26,23 @@
 #include <event2/event.h>
 #include <event2/util.h>
 
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cmath>
 #include <memory.h>
 #include <string>
+#include <system_error>
 
 namespace viper {
 namespace net {
 
-TCPClient::TCPClient()
+TCPClient::TCPClient(NetBackend backend)
 {
+    _messagePool = std::make_shared<MessagePool>();
+    _backend     = backend;
 }
 
 TCPClient::~TCPClient()
@@ -42,38 +51,62 @@ TCPClient::~TCPClient()
 
 void TCPClient::ReadCallback(bufferevent* bev, void* ctx)
 {
-    auto conn = static_cast<TCPConnection*>(ctx);
+    auto  conn    = static_cast<TCPConnection*>(ctx);
+    auto  handler = static_cast<TCPClient*>(conn->GetHandler());
+    auto& batch   = handler->_batch;
 
-    MessagePtr msg     = std::make_shared<Message>();
-    auto       errcode = conn->Read(msg);
+    auto errcode = conn->Read(handler->_messagePool.get(), batch);
+    if (!error::IsSuccess(errcode))
+    {
+        // the stream can not be resynchronized, stop reading from it
+        LOG_WARN("invalid connection:{}, errcode:{}", conn->ID(), errcode.value());
+        conn->UpdateState(ConnectionState::INVALID);
+        bufferevent_disable(bev, EV_READ);
+    }
 
-    if (errcode == error::ErrorCode::SYSTEM_TRY_AGAIN)
+    if (batch.empty())
     {
         LOG_DEBUG("no more data to read, try again, connection:{}", conn->ID());
+        conn->OfferFile(handler->_functor);
         return;
     }
 
-    if (errcode == error::ErrorCode::NET_INVALID_MAGIC)
+    LOG_DEBUG("readed {} messages. connection:{}", batch.size(), conn->ID());
+
+    auto sharedConn = conn->shared_from_this();
+
+    std::size_t count = 0;
+    for (auto& msg : batch)
     {
-        LOG_WARN("invalid connection:{}", conn->ID());
-        conn->UpdateState(ConnectionState::INVALID);
-        return;
+        if (!handler->ProcessCoreMessage(sharedConn, msg))
+        {
+            batch[count++] = std::move(msg);
+        }
     }
+    batch.resize(count);
 
-    if (!error::IsSuccess(errcode))
+    if (!batch.empty())
     {
-        LOG_ERROR("failed to read data from connection:{}, errcode:{}", conn->GetRemoteAddress(), errcode.value());
+        handler->_functor->Dispatch(sharedConn, batch);
     }
 
-    LOG_DEBUG("readed a message. connection:{}", conn->ID());
+    // give the messages back to the pool
+    batch.clear();
 
-    auto handler    = static_cast<TCPClient*>(conn->GetHandler());
-    auto sharedConn = conn->shared_from_this();
+    // a file frame is offered once the frames before it were handled
+    conn->OfferFile(handler->_functor);
+}
 
-    if (!handler->ProcessCoreMessage(sharedConn, msg))
+void TCPClient::WriteCallback(bufferevent* bev, void* ctx)
+{
+    auto conn = static_cast<TCPConnection*>(ctx);
+    if (!conn->Pump())
     {
-        handler->_functor->HandleData(sharedConn, msg);
+        return;
     }
+
+    auto client = static_cast<TCPClient*>(conn->GetHandler());
+    client->_functor->OnWritable(conn->shared_from_this());
 }
 
 void TCPClient::EventCallback(bufferevent* bev, short events, void* ctx)
@@ -83,22 +116,31 @@ void TCPClient::EventCallback(bufferevent* bev, short events, void* ctx)
 
     if (events & BEV_EVENT_CONNECTED)
     {
+        // a TLS connection reports it once its handshake completed
+        SSL* ssl = client->_tls ? bufferevent_openssl_get_ssl(bev) : nullptr;
+        if (ssl)
+        {
+            client->_tls->OnHandshake(ssl);
+        }
+
         conn->UpdateState(ConnectionState::CONNECTED);
+        conn->SendHello();
         client->_functor->OnConnection(conn->shared_from_this());
         return;
     }
 
-    if (events & BEV_EVENT_EOF)
+    // a reset peer reports an error instead of the end of file, both drop the connection
+    if (events & (BEV_EVENT_EOF | BEV_EVENT_ERROR))
     {
-        conn->UpdateState(ConnectionState::DISCONNECTED);
-        auto sharedConn = conn->shared_from_this();
-        client->_functor->OnDisconnection(sharedConn);
-        client->_connection.reset();
-        return;
-    }
+        std::string reason = client->_tls ? TLSContext::ErrorString(bev) : "";
+        if (!reason.empty())
+        {
+            LOG_WARN("tls connection failed. error:{}, connection:{}", reason, conn->ID());
+        }
 
-    if (events & BEV_EVENT_ERROR)
-    {
+        LOG_DEBUG("connection dropped. events:0x{:02X}, connection:{}", events, conn->ID());
+        client->CloseConnection(conn, ConnectionState::DISCONNECTED);
+        return;
     }
 
     if (events & BEV_EVENT_TIMEOUT)
@@ -113,7 +155,8 @@ void TCPClient::CheckConnectionState(evutil_socket_t fd, short events, void* ctx
 
     LOG_DEBUG("tcp client check the connection state, remote server: {}:{}", client->_remoteIP, client->_remotePort);
 
-    if (client->_connection == nullptr || client->_connection->State() != ConnectionState::CONNECTED)
+    auto conn = client->_connection.load();
+    if (conn == nullptr || conn->State() != ConnectionState::CONNECTED)
     {
         auto errcode = client->Reconnect();
         if (!viper::error::IsSuccess(errcode))
@@ -129,34 +172,99 @@ void TCPClient::CheckConnectionState(evutil_socket_t fd, short events, void* ctx
 void TCPClient::ConnectionKeepalive(evutil_socket_t fd, short events, void* ctx)
 {
     auto client = static_cast<TCPClient*>(ctx);
+    auto conn   = client->_connection.load();
 
-    LOG_DEBUG("tcp client connection keepalive, remote server: {}:{}", client->_remoteIP, client->_remotePort);
+    // set the next timer
+    evtimer_add(client->_connectionKeepaliveEvent, &client->_connectionKeepaliveTimeoutSeconds);
 
-    if (client->_connection == nullptr)
+    // a ping in flight is followed up by the dead peer check
+    if (conn == nullptr || conn->State() != ConnectionState::CONNECTED || client->_pingTime != 0)
     {
-        // set the next timer
-        evtimer_add(client->_connectionKeepaliveEvent, &client->_connectionKeepaliveTimeoutSeconds);
         return;
     }
 
+    // Frames in both directions prove the liveness to both sides, the ping is only
+    // sent anyway once the last round trip sample got old.
+    auto nowMs   = assist::TimestampTickCountMillisecond();
+    bool traffic = conn->ReceivedBytes() != client->_keepaliveReadBytes && conn->WriteBytes() != client->_keepaliveWriteBytes;
+    bool fresh   = nowMs - client->_rttSampleTime < VIPER_NET_TCP_CONNECTION_RTT_REFRESH_SECOND_DFT * 1000;
+
+    client->_keepaliveReadBytes  = conn->ReceivedBytes();
+    client->_keepaliveWriteBytes = conn->WriteBytes();
+    if (traffic && fresh)
+    {
+        return;
+    }
+
+    LOG_DEBUG("tcp client connection keepalive, remote server: {}:{}", client->_remoteIP, client->_remotePort);
+
     static std::string data(VIPER_NET_MESSAGE_KEEPALIVE_PING);
 
+    // the server echoes the timestamp in its pong
     viper::net::Header header;
-    header._dataSize = data.size();
-    header._msgType  = (uint32_t)VIPER_NET_MESSAGE_PROTOCOL_KEEPALIVE_PING;
+    header._dataSize  = data.size();
+    header._msgType   = (uint32_t)VIPER_NET_MESSAGE_PROTOCOL_KEEPALIVE_PING;
+    header._timestamp = assist::TimestampTickCountMicrosecond();
 
     viper::net::Hton(header);
     viper::net::Message msg(header, data.data(), data.size());
 
-    auto errcode = client->_connection->Send(msg);
-
+    auto errcode = conn->Send(msg);
     if (!viper::error::IsSuccess(errcode))
     {
-        LOG_WARN("failed to send keepalive ping. connection: {}", client->_connection->ID());
+        LOG_WARN("failed to send keepalive ping. connection: {}", conn->ID());
+        return;
+    }
+
+    client->_pingTime            = assist::TimestampTickCountMicrosecond();
+    client->_pingReadBytes       = conn->ReceivedBytes();
+    client->_keepaliveWriteBytes = conn->WriteBytes();
+
+    // Without samples the peer is given five timeout periods, like the idle
+    // connections of the server, and never less than a keepalive interval.
+    uint64_t fallbackUs = (uint64_t)client->_checkConnectionTimeoutSeconds.tv_sec * 5 * 1000000;
+    uint64_t floorUs    = (uint64_t)client->_connectionKeepaliveTimeoutSeconds.tv_sec * 1000000;
+    uint64_t timeoutUs  = conn->RTT().Timeout(fallbackUs) * VIPER_NET_TCP_CONNECTION_DEAD_PEER_RTT_TIMEOUTS;
+    uint64_t deadlineUs = std::max(floorUs, std::min(fallbackUs, timeoutUs));
+    timeval  deadline   = {(time_t)(deadlineUs / 1000000), (suseconds_t)(deadlineUs % 1000000)};
+    evtimer_add(client->_deadPeerEvent, &deadline);
+}
+
+void TCPClient::CheckDeadPeer(evutil_socket_t fd, short events, void* ctx)
+{
+    auto client = static_cast<TCPClient*>(ctx);
+    auto conn   = client->_connection.load();
+    if (conn == nullptr || client->_pingTime == 0)
+    {
+        return;
+    }
+
+    // anything received since the ping shows the peer is there, only the pong is
+    // late, maybe behind a large frame which did not arrive whole yet
+    uint64_t elapsedUs = assist::TimestampTickCountMicrosecond() - client->_pingTime;
+    client->_pingTime  = 0;
+    if (conn->ReceivedBytes() != client->_pingReadBytes)
+    {
+        return;
+    }
+
+    LOG_WARN("the peer did not answer the keepalive ping. elapsed ms:{}, srtt us:{}, connection:{}",
+             elapsedUs / 1000, conn->RTT().Stats()._srttUs, conn->ID());
+    client->CloseConnection(conn.get(), ConnectionState::TIMEOUT);
+}
+
+void TCPClient::ExpireCalls(evutil_socket_t fd, short events, void* ctx)
+{
+    auto client = static_cast<TCPClient*>(ctx);
+
+    auto expired = client->_calls.Expire(assist::TimestampTickCountMillisecond());
+    if (expired > 0)
+    {
+        LOG_DEBUG("calls timed out. expired:{}, outstanding:{}", expired, client->_calls.Outstanding());
     }
 
     // set the next timer
-    evtimer_add(client->_connectionKeepaliveEvent, &client->_connectionKeepaliveTimeoutSeconds);
+    evtimer_add(client->_expireCallsEvent, &client->_expireCallsInterval);
 }
 
 void TCPClient::SetTimeout(int timeoutSec)
@@ -177,6 +285,50 @@ void TCPClient::SetCallback(TCPHandlerCallbackFunctor functor)
     _functor = functor;
 }
 
+void TCPClient::SetBackpressure(const BackpressureConfig& config)
+{
+    _backpressure = config;
+}
+
+void TCPClient::SetPriority(const PriorityConfig& config)
+{
+    _priority = config;
+}
+
+void TCPClient::SetCompression(const CompressionConfig& config)
+{
+    _compressor = config._enable ? std::make_shared<Compressor>(config) : nullptr;
+}
+
+void TCPClient::SetChecksum(bool enable)
+{
+    _checksum = enable;
+}
+
+void TCPClient::SetCompactHeader(bool enable)
+{
+    _compact = enable;
+}
+
+std::error_code TCPClient::SetTLS(const TLSConfig& config)
+{
+    if (!config._enable)
+    {
+        _tls = nullptr;
+        return error::ErrorCode::SUCCESS;
+    }
+
+    auto tls     = std::make_shared<TLSContext>();
+    auto errcode = tls->Init(config, false);
+    if (!error::IsSuccess(errcode))
+    {
+        return errcode;
+    }
+
+    _tls = tls;
+    return error::ErrorCode::SUCCESS;
+}
+
 std::error_code TCPClient::Connect(const std::string& ip, uint16_t port)
 {
     _base = event_base_new();
@@ -186,19 +338,64 @@ std::error_code TCPClient::Connect(const std::string& ip, uint16_t port)
         return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
     }
 
+    // the lowest priority runs after the I/O callbacks, e.g. corked flushes
+    event_base_priority_init(_base, VIPER_NET_EVENT_PRIORITY_COUNT);
+
+    auto errcode = _outbound.Start(_base, this);
+    if (!error::IsSuccess(errcode))
+    {
+        event_base_free(_base);
+        _base = nullptr;
+        return errcode;
+    }
+
+    if (NetBackend::IO_URING == _backend)
+    {
+        _uring  = std::make_unique<UringBackend>();
+        errcode = _uring->Start(_base);
+        if (!error::IsSuccess(errcode))
+        {
+            LOG_ERROR("failed to start the io_uring backend:{}:{}", ip, port);
+            _uring.reset();
+            _outbound.Stop();
+            event_base_free(_base);
+            _base = nullptr;
+            return errcode;
+        }
+    }
+
+    if (!_shmPath.empty())
+    {
+        _shm = std::make_unique<ShmBackend>();
+        _shm->Start(_base);
+    }
+
     _remoteIP   = ip;
     _remotePort = port;
 
-    auto errcode = Reconnect();
+    errcode = Reconnect();
     if (!viper::error::IsSuccess(errcode))
     {
+        // the base is freed last, the queue and the backends have events on it
+        _outbound.Stop();
+        _uring.reset();
+        _shm.reset();
+        event_base_free(_base);
+        _base = nullptr;
         return errcode;
     }
 
+    _running  = true;
     _asyncRun = std::async(std::launch::async, &TCPClient::Run, this);
     return error::ErrorCode::SUCCESS;
 }
 
+std::error_code TCPClient::ConnectShm(const std::string& path)
+{
+    _shmPath = path;
+    return Connect(path, 0);
+}
+
 void TCPClient::Close()
 {
     if (!_base)
@@ -206,33 +403,179 @@ void TCPClient::Close()
         return;
     }
 
+    // the loop notices the break at its next wakeup, the timers bound the wait
+    _running = false;
     event_base_loopbreak(_base);
-    bufferevent_free(_bev);
+    if (_asyncRun.valid())
+    {
+        _asyncRun.wait();
+    }
+
+    // the connection frees its bufferevent, then the backend its sockets
+    _connection.store(nullptr);
+    _outbound.Stop();
+    _uring.reset();
+    _shm.reset();
+
+    for (auto ev : {_checkConnectionStateEvent, _connectionKeepaliveEvent, _deadPeerEvent, _expireCallsEvent})
+    {
+        if (ev)
+        {
+            event_free(ev);
+        }
+    }
     event_base_free(_base);
 
-    _base = nullptr;
-    _bev  = nullptr;
+    _base                      = nullptr;
+    _checkConnectionStateEvent = nullptr;
+    _connectionKeepaliveEvent  = nullptr;
+    _deadPeerEvent             = nullptr;
+    _expireCallsEvent          = nullptr;
 
-    _asyncRun.wait();
+    _calls.Cancel(error::ErrorCode::NET_DISCONNECTED);
 }
 
 std::error_code TCPClient::Send(const Message& msg)
 {
-    if (_connection == nullptr)
+    auto conn = _connection.load();
+    if (conn == nullptr)
     {
         return error::ErrorCode::NET_DISCONNECTED;
     }
 
-    if (_connection->State() != ConnectionState::CONNECTED)
+    if (conn->State() != ConnectionState::CONNECTED)
     {
         return viper::error::ErrorCode::NET_DISCONNECTED;
     }
 
-    return _connection->Send(msg);
+    return conn->Send(msg);
+}
+
+uint64_t TCPClient::OpenStream()
+{
+    auto conn = _connection.load();
+    return conn ? conn->OpenStream() : 0;
+}
+
+std::error_code TCPClient::SendChunk(const Header& header, uint64_t streamID, const iovec* iov, int iovcnt, bool last,
+                                     evbuffer_ref_cleanup_cb cleanup, void* cleanupArg)
+{
+    auto conn = _connection.load();
+    if (conn == nullptr || conn->State() != ConnectionState::CONNECTED)
+    {
+        return error::ErrorCode::NET_DISCONNECTED;
+    }
+
+    return conn->SendChunk(header, streamID, iov, iovcnt, last, cleanup, cleanupArg);
+}
+
+std::error_code TCPClient::SendFile(const std::string& path, uint64_t offset, uint64_t length, uint32_t msgType)
+{
+    auto conn = _connection.load();
+    if (conn == nullptr || conn->State() != ConnectionState::CONNECTED)
+    {
+        return error::ErrorCode::NET_DISCONNECTED;
+    }
+
+    return conn->SendFile(path, offset, length, msgType);
+}
+
+bool TCPClient::IsConnected()
+{
+    auto conn = _connection.load();
+    return conn != nullptr && conn->State() == ConnectionState::CONNECTED;
+}
+
+std::size_t TCPClient::Outstanding()
+{
+    return _calls.Outstanding();
+}
+
+std::error_code TCPClient::Call(uint32_t msgType, const char* payload, uint32_t payloadSize, int timeoutMs,
+                                CallCallback callback)
+{
+    auto conn = _connection.load();
+    if (conn == nullptr || conn->State() != ConnectionState::CONNECTED)
+    {
+        return error::ErrorCode::NET_DISCONNECTED;
+    }
+
+    uint64_t sequence = 0;
+    uint64_t deadline = assist::TimestampTickCountMillisecond() + timeoutMs;
+
+    auto errcode = _calls.Insert(deadline, std::move(callback), sequence);
+    if (!error::IsSuccess(errcode))
+    {
+        return errcode;
+    }
+
+    Header header;
+    header._msgType  = msgType;
+    header._sequence = sequence;
+
+    iovec iov = {(void*)payload, payloadSize};
+    errcode   = conn->SendV(header, &iov, 1);
+
+    // the loop may have expired or cancelled the call meanwhile, its callback has
+    // run then and the call counts as sent
+    if (!error::IsSuccess(errcode) && !_calls.Remove(sequence))
+    {
+        return error::ErrorCode::SUCCESS;
+    }
+
+    return errcode;
+}
+
+std::future<MessagePtr> TCPClient::Call(uint32_t msgType, const char* payload, uint32_t payloadSize, int timeoutMs)
+{
+    auto promise = std::make_shared<std::promise<MessagePtr>>();
+    auto future  = promise->get_future();
+
+    auto errcode = Call(msgType, payload, payloadSize, timeoutMs, [promise](std::error_code errcode, MessagePtr response) {
+        if (!error::IsSuccess(errcode))
+        {
+            promise->set_exception(std::make_exception_ptr(std::system_error(errcode)));
+            return;
+        }
+
+        promise->set_value(std::move(response));
+    });
+
+    if (!error::IsSuccess(errcode))
+    {
+        promise->set_exception(std::make_exception_ptr(std::system_error(errcode)));
+    }
+
+    return future;
+}
+
+MessagePoolStats TCPClient::GetMessagePoolStats()
+{
+    return _messagePool->Stats();
+}
+
+CompressionStats TCPClient::GetCompressionStats()
+{
+    return _compressor ? _compressor->Stats() : CompressionStats();
+}
+
+RTTStats TCPClient::GetRTTStats()
+{
+    auto conn = _connection.load();
+    return conn ? conn->RTT().Stats() : RTTStats();
+}
+
+TLSStats TCPClient::GetTLSStats()
+{
+    return _tls ? _tls->Stats() : TLSStats();
 }
 
 void TCPClient::Run()
 {
+    // the message pool and the connection are owned by the loop thread
+    _messagePool->BindThread();
+    _outbound.BindThread();
+
     // set connection state check timer
     _checkConnectionStateEvent = evtimer_new(_base, &TCPClient::CheckConnectionState, this);
     evtimer_add(_checkConnectionStateEvent, &_checkConnectionTimeoutSeconds);
@@ -241,18 +584,29 @@ void TCPClient::Run()
     _connectionKeepaliveEvent = evtimer_new(_base, &TCPClient::ConnectionKeepalive, this);
     evtimer_add(_connectionKeepaliveEvent, &_connectionKeepaliveTimeoutSeconds);
 
+    // armed with every keepalive ping
+    _deadPeerEvent = evtimer_new(_base, &TCPClient::CheckDeadPeer, this);
+
+    // set call expiration timer
+    _expireCallsEvent = evtimer_new(_base, &TCPClient::ExpireCalls, this);
+    evtimer_add(_expireCallsEvent, &_expireCallsInterval);
+
     // start the event loop
     int exitedCode = 0;
     do {
         exitedCode = event_base_loop(_base, EVLOOP_NO_EXIT_ON_EMPTY);
-    } while (exitedCode != -1);
+    } while (exitedCode != -1 && _running);
 
     LOG_WARN("tcp client run exited. exited code:{}", exitedCode);
-    bufferevent_free(_bev);
 }
 
 std::error_code TCPClient::Reconnect()
 {
+    if (_shm)
+    {
+        return ReconnectShm();
+    }
+
     evutil_addrinfo hints;
     memset(&hints, 0, sizeof(hints));
     hints.ai_family   = AF_UNSPEC;
@@ -264,28 +618,45 @@ std::error_code TCPClient::Reconnect()
     if (getaddrinfo(_remoteIP.c_str(), remotePort.c_str(), &hints, &servinfo) != 0)
     {
         LOG_WARN("failed to get addr info. remote server: {}:{}", _remoteIP, remotePort);
-        event_base_free(_base);
-        _base = nullptr;
         return error::ErrorCode::NET_DISCONNECTED;
     }
 
     evutil_addrinfo* p = nullptr;
     for (p = servinfo; p != nullptr; p = p->ai_next)
     {
-        _bev = bufferevent_socket_new(_base, -1, BEV_OPT_CLOSE_ON_FREE);
-        if (bufferevent_socket_connect(_bev, p->ai_addr, p->ai_addrlen) < 0)
+        bufferevent* bev = nullptr;
+        if (_uring)
+        {
+            evutil_socket_t fd = socket(p->ai_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            bev                = fd < 0 ? nullptr : _uring->Connect(fd, p->ai_addr, p->ai_addrlen);
+            if (!bev)
+            {
+                continue;
+            }
+
+            // the TLS records are filtered on top of the bufferevent of the ring
+            bev = _tls ? OpenTLS(bev) : bev;
+            if (!bev)
+            {
+                continue;
+            }
+        }
+        else
         {
-            bufferevent_free(_bev);
-            _bev = nullptr;
-            continue;
+            bev = _tls ? OpenTLS(nullptr) : bufferevent_socket_new(_base, -1, BEV_OPT_CLOSE_ON_FREE);
+            if (!bev)
+            {
+                continue;
+            }
+
+            if (bufferevent_socket_connect(bev, p->ai_addr, p->ai_addrlen) < 0)
+            {
+                bufferevent_free(bev);
+                continue;
+            }
         }
 
-        auto conn = std::make_shared<TCPConnection>(-1, p->ai_addr, p->ai_addrlen);
-        conn->UpdateState(ConnectionState::CONNECTING);
-        conn->BindHandler(_bev, this);
-        bufferevent_setcb(_bev, &TCPClient::ReadCallback, nullptr, &TCPClient::EventCallback, conn.get());
-        bufferevent_enable(_bev, EV_READ | EV_WRITE);
-        _connection = conn;
+        BindConnection(bev, p->ai_addr, p->ai_addrlen);
         break;
     }
 
@@ -293,18 +664,159 @@ std::error_code TCPClient::Reconnect()
     return error::ErrorCode::SUCCESS;
 }
 
+bufferevent* TCPClient::OpenTLS(bufferevent* io)
+{
+    // the session of the previous connection is offered, so a reconnect resumes it
+    SSL* ssl = _tls->NewSSL(_remoteIP);
+    if (!ssl)
+    {
+        if (io)
+        {
+            UringBackend::Release(io);
+            bufferevent_free(io);
+        }
+
+        return nullptr;
+    }
+
+    bufferevent* bev = nullptr;
+    if (io)
+    {
+        bev = bufferevent_openssl_filter_new(_base, io, ssl, BUFFEREVENT_SSL_CONNECTING, BEV_OPT_CLOSE_ON_FREE);
+    }
+    else
+    {
+        bev = bufferevent_openssl_socket_new(_base, -1, ssl, BUFFEREVENT_SSL_CONNECTING, BEV_OPT_CLOSE_ON_FREE);
+    }
+
+    if (bev)
+    {
+        bufferevent_openssl_set_allow_dirty_shutdown(bev, 1);
+    }
+
+    return bev;
+}
+
+std::error_code TCPClient::ReconnectShm()
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (_shmPath.size() >= sizeof(address.sun_path))
+    {
+        LOG_ERROR("the shared memory socket path is too long. path:{}", _shmPath);
+        return error::ErrorCode::INVALID_PARAMETER;
+    }
+    memcpy(address.sun_path, _shmPath.c_str(), _shmPath.size());
+
+    evutil_socket_t fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        LOG_WARN("failed to create the shared memory socket. errno:{}", errno);
+        return error::ErrorCode::NET_DISCONNECTED;
+    }
+
+    // a UNIX socket connects at once; a server which is not up yet is retried by the
+    // state check, like a refused tcp connect
+    if (connect(fd, (sockaddr*)&address, sizeof(address)) != 0)
+    {
+        LOG_DEBUG("failed to connect the shared memory socket. path:{}, errno:{}", _shmPath, errno);
+        close(fd);
+        return error::ErrorCode::SUCCESS;
+    }
+
+    bufferevent* bev = _shm->Connect(fd);
+    if (!bev)
+    {
+        return error::ErrorCode::NET_DISCONNECTED;
+    }
+
+    BindConnection(bev, (sockaddr*)&address, sizeof(address));
+    return error::ErrorCode::SUCCESS;
+}
+
+void TCPClient::CloseConnection(TCPConnection* conn, ConnectionState state)
+{
+    bool established = conn->State() == ConnectionState::CONNECTED;
+
+    conn->UpdateState(state);
+    _calls.Cancel(error::ErrorCode::NET_DISCONNECTED);
+    auto sharedConn = conn->shared_from_this();
+    if (established)
+    {
+        _functor->AbortStreams(sharedConn);
+        _functor->OnDisconnection(sharedConn);
+    }
+
+    _pingTime = 0;
+    evtimer_del(_deadPeerEvent);
+    _connection.store(nullptr);
+
+    // Reconnect right away instead of waiting for the next state check, a
+    // failed connect waits so an unreachable server is not retried in a loop.
+    if (established)
+    {
+        event_active(_checkConnectionStateEvent, EV_TIMEOUT, 1);
+    }
+}
+
+void TCPClient::BindConnection(bufferevent* bev, sockaddr* address, int socklen)
+{
+    // the connection owns the bufferevent, it is freed with the connection
+    auto conn = std::make_shared<TCPConnection>(-1, address, socklen);
+    conn->UpdateState(ConnectionState::CONNECTING);
+    conn->SetBackpressure(_backpressure);
+    conn->SetPriority(_priority);
+    conn->SetCompressor(_compressor);
+    conn->SetChecksum(_checksum);
+    conn->SetCompactHeader(_compact);
+    conn->BindHandler(bev, this);
+    conn->BindOutbound(&_outbound);
+    bufferevent_setcb(bev, &TCPClient::ReadCallback, &TCPClient::WriteCallback, &TCPClient::EventCallback, conn.get());
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+    _connection.store(conn);
+    _keepaliveReadBytes  = 0;
+    _keepaliveWriteBytes = 0;
+}
+
 bool TCPClient::ProcessCoreMessage(TCPConnectionPtr conn, MessagePtr msg)
 {
     const auto& header = msg->GetHeader();
 
+    if (header._version & VIPER_NET_MESSAGE_FLAG_RESPONSE)
+    {
+        if (!_calls.Complete(header._sequence, error::ErrorCode::SUCCESS, msg))
+        {
+            LOG_DEBUG("drop the response of an expired call. sequence:{}", header._sequence);
+        }
+
+        return true;
+    }
+
     if (header._msgType > VIPER_NET_MESSAGE_PROTOCOL_BASE)
     {
         return false;
     }
 
+    if (header._msgType == VIPER_NET_MESSAGE_PROTOCOL_HELLO)
+    {
+        conn->OnHello(header);
+        return true;
+    }
+
     if (header._msgType == VIPER_NET_MESSAGE_PROTOCOL_KEEPALIVE_PONG)
     {
         LOG_DEBUG("received keepalive pong. remote server: {}", conn->GetRemoteAddress());
+
+        // older servers answer without the timestamp of the ping
+        if (header._timestamp != 0)
+        {
+            conn->RTT().Sample(assist::TimestampTickCountMicrosecond() - header._timestamp);
+            _rttSampleTime = assist::TimestampTickCountMillisecond();
+        }
+
+        _pingTime = 0;
+        evtimer_del(_deadPeerEvent);
         return true;
     }
 
@@ -17,43 +17,145 @@
 #ifndef _VIPER_CORE_NET_TCP_CLIENT_H_
 #define _VIPER_CORE_NET_TCP_CLIENT_H_
 
+#include "core/net/call_table.h"
 #include "core/net/message.h"
+#include "core/net/message_pool.h"
 #include "core/net/tcp_connection.h"
 #include "core/net/tcp_handler.h"
 
 #include <event2/bufferevent.h>
 #include <event2/event.h>
 
+#include <atomic>
+#include <cstddef>
 #include <cstdint>
 #include <future>
 #include <memory>
 #include <system_error>
+#include <vector>
 
 namespace viper {
 namespace net {
 
+/**
+ * @brief TCPClient the libevent backend writes to the sockets with writev, which raises
+ *        SIGPIPE when the server dropped the connection. The process disposition is
+ *        left to the application, which ignores SIGPIPE, e.g. with
+ *        signal(SIGPIPE, SIG_IGN), unless it handles the signal itself. The
+ *        io_uring and shared memory backends send with MSG_NOSIGNAL.
+ */
 class TCPClient final
 {
 public:
-    TCPClient();
+    explicit TCPClient(NetBackend backend = NetBackend::LIBEVENT);
     ~TCPClient();
 
 public:
     static void ReadCallback(bufferevent* bev, void* ctx);
+    static void WriteCallback(bufferevent* bev, void* ctx);
     static void EventCallback(bufferevent* bev, short events, void* ctx);
     static void CheckConnectionState(evutil_socket_t fd, short events, void* ctx);
     static void ConnectionKeepalive(evutil_socket_t fd, short events, void* ctx);
+    static void CheckDeadPeer(evutil_socket_t fd, short events, void* ctx);
+    static void ExpireCalls(evutil_socket_t fd, short events, void* ctx);
 
 public:
-    void            SetTimeout(int timeoutSec);
-    void            SetCallback(TCPHandlerCallbackFunctor functor);
-    std::error_code Connect(const std::string& ip, uint16_t port);
-    void            Close();
-    std::error_code Send(const Message& msg);
+    void             SetTimeout(int timeoutSec);
+    void             SetCallback(TCPHandlerCallbackFunctor functor);
+    void             SetBackpressure(const BackpressureConfig& config);
+    void             SetPriority(const PriorityConfig& config);
+    void             SetCompression(const CompressionConfig& config);
+    void             SetChecksum(bool enable);
+    void             SetCompactHeader(bool enable);
+
+    /**
+     * @brief SetTLS connect over TLS, called before Connect. The session the server
+     *        issued is kept and offered again, so a reconnect takes an abbreviated
+     *        handshake. Not used by ConnectShm.
+     *
+     * @param config the verification and the optional client certificate, disabled by default
+     * @return std::error_code FILE_EXCEPTION when a certificate can not be loaded
+     */
+    std::error_code  SetTLS(const TLSConfig& config);
+    std::error_code  Connect(const std::string& ip, uint16_t port);
+
+    /**
+     * @brief ConnectShm connect to a server on the same host through the UNIX socket
+     *        set with TCPServer::SetShmPath, the frames then go through shared
+     *        memory rings. Everything else works like after Connect.
+     *
+     * @param path the socket path of the server
+     * @return std::error_code
+     */
+    std::error_code  ConnectShm(const std::string& path);
+    void             Close();
+    std::error_code  Send(const Message& msg);
+    bool             IsConnected();
+    std::size_t      Outstanding();
+    MessagePoolStats GetMessagePoolStats();
+    CompressionStats GetCompressionStats();
+    TLSStats         GetTLSStats();
+
+    /**
+     * @brief OpenStream and SendChunk stream a large message over the current
+     *        connection, see TCPConnection::SendChunk. A stream does not survive a
+     *        reconnect, the peer ends it with NET_DISCONNECTED.
+     *
+     * @return uint64_t the stream id, 0 while disconnected
+     */
+    uint64_t        OpenStream();
+    std::error_code SendChunk(const Header& header, uint64_t streamID, const iovec* iov, int iovcnt, bool last,
+                              evbuffer_ref_cleanup_cb cleanup = nullptr, void* cleanupArg = nullptr);
+
+    /**
+     * @brief SendFile send a byte range of a file over the current connection, see
+     *        TCPConnection::SendFile
+     *
+     * @return std::error_code NET_DISCONNECTED while disconnected
+     */
+    std::error_code SendFile(const std::string& path, uint64_t offset, uint64_t length, uint32_t msgType);
+
+    /**
+     * @brief GetRTTStats the round trip times of the current connection, measured
+     *        with the keepalive pings. While frames flow both ways the pings are
+     *        skipped, and a ping unanswered for VIPER_NET_TCP_CONNECTION_DEAD_PEER_RTT_TIMEOUTS
+     *        round trip timeouts, and at least a keepalive interval, drops the
+     *        connection when nothing else arrived meanwhile.
+     *
+     * @return RTTStats empty while disconnected
+     */
+    RTTStats GetRTTStats();
+
+    /**
+     * @brief Call send a request and wait for its response asynchronously. Any
+     *        number of calls may be in flight on the connection, the response is
+     *        matched by the sequence and answered with TCPConnection::Reply.
+     *
+     * @param msgType the message type of the request
+     * @param payload the request payload
+     * @param payloadSize the request payload size
+     * @param timeoutMs the call fails with NET_TIMEOUT after it
+     * @param callback runs on the event loop thread, exactly once if SUCCESS is returned
+     *        and never otherwise
+     * @return std::error_code
+     */
+    std::error_code Call(uint32_t msgType, const char* payload, uint32_t payloadSize, int timeoutMs,
+                         CallCallback callback);
+
+    /**
+     * @brief Call the future variant, a failed call stores a std::system_error
+     *
+     * @return std::future<MessagePtr> the response
+     */
+    std::future<MessagePtr> Call(uint32_t msgType, const char* payload, uint32_t payloadSize, int timeoutMs);
 
 private:
     void            Run();
     std::error_code Reconnect();
+    std::error_code ReconnectShm();
+    bufferevent*    OpenTLS(bufferevent* io);
+    void            BindConnection(bufferevent* bev, sockaddr* address, int socklen);
+    void            CloseConnection(TCPConnection* conn, ConnectionState state);
     bool            ProcessCoreMessage(TCPConnectionPtr conn, MessagePtr msg);
 
 private:
@@ -63,11 +165,37 @@ private:
     std::string               _remoteIP;
     uint16_t                  _remotePort = 0;
     std::future<void>         _asyncRun;
-    TCPConnectionPtr          _connection                = nullptr;
     event*                    _checkConnectionStateEvent = nullptr;
     event*                    _connectionKeepaliveEvent  = nullptr;
+    event*                    _deadPeerEvent             = nullptr;
     event_base*               _base                      = nullptr;
-    bufferevent*              _bev                       = nullptr;
+    MessagePoolPtr            _messagePool               = nullptr;
+    std::vector<MessagePtr>   _batch;
+    BackpressureConfig        _backpressure;
+    PriorityConfig            _priority;
+    CompressorPtr             _compressor = nullptr;
+    TLSContextPtr             _tls        = nullptr;
+    bool                      _checksum   = false;
+    bool                      _compact    = false;
+    std::atomic_bool          _running    = false;
+    NetBackend                _backend    = NetBackend::LIBEVENT;
+    UringBackendPtr           _uring      = nullptr; // the socket I/O with NetBackend::IO_URING
+    ShmBackendPtr             _shm        = nullptr; // the I/O after ConnectShm
+    std::string               _shmPath;
+    OutboundQueue             _outbound;                 // the frames sent from other threads
+    CallTable                 _calls;
+    event*                    _expireCallsEvent    = nullptr;
+    timeval                   _expireCallsInterval = {0, VIPER_NET_CALL_EXPIRE_INTERVAL_MS * 1000};
+
+    // replaced by the loop thread, loaded by the callers of any thread
+    std::atomic<TCPConnectionPtr> _connection;
+
+    // the keepalive, _pingTime is the microsecond tick of the unanswered ping
+    uint64_t _pingTime            = 0;
+    uint64_t _pingReadBytes       = 0;
+    uint64_t _keepaliveReadBytes  = 0;
+    uint64_t _keepaliveWriteBytes = 0;
+    uint64_t _rttSampleTime       = 0; // milliseconds
 };
 
 using TCPClientPtr = std::shared_ptr<TCPClient>;
@@ -0,0 +1,292 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#include "core/net/tcp_client_pool.h"
+#include "core/error/error.h"
+#include "core/log/log.h"
+
+#include <random>
+
+namespace viper {
+namespace net {
+
+TCPClientPool::TCPClientPool(const std::vector<Endpoint>& endpoints, int connections, BalancePolicy policy)
+{
+    _endpoints   = endpoints;
+    _connections = connections > 0 ? connections : VIPER_NET_TCP_CLIENT_POOL_CONNECTIONS_DFT;
+    _policy      = policy;
+
+    for (std::size_t idx = 0; idx < _endpoints.size() * _connections; ++idx)
+    {
+        _clients.push_back(std::make_shared<TCPClient>());
+    }
+}
+
+TCPClientPool::~TCPClientPool()
+{
+}
+
+void TCPClientPool::SetTimeout(int timeoutSec)
+{
+    for (auto& client : _clients)
+    {
+        client->SetTimeout(timeoutSec);
+    }
+}
+
+void TCPClientPool::SetCallback(TCPHandlerCallbackFunctor functor)
+{
+    for (auto& client : _clients)
+    {
+        client->SetCallback(functor);
+    }
+}
+
+void TCPClientPool::SetBackpressure(const BackpressureConfig& config)
+{
+    for (auto& client : _clients)
+    {
+        client->SetBackpressure(config);
+    }
+}
+
+void TCPClientPool::SetPriority(const PriorityConfig& config)
+{
+    for (auto& client : _clients)
+    {
+        client->SetPriority(config);
+    }
+}
+
+void TCPClientPool::SetCompression(const CompressionConfig& config)
+{
+    for (auto& client : _clients)
+    {
+        client->SetCompression(config);
+    }
+}
+
+void TCPClientPool::SetChecksum(bool enable)
+{
+    for (auto& client : _clients)
+    {
+        client->SetChecksum(enable);
+    }
+}
+
+void TCPClientPool::SetCompactHeader(bool enable)
+{
+    for (auto& client : _clients)
+    {
+        client->SetCompactHeader(enable);
+    }
+}
+
+std::error_code TCPClientPool::Connect()
+{
+    std::error_code lastErrcode = error::ErrorCode::NET_DISCONNECTED;
+    bool            connected   = false;
+
+    for (std::size_t idx = 0; idx < _clients.size(); ++idx)
+    {
+        // the connections of one endpoint are interleaved with the others
+        const auto& endpoint = _endpoints[idx % _endpoints.size()];
+
+        auto errcode = _clients[idx]->Connect(endpoint._ip, endpoint._port);
+        if (!error::IsSuccess(errcode))
+        {
+            LOG_WARN("failed to connect the pool endpoint {}:{}. errcode:{}", endpoint._ip, endpoint._port, errcode.value());
+            lastErrcode = errcode;
+            continue;
+        }
+
+        connected = true;
+    }
+
+    return connected ? error::ErrorCode::SUCCESS : lastErrcode;
+}
+
+void TCPClientPool::Close()
+{
+    for (auto& client : _clients)
+    {
+        client->Close();
+    }
+}
+
+TCPClientPtr TCPClientPool::Pick()
+{
+    if (_clients.empty())
+    {
+        return nullptr;
+    }
+
+    switch (_policy)
+    {
+    case BalancePolicy::LEAST_OUTSTANDING:
+        return PickLeastOutstanding();
+
+    case BalancePolicy::POWER_OF_TWO:
+        return PickPowerOfTwo();
+
+    default:
+        return PickRoundRobin();
+    }
+}
+
+std::error_code TCPClientPool::Send(const Message& msg)
+{
+    // a client may drop between the pick and the send, fail over to the next one
+    for (std::size_t attempt = 0; attempt < _clients.size(); ++attempt)
+    {
+        auto client = Pick();
+        if (client == nullptr)
+        {
+            break;
+        }
+
+        auto errcode = client->Send(msg);
+        if (errcode != error::ErrorCode::NET_DISCONNECTED)
+        {
+            return errcode;
+        }
+    }
+
+    return error::ErrorCode::NET_DISCONNECTED;
+}
+
+std::error_code TCPClientPool::Call(uint32_t msgType, const char* payload, uint32_t payloadSize, int timeoutMs,
+                                    CallCallback callback)
+{
+    for (std::size_t attempt = 0; attempt < _clients.size(); ++attempt)
+    {
+        auto client = Pick();
+        if (client == nullptr)
+        {
+            break;
+        }
+
+        // the callback is only consumed when the call was sent
+        auto errcode = client->Call(msgType, payload, payloadSize, timeoutMs, callback);
+        if (errcode != error::ErrorCode::NET_DISCONNECTED)
+        {
+            return errcode;
+        }
+    }
+
+    return error::ErrorCode::NET_DISCONNECTED;
+}
+
+std::future<MessagePtr> TCPClientPool::Call(uint32_t msgType, const char* payload, uint32_t payloadSize, int timeoutMs)
+{
+    auto promise = std::make_shared<std::promise<MessagePtr>>();
+    auto future  = promise->get_future();
+
+    auto errcode = Call(msgType, payload, payloadSize, timeoutMs, [promise](std::error_code errcode, MessagePtr response) {
+        if (!error::IsSuccess(errcode))
+        {
+            promise->set_exception(std::make_exception_ptr(std::system_error(errcode)));
+            return;
+        }
+
+        promise->set_value(std::move(response));
+    });
+
+    if (!error::IsSuccess(errcode))
+    {
+        promise->set_exception(std::make_exception_ptr(std::system_error(errcode)));
+    }
+
+    return future;
+}
+
+std::size_t TCPClientPool::Connected()
+{
+    std::size_t connected = 0;
+    for (auto& client : _clients)
+    {
+        connected += client->IsConnected() ? 1 : 0;
+    }
+
+    return connected;
+}
+
+TCPClientPtr TCPClientPool::PickRoundRobin()
+{
+    std::size_t start = _next.fetch_add(1, std::memory_order_relaxed);
+    for (std::size_t idx = 0; idx < _clients.size(); ++idx)
+    {
+        auto& client = _clients[(start + idx) % _clients.size()];
+        if (client->IsConnected())
+        {
+            return client;
+        }
+    }
+
+    return nullptr;
+}
+
+TCPClientPtr TCPClientPool::PickLeastOutstanding()
+{
+    // start the scan at a rotating index so ties are spread over the clients
+    std::size_t  start  = _next.fetch_add(1, std::memory_order_relaxed);
+    TCPClientPtr picked = nullptr;
+    std::size_t  least  = 0;
+
+    for (std::size_t idx = 0; idx < _clients.size(); ++idx)
+    {
+        auto& client = _clients[(start + idx) % _clients.size()];
+        if (!client->IsConnected())
+        {
+            continue;
+        }
+
+        std::size_t outstanding = client->Outstanding();
+        if (picked == nullptr || outstanding < least)
+        {
+            picked = client;
+            least  = outstanding;
+        }
+    }
+
+    return picked;
+}
+
+TCPClientPtr TCPClientPool::PickPowerOfTwo()
+{
+    thread_local std::minstd_rand random(std::random_device{}());
+
+    auto& first  = _clients[random() % _clients.size()];
+    auto& second = _clients[random() % _clients.size()];
+
+    bool firstConnected  = first->IsConnected();
+    bool secondConnected = second->IsConnected();
+    if (firstConnected && secondConnected)
+    {
+        return first->Outstanding() <= second->Outstanding() ? first : second;
+    }
+
+    if (firstConnected || secondConnected)
+    {
+        return firstConnected ? first : second;
+    }
+
+    // both samples are down, fall back to a scan
+    return PickRoundRobin();
+}
+
+} // namespace net
+} // namespace viper
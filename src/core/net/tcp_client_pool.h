@@ -0,0 +1,123 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#ifndef _VIPER_CORE_NET_TCP_CLIENT_POOL_H_
+#define _VIPER_CORE_NET_TCP_CLIENT_POOL_H_
+
+#include "core/net/call_table.h"
+#include "core/net/message.h"
+#include "core/net/tcp_client.h"
+#include "core/net/tcp_handler.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace viper {
+namespace net {
+
+// clang-format off
+
+#define VIPER_NET_TCP_CLIENT_POOL_CONNECTIONS_DFT 2
+
+// clang-format on
+
+struct Endpoint
+{
+    std::string _ip;
+    uint16_t    _port = 0;
+};
+
+enum class BalancePolicy : int
+{
+    ROUND_ROBIN,
+    LEAST_OUTSTANDING, // the connection with the fewest calls in flight
+    POWER_OF_TWO,      // the less loaded of two random connections
+};
+
+/**
+ * @brief TCPClientPool several connections to each of several endpoints, e.g.
+ *        the controllers of the configuration.
+ *
+ * Every connection is a TCPClient. Sends and calls go to a connected client
+ * chosen by the balance policy, so a dropped connection is skipped right away
+ * while it reconnects in the background.
+ */
+class TCPClientPool final
+{
+public:
+    TCPClientPool(const std::vector<Endpoint>& endpoints,
+                  int                          connections = VIPER_NET_TCP_CLIENT_POOL_CONNECTIONS_DFT,
+                  BalancePolicy                policy      = BalancePolicy::ROUND_ROBIN);
+    ~TCPClientPool();
+
+public:
+    void            SetTimeout(int timeoutSec);
+    void            SetCallback(TCPHandlerCallbackFunctor functor);
+    void            SetBackpressure(const BackpressureConfig& config);
+    void            SetPriority(const PriorityConfig& config);
+    void            SetCompression(const CompressionConfig& config);
+    void            SetChecksum(bool enable);
+    void            SetCompactHeader(bool enable);
+    std::error_code Connect();
+    void            Close();
+
+    /**
+     * @brief Pick choose a connected client by the balance policy
+     *
+     * @return TCPClientPtr nullptr when no client is connected
+     */
+    TCPClientPtr Pick();
+
+    /**
+     * @brief Send send on a picked client, the next one is tried when it dropped
+     *        in the meantime
+     *
+     * @return std::error_code NET_DISCONNECTED when no client is connected
+     */
+    std::error_code Send(const Message& msg);
+
+    std::error_code Call(uint32_t msgType, const char* payload, uint32_t payloadSize, int timeoutMs,
+                         CallCallback callback);
+
+    std::future<MessagePtr> Call(uint32_t msgType, const char* payload, uint32_t payloadSize, int timeoutMs);
+
+    std::size_t Connected();
+
+private:
+    TCPClientPtr PickRoundRobin();
+    TCPClientPtr PickLeastOutstanding();
+    TCPClientPtr PickPowerOfTwo();
+
+private:
+    std::vector<Endpoint>     _endpoints;
+    int                       _connections = VIPER_NET_TCP_CLIENT_POOL_CONNECTIONS_DFT;
+    BalancePolicy             _policy      = BalancePolicy::ROUND_ROBIN;
+    std::vector<TCPClientPtr> _clients;
+    std::atomic_uint64_t      _next = 0;
+};
+
+using TCPClientPoolPtr = std::shared_ptr<TCPClientPool>;
+
+} // namespace net
+} // namespace viper
+
+#endif
@@ -15,22 +15,47 @@
 **/
 
 #include "core/net/tcp_connection.h"
+#include "core/assist/math.h"
 #include "core/assist/string.h"
-#include "core/assist/time.h"
 #include "core/error/error.h"
 #include "core/log/log.h"
 #include "core/net/message.h"
+#include "core/net/shm_backend.h"
+#include "core/net/tcp_handler.h"
+#include "core/net/uring_backend.h"
 
 #include <event2/buffer.h>
 #include <event2/bufferevent.h>
+#include <event2/bufferevent_ssl.h>
 #include <event2/event.h>
 
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+
 namespace viper {
 namespace net {
 
 TCPConnection::TCPConnection(evutil_socket_t fd, sockaddr* address, int socklen)
 {
-    _fd                      = fd;
+    _fd               = fd;
+    _idleTimer._owner = this;
+
+    // a same host connection over shared memory, named after the socket path
+    if (AF_UNIX == address->sa_family)
+    {
+        auto local  = reinterpret_cast<sockaddr_un*>(address);
+        bool named  = socklen > (int)offsetof(sockaddr_un, sun_path) && local->sun_path[0] != '\0';
+        _remoteIP   = named ? local->sun_path : "local";
+        _remotePort = 0;
+        return;
+    }
+
     char host[NI_MAXHOST]    = {0};
     char service[NI_MAXSERV] = {0};
     int  flags               = NI_NUMERICHOST | NI_NUMERICSERV;
@@ -41,16 +66,76 @@ TCPConnection::TCPConnection(evutil_socket_t fd, sockaddr* address, int socklen)
 
     _remoteIP   = host;
     _remotePort = std::atoi(service);
-    BuildID();
 }
 
 TCPConnection::~TCPConnection()
 {
-    LOG_DEBUG("connection is disconnected. {}", _id);
+    LOG_DEBUG("connection is disconnected. {}", ID());
+
+    if (_flushEvent)
+    {
+        event_free(_flushEvent);
+        _flushEvent = nullptr;
+    }
+
+    if (_corkedOutput)
+    {
+        evbuffer_free(_corkedOutput);
+        _corkedOutput = nullptr;
+    }
+
+    if (_pendingOutput)
+    {
+        evbuffer_free(_pendingOutput);
+        _pendingOutput = nullptr;
+    }
+
+    for (auto& lane : _lanes)
+    {
+        if (lane._buffer)
+        {
+            evbuffer_free(lane._buffer);
+            lane._buffer = nullptr;
+        }
+    }
+
+    if (_compressed)
+    {
+        evbuffer_free(_compressed);
+        _compressed = nullptr;
+    }
+
+    if (_frame)
+    {
+        evbuffer_free(_frame);
+        _frame = nullptr;
+    }
+
+    if (_spliceEvent)
+    {
+        event_free(_spliceEvent);
+        _spliceEvent = nullptr;
+    }
+
+    for (auto& end : _pipe)
+    {
+        if (end >= 0)
+        {
+            close(end);
+            end = -1;
+        }
+    }
 
     if (_bev)
     {
         bufferevent_disable(_bev, EV_WRITE | EV_READ);
+
+        // a TLS filter is freed with the bufferevent below it
+        bufferevent* io = bufferevent_get_underlying(_bev);
+        if (!UringBackend::Release(io ? io : _bev))
+        {
+            ShmBackend::Release(_bev);
+        }
         bufferevent_free(_bev);
         _bev = nullptr;
     }
@@ -58,27 +143,119 @@ TCPConnection::~TCPConnection()
 
 const std::string& TCPConnection::ID()
 {
+    std::call_once(_idOnce, [this]() { BuildID(); });
     return _id;
 }
 
+ConnectionHandle TCPConnection::Handle()
+{
+    return _handle;
+}
+
+void TCPConnection::BindHandle(ConnectionHandle handle)
+{
+    _handle = handle;
+}
+
 void TCPConnection::UpdateState(ConnectionState state)
 {
     _state.store(state);
 }
 
-bool TCPConnection::IsTimeout(int timeoutSec)
+TimerNode& TCPConnection::IdleTimer()
+{
+    return _idleTimer;
+}
+
+uint64_t TCPConnection::SampleReadBytes()
+{
+    uint64_t bytes    = _readBytes - _sampledReadBytes;
+    _sampledReadBytes = _readBytes;
+    return bytes;
+}
+
+uint64_t TCPConnection::ReadBytes()
+{
+    return _readBytes;
+}
+
+uint64_t TCPConnection::WriteBytes()
+{
+    return _writeBytes;
+}
+
+uint64_t TCPConnection::ReceivedBytes()
+{
+    // the decoder drains what it counts, the sum grows with every byte that arrives
+    return _bev ? _readBytes + evbuffer_get_length(bufferevent_get_input(_bev)) : _readBytes;
+}
+
+RTTEstimator& TCPConnection::RTT()
 {
-    if (0 == _lastReadTimestamp)
+    return _rtt;
+}
+
+bool TCPConnection::TrackInboundStream(uint64_t streamID, bool end)
+{
+    if (end)
     {
-        _lastReadTimestamp = assist::TimestampTickCountSecond();
-        return false;
+        return 0 == _inboundStreams.erase(streamID);
+    }
+
+    return _inboundStreams.insert(streamID).second;
+}
+
+std::vector<uint64_t> TCPConnection::TakeInboundStreams()
+{
+    std::vector<uint64_t> streams(_inboundStreams.begin(), _inboundStreams.end());
+    _inboundStreams.clear();
+    return streams;
+}
+
+void TCPConnection::Detach()
+{
+    bufferevent_disable(_bev, EV_READ | EV_WRITE);
+    Flush();
+
+    // the flush event belongs to the old loop, the next corked send creates it again
+    if (_flushEvent)
+    {
+        event_free(_flushEvent);
+        _flushEvent = nullptr;
+    }
+
+    if (_spliceEvent)
+    {
+        event_free(_spliceEvent);
+        _spliceEvent = nullptr;
+    }
+}
+
+std::error_code TCPConnection::Attach(event_base* base, void* handler)
+{
+    if (bufferevent_base_set(base, _bev) != 0)
+    {
+        LOG_ERROR("failed to move the connection to another loop. connection:{}", ID());
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    _handler = handler;
+    bufferevent_enable(_bev, EV_READ | EV_WRITE);
+
+    // a file being spliced goes on from the new loop
+    if (_splicing)
+    {
+        _splicing = false;
+        StartSplice();
+    }
+
+    // the lanes are refilled by the write callback, which needs output to fire
+    if (_priority._enable)
+    {
+        PumpLanes();
     }
 
-    // A timeout is only recognized if it exceeds the timeout period five times.
-    auto duration = assist::TimestampTickCountSecond() - _lastReadTimestamp;
-    auto timeout  = timeoutSec * 5;
-    LOG_DEBUG("check timeout. duration: {}, timeout seconds: {}, connection: {}", duration, timeout, ID());
-    return duration >= timeout;
+    return error::ErrorCode::SUCCESS;
 }
 
 ConnectionState TCPConnection::State()
@@ -90,6 +267,27 @@ void TCPConnection::BindHandler(bufferevent* bev, void* handler)
 {
     _bev     = bev;
     _handler = handler;
+
+    // the lanes replace the pending queue, the output is refilled once it drained to one chunk
+    if (_priority._enable)
+    {
+        for (auto& lane : _lanes)
+        {
+            lane._buffer = evbuffer_new();
+        }
+
+        bufferevent_setwatermark(_bev, EV_WRITE, _priority._chunkSize, 0);
+        return;
+    }
+
+    if (0 == _backpressure._highWatermark)
+    {
+        return;
+    }
+
+    // the write callback fires once the output drained to the low watermark
+    bufferevent_setwatermark(_bev, EV_WRITE, _backpressure._lowWatermark, 0);
+    _pendingOutput = evbuffer_new();
 }
 
 void* TCPConnection::GetHandler()
@@ -97,74 +295,1273 @@ void* TCPConnection::GetHandler()
     return _handler;
 }
 
+void TCPConnection::BindOutbound(OutboundQueue* queue)
+{
+    _outbound.store(queue, std::memory_order_release);
+}
+
+OutboundQueue* TCPConnection::Outbound()
+{
+    return _outbound.load(std::memory_order_acquire);
+}
+
+bool TCPConnection::ShouldQueue()
+{
+    OutboundQueue* queue = _outbound.load(std::memory_order_acquire);
+    return queue && !queue->InLoopThread();
+}
+
+bufferevent* TCPConnection::GetBufferEvent()
+{
+    return _bev;
+}
+
 std::string TCPConnection::GetRemoteAddress()
 {
     return assist::FormatString("%s:%d", _remoteIP.c_str(), _remotePort);
 }
 
-std::error_code TCPConnection::Read(MessagePtr msg)
+std::error_code TCPConnection::Read(MessagePool* pool, std::vector<MessagePtr>& msgs)
 {
-    evbuffer* buffer = bufferevent_get_input(_bev);
-    if (Message::MESSAGE_HEADER_SIZE > evbuffer_get_length(buffer))
+    std::size_t first     = msgs.size();
+    evbuffer*   buffer    = bufferevent_get_input(_bev);
+    std::size_t available = evbuffer_get_length(buffer);
+
+    // the payload of a file frame goes to its descriptor before anything else is decoded
+    if (_fileSink >= 0)
     {
-        LOG_DEBUG("evbuffer length less than header size");
-        return error::ErrorCode::SYSTEM_TRY_AGAIN;
+        auto errcode = LandFile(buffer);
+        _readBytes += available - evbuffer_get_length(buffer);
+        available   = evbuffer_get_length(buffer);
+        if (!error::IsSuccess(errcode) || _fileSink >= 0)
+        {
+            UpdateReadWatermark();
+            return errcode;
+        }
     }
 
-    Header header;
-    int    length = evbuffer_copyout(buffer, (void*)&header, Message::MESSAGE_HEADER_SIZE);
-    if (Message::MESSAGE_HEADER_SIZE > length)
+    auto errcode = _decoder.Decode(buffer, pool, msgs);
+
+    _readBytes += available - evbuffer_get_length(buffer);
+    if (!error::IsSuccess(errcode))
+    {
+        LOG_WARN("failed to decode the frames, connection: {}, errcode: {}", ID(), errcode.value());
+        return errcode;
+    }
+
+    for (std::size_t idx = first; idx < msgs.size(); ++idx)
     {
-        LOG_DEBUG("evbuffer copied size less than header size");
-        return error::ErrorCode::SYSTEM_TRY_AGAIN;
+        if (!(msgs[idx]->GetHeader()._version & VIPER_NET_MESSAGE_FLAG_COMPRESSED))
+        {
+            continue;
+        }
+
+        errcode = _compressor ? _compressor->Decompress(*msgs[idx]) : error::ErrorCode::NET_DECOMPRESS_FAILED;
+        if (!error::IsSuccess(errcode))
+        {
+            // the frames before the broken one are still delivered
+            LOG_WARN("failed to decompress the frame, connection: {}, errcode: {}", ID(), errcode.value());
+            msgs.resize(idx);
+            return errcode;
+        }
     }
 
+    UpdateState(ConnectionState::CONNECTED);
+    UpdateReadWatermark();
+
+    return error::ErrorCode::SUCCESS;
+}
+
+std::error_code TCPConnection::Send(const Message& msg)
+{
+    LOG_DEBUG("send data. size:{}, remote address:{}", msg.GetDataSize(), GetRemoteAddress());
+
+    // the header of a message to send is already in network byte order
+    Header header = msg.GetHeader();
     Ntoh(header);
 
-    uint32_t totalSize = header._dataSize + Message::MESSAGE_HEADER_SIZE;
-    if (totalSize > Message::MAX_MESSAGE_SIZE)
+    if (ShouldQueue())
+    {
+        auto errcode = AdmitQueued(msg.GetPayloadSize());
+        if (!error::IsSuccess(errcode))
+        {
+            return errcode;
+        }
+
+        // copied, the message stays with the caller
+        evbuffer* payload = evbuffer_new();
+        if (msg.IsChained())
+        {
+            evbuffer* chained = msg.GetPayloadBuffer();
+            int       count   = evbuffer_peek(chained, -1, nullptr, nullptr, 0);
+
+            std::vector<evbuffer_iovec> chunks(count);
+            evbuffer_peek(chained, -1, nullptr, chunks.data(), count);
+            for (auto& chunk : chunks)
+            {
+                evbuffer_add(payload, chunk.iov_base, chunk.iov_len);
+            }
+        }
+        else
+        {
+            evbuffer_add(payload, msg.GetPayload(), msg.GetPayloadSize());
+        }
+
+        Outbound()->Push(shared_from_this(), header, payload);
+        return error::ErrorCode::SUCCESS;
+    }
+
+    if (ShouldCompress(header, msg.GetPayloadSize()))
     {
-        LOG_WARN("total size {} more than max message size {}.", totalSize, (uint64_t)Message::MAX_MESSAGE_SIZE);
-        return error::ErrorCode::NET_MESSAGE_TOO_LARGE;
+        std::vector<iovec> iov;
+        if (msg.IsChained())
+        {
+            evbuffer* payload = msg.GetPayloadBuffer();
+            int       count   = evbuffer_peek(payload, -1, nullptr, nullptr, 0);
+
+            std::vector<evbuffer_iovec> chunks(count);
+            evbuffer_peek(payload, -1, nullptr, chunks.data(), count);
+            for (auto& chunk : chunks)
+            {
+                iov.push_back({chunk.iov_base, chunk.iov_len});
+            }
+        }
+        else
+        {
+            iov.push_back({(void*)msg.GetPayload(), msg.GetPayloadSize()});
+        }
+
+        auto errcode = SendCompressed(header, iov.data(), iov.size());
+        if (errcode != error::ErrorCode::NET_COMPRESS_FAILED)
+        {
+            return errcode;
+        }
     }
 
-    if (header._magic != VIPER_NET_MESSAGE_MAGIC)
+    if (_compressor && header._msgType > VIPER_NET_MESSAGE_PROTOCOL_BASE)
     {
-        LOG_WARN("invalid connection: {}, magic: 0x{:04X}", ID(), header._magic);
-        return error::ErrorCode::NET_INVALID_MAGIC;
+        _compressor->CountRaw(msg.GetPayloadSize());
     }
 
-    _lastReadTimestamp = assist::TimestampTickCountSecond();
-    UpdateState(ConnectionState::CONNECTED);
+    // Reference the payload segments so the same message can be sent to several
+    // connections. GetPayload would pull a chained payload up into one copy.
+    if (msg.IsChained())
+    {
+        FramePayload payload;
+        payload._buffer = msg.GetPayloadBuffer();
+        return WriteFrame(header, payload);
+    }
+
+    FramePayload payload;
+    iovec        chunk = {(void*)msg.GetPayload(), msg.GetPayloadSize()};
+    payload._iov       = &chunk;
+    payload._iovcnt    = 1;
+    return WriteFrame(header, payload);
+}
+
+std::error_code TCPConnection::Send(const MessagePtr msg)
+{
+    return Send(*msg);
+}
 
-    char* msgBuffer = (char*)evbuffer_pullup(buffer, totalSize);
-    if (!msgBuffer)
+std::error_code TCPConnection::SendV(const Header& header, const iovec* iov, int iovcnt,
+                                     evbuffer_ref_cleanup_cb cleanup, void* cleanupArg)
+{
+    std::size_t payloadSize = 0;
+    for (int idx = 0; idx < iovcnt; ++idx)
     {
-        LOG_DEBUG("no more data to read, connection: {}", ID());
-        return error::ErrorCode::SYSTEM_TRY_AGAIN;
+        payloadSize += iov[idx].iov_len;
     }
 
-    LOG_DEBUG("received, body size:{}, total size:{}", header._dataSize, totalSize);
-    msg->Reset(header, msgBuffer + Message::MESSAGE_HEADER_SIZE, header._dataSize);
-    evbuffer_drain(buffer, totalSize);
+    LOG_DEBUG("send data. size:{}, chunks:{}, remote address:{}", payloadSize, iovcnt, GetRemoteAddress());
 
-    return error::ErrorCode::SUCCESS;
+    if (ShouldQueue())
+    {
+        // admitted before the chunks are referenced, a rejected frame leaves them with the caller
+        auto errcode = AdmitQueued(payloadSize);
+        if (!error::IsSuccess(errcode))
+        {
+            return errcode;
+        }
+
+        // referenced chunks stay referenced, the cleanup runs on the loop thread
+        evbuffer* payload = evbuffer_new();
+        for (int idx = 0; idx < iovcnt; ++idx)
+        {
+            if (cleanup)
+            {
+                evbuffer_add_reference(payload, iov[idx].iov_base, iov[idx].iov_len, cleanup, cleanupArg);
+            }
+            else
+            {
+                evbuffer_add(payload, iov[idx].iov_base, iov[idx].iov_len);
+            }
+        }
+
+        Outbound()->Push(shared_from_this(), header, payload);
+        return error::ErrorCode::SUCCESS;
+    }
+
+    if (ShouldCompress(header, payloadSize))
+    {
+        auto errcode = SendCompressed(header, iov, iovcnt);
+        if (errcode != error::ErrorCode::NET_COMPRESS_FAILED)
+        {
+            // the chunks were compressed into a copy, release them right away
+            bool release = error::IsSuccess(errcode) || errcode == error::ErrorCode::NET_SEND_FAILED;
+            for (int idx = 0; cleanup && release && idx < iovcnt; ++idx)
+            {
+                cleanup(iov[idx].iov_base, iov[idx].iov_len, cleanupArg);
+            }
+
+            return errcode;
+        }
+    }
+
+    if (_compressor && header._msgType > VIPER_NET_MESSAGE_PROTOCOL_BASE)
+    {
+        _compressor->CountRaw(payloadSize);
+    }
+
+    FramePayload payload;
+    payload._iov        = iov;
+    payload._iovcnt     = iovcnt;
+    payload._cleanup    = cleanup;
+    payload._cleanupArg = cleanupArg;
+    return WriteFrame(header, payload);
 }
 
-std::error_code TCPConnection::Send(const Message& msg)
+std::error_code TCPConnection::SendV(const Header& header, evbuffer* payload)
 {
-    LOG_DEBUG("send data. size:{}, remote address:{}", msg.GetDataSize(), GetRemoteAddress());
-    int errcode = bufferevent_write(_bev, msg.GetData(), msg.GetDataSize());
-    if (errcode)
+    LOG_DEBUG("send data. size:{}, remote address:{}", evbuffer_get_length(payload), GetRemoteAddress());
+
+    if (ShouldQueue())
     {
-        return error::ErrorCode::NET_SEND_FAILED;
+        auto errcode = AdmitQueued(evbuffer_get_length(payload));
+        if (!error::IsSuccess(errcode))
+        {
+            return errcode;
+        }
+
+        evbuffer* queued = evbuffer_new();
+        evbuffer_add_buffer(queued, payload);
+
+        Outbound()->Push(shared_from_this(), header, queued);
+        return error::ErrorCode::SUCCESS;
     }
-    return error::ErrorCode::SUCCESS;
+
+    return SendBuffer(header, payload);
 }
 
-std::error_code TCPConnection::Send(const MessagePtr msg)
+std::error_code TCPConnection::SendFile(const std::string& path, uint64_t offset, uint64_t length, uint32_t msgType)
 {
-    return Send(*msg);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        LOG_ERROR("failed to open the file to send. path:{}, errno:{}", path, errno);
+        return error::ErrorCode::FILE_EXCEPTION;
+    }
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || offset > (uint64_t)status.st_size)
+    {
+        LOG_ERROR("the offset is outside the file to send. path:{}, offset:{}", path, offset);
+        close(fd);
+        return error::ErrorCode::INVALID_PARAMETER;
+    }
+
+    uint64_t size = 0 == length ? status.st_size - offset : length;
+    if (offset + size > (uint64_t)status.st_size || size + Message::MESSAGE_HEADER_SIZE > Message::MAX_MESSAGE_SIZE)
+    {
+        LOG_ERROR("invalid range of the file to send. path:{}, offset:{}, length:{}, file size:{}", path, offset,
+                  size, status.st_size);
+        close(fd);
+        return error::ErrorCode::INVALID_PARAMETER;
+    }
+
+    // the segment owns the descriptor, it is closed with the last chain referring to it
+    evbuffer_file_segment* segment = evbuffer_file_segment_new(fd, offset, size, EVBUF_FS_CLOSE_ON_FREE);
+    if (!segment)
+    {
+        LOG_ERROR("failed to create the file segment. path:{}", path);
+        close(fd);
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    LOG_DEBUG("send file. path:{}, offset:{}, size:{}, remote address:{}", path, offset, size, GetRemoteAddress());
+
+    Header header;
+    header._version = VIPER_NET_MESSAGE_FLAG_FILE;
+    header._msgType = msgType;
+
+    if (ShouldQueue())
+    {
+        auto errcode = AdmitQueued(size);
+        if (!error::IsSuccess(errcode))
+        {
+            evbuffer_file_segment_free(segment);
+            return errcode;
+        }
+
+        // the queued buffer maps the range, it can not drain to the socket with sendfile
+        evbuffer* payload = evbuffer_new();
+        evbuffer_add_file_segment(payload, segment, 0, size);
+        evbuffer_file_segment_free(segment);
+
+        Outbound()->Push(shared_from_this(), header, payload);
+        return error::ErrorCode::SUCCESS;
+    }
+
+    FramePayload payload;
+    payload._file     = segment;
+    payload._fileSize = size;
+
+    auto errcode = WriteFrame(header, payload);
+    evbuffer_file_segment_free(segment);
+    return errcode;
+}
+
+void TCPConnection::OfferFile(std::shared_ptr<TCPHandlerCallback> callback)
+{
+    const Header* header = _decoder.PendingFile();
+    if (!header || _fileSink >= 0 || State() != ConnectionState::CONNECTED)
+    {
+        return;
+    }
+
+    int sink = callback->OnFileBegin(shared_from_this(), *header);
+    if (sink < 0)
+    {
+        _decoder.DecodeFile();
+    }
+    else
+    {
+        _fileCallback = callback;
+        _fileHeader   = *header;
+        _fileSink     = sink;
+        _fileLeft     = header->_dataSize;
+        _decoder.TakeFile();
+    }
+
+    // the next read lands or decodes the payload, deferred since the loops are in their read callback
+    UpdateReadWatermark();
+    bufferevent_trigger(_bev, EV_READ, BEV_TRIG_IGNORE_WATERMARKS | BEV_TRIG_DEFER_CALLBACKS);
+}
+
+void TCPConnection::AbortFile()
+{
+    if (_fileSink >= 0)
+    {
+        EndFile(error::ErrorCode::NET_DISCONNECTED);
+    }
+}
+
+uint64_t TCPConnection::OpenStream()
+{
+    return _lastStreamID.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+std::error_code TCPConnection::SendChunk(const Header& header, uint64_t streamID, const iovec* iov, int iovcnt,
+                                         bool last, evbuffer_ref_cleanup_cb cleanup, void* cleanupArg)
+{
+    Header chunk    = header;
+    chunk._version  = header._version | VIPER_NET_MESSAGE_FLAG_STREAM;
+    chunk._sequence = streamID;
+    if (last)
+    {
+        chunk._version = chunk._version | VIPER_NET_MESSAGE_FLAG_STREAM_END;
+    }
+
+    return SendV(chunk, iov, iovcnt, cleanup, cleanupArg);
+}
+
+std::error_code TCPConnection::Reply(const Message& request, const char* payload, uint32_t payloadSize)
+{
+    Header header;
+    header._version  = VIPER_NET_MESSAGE_FLAG_RESPONSE;
+    header._msgType  = request.GetHeader()._msgType;
+    header._sequence = request.GetHeader()._sequence;
+
+    iovec iov = {(void*)payload, payloadSize};
+    return SendV(header, &iov, 1);
+}
+
+std::error_code TCPConnection::Reply(const MessagePtr request, const char* payload, uint32_t payloadSize)
+{
+    return Reply(*request, payload, payloadSize);
+}
+
+void TCPConnection::SetCork(bool enable)
+{
+    _corked = enable;
+    if (!_corked)
+    {
+        Flush();
+    }
+}
+
+void TCPConnection::SetBackpressure(const BackpressureConfig& config)
+{
+    _backpressure = config;
+}
+
+void TCPConnection::SetPriority(const PriorityConfig& config)
+{
+    _priority = config;
+}
+
+std::size_t TCPConnection::PendingOutput()
+{
+    std::size_t pending = _corkedOutput ? evbuffer_get_length(_corkedOutput) : 0;
+    if (_pendingOutput)
+    {
+        pending += evbuffer_get_length(_pendingOutput);
+    }
+
+    for (auto& lane : _lanes)
+    {
+        pending += lane._buffer ? evbuffer_get_length(lane._buffer) : 0;
+    }
+
+    if (_bev)
+    {
+        pending += evbuffer_get_length(bufferevent_get_output(_bev));
+    }
+
+    return pending;
+}
+
+bool TCPConnection::Pump()
+{
+    if (_priority._enable)
+    {
+        PumpLanes();
+    }
+    else if (_pendingOutput)
+    {
+        // whole frames only, the socket output is refilled just above the low watermark
+        evbuffer* output = bufferevent_get_output(_bev);
+        while (!_pendingFrames.empty() && evbuffer_get_length(output) <= _backpressure._lowWatermark)
+        {
+            evbuffer_remove_buffer(_pendingOutput, output, _pendingFrames.front());
+            _pendingFrames.pop_front();
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    // published before the flag is read, a sender blocked meanwhile sees the drained output
+    PublishOutput();
+    bool blocked = _outputBlocked || _queueBlocked.load(std::memory_order_seq_cst);
+    if (!blocked || PendingOutput() > _backpressure._lowWatermark)
+    {
+        return false;
+    }
+
+    _outputBlocked = false;
+    _queueBlocked.store(false, std::memory_order_relaxed);
+    return true;
+}
+
+uint64_t TCPConnection::DroppedFrames()
+{
+    return _droppedFrames.load(std::memory_order_relaxed);
+}
+
+void TCPConnection::SetCompressor(CompressorPtr compressor)
+{
+    _compressor = compressor;
+    if (_compressor && !_compressed)
+    {
+        _compressed = evbuffer_new();
+    }
+}
+
+void TCPConnection::SetChecksum(bool enable)
+{
+    _checksum = enable;
+}
+
+void TCPConnection::SetCompactHeader(bool enable)
+{
+    _compactHeader = enable;
+    _decoder.ExpectCompact(enable);
+}
+
+std::error_code TCPConnection::SendHello()
+{
+    Header header;
+    header._msgType = (uint32_t)VIPER_NET_MESSAGE_PROTOCOL_HELLO;
+    if (_compressor)
+    {
+        header._tag      = header._tag | VIPER_NET_MESSAGE_CAPABILITY_ZSTD;
+        header._sequence = _compressor->DictionaryID();
+    }
+
+    if (_checksum)
+    {
+        header._tag = header._tag | VIPER_NET_MESSAGE_CAPABILITY_CRC32C;
+    }
+
+    if (_priority._enable)
+    {
+        header._tag = header._tag | VIPER_NET_MESSAGE_CAPABILITY_FRAGMENT;
+    }
+
+    if (_compactHeader)
+    {
+        header._tag = header._tag | VIPER_NET_MESSAGE_CAPABILITY_COMPACT;
+    }
+
+    // without capabilities the wire stays compatible with peers which predate the hello
+    if (0 == header._tag)
+    {
+        return error::ErrorCode::SUCCESS;
+    }
+
+    return SendV(header, nullptr, 0);
+}
+
+void TCPConnection::OnHello(const Header& header)
+{
+    _peerCompression  = _compressor && (header._tag & VIPER_NET_MESSAGE_CAPABILITY_ZSTD);
+    _peerDictionaryID = header._sequence;
+    _peerChecksum     = header._tag & VIPER_NET_MESSAGE_CAPABILITY_CRC32C;
+    _peerFragments    = header._tag & VIPER_NET_MESSAGE_CAPABILITY_FRAGMENT;
+    _peerCompact      = _compactHeader && (header._tag & VIPER_NET_MESSAGE_CAPABILITY_COMPACT);
+
+    LOG_DEBUG("received hello. capabilities:0x{:08X}, compression:{}, checksum:{}, fragments:{}, compact:{}, connection:{}",
+              header._tag, _peerCompression, _peerChecksum, _peerFragments, _peerCompact, ID());
+}
+
+bool TCPConnection::IsCompressing()
+{
+    return _peerCompression;
+}
+
+void TCPConnection::FlushCallback(evutil_socket_t fd, short events, void* ctx)
+{
+    auto conn = static_cast<TCPConnection*>(ctx);
+    conn->Flush();
+}
+
+void TCPConnection::SpliceCallback(evutil_socket_t fd, short events, void* ctx)
+{
+    auto conn = static_cast<TCPConnection*>(ctx);
+    conn->Splice();
+}
+
+void TCPConnection::UpdateReadWatermark()
+{
+    // do not wake up before the pending frame can be completed, a file takes any byte
+    std::size_t needed = _fileSink >= 0 ? 1 : _decoder.Needed();
+    if (needed == _readLowWatermark)
+    {
+        return;
+    }
+
+    // a frame larger than the high watermark must still fit into the input buffer
+    std::size_t high = std::max<std::size_t>(VIPER_NET_TCP_CONNECTION_READ_HIGH_WATERMARK, needed);
+    bufferevent_setwatermark(_bev, EV_READ, needed, high);
+    _readLowWatermark = needed;
+}
+
+evbuffer* TCPConnection::OutputBuffer()
+{
+    // keep the frame order once frames are waiting behind a full socket output
+    if (_pendingOutput && (!_pendingFrames.empty() ||
+                           evbuffer_get_length(bufferevent_get_output(_bev)) > _backpressure._lowWatermark))
+    {
+        return _pendingOutput;
+    }
+
+    if (!_corked)
+    {
+        return bufferevent_get_output(_bev);
+    }
+
+    if (!_corkedOutput)
+    {
+        _corkedOutput = evbuffer_new();
+    }
+
+    ScheduleFlush();
+    return _corkedOutput;
+}
+
+void TCPConnection::ScheduleFlush()
+{
+    if (!_flushEvent)
+    {
+        // run after the other callbacks of the loop iteration
+        auto base   = bufferevent_get_base(_bev);
+        _flushEvent = event_new(base, -1, 0, &TCPConnection::FlushCallback, this);
+        if (event_base_get_npriorities(base) > 1)
+        {
+            event_priority_set(_flushEvent, event_base_get_npriorities(base) - 1);
+        }
+    }
+
+    if (!_flushScheduled)
+    {
+        event_active(_flushEvent, EV_WRITE, 0);
+        _flushScheduled = true;
+    }
+}
+
+void TCPConnection::Flush()
+{
+    _flushScheduled = false;
+
+    // corked frames wait in their lanes, the flush pumps them
+    if (_priority._enable)
+    {
+        PumpLanes();
+        return;
+    }
+
+    if (!_corkedOutput || 0 == evbuffer_get_length(_corkedOutput))
+    {
+        return;
+    }
+
+    // moves the staged segments, the payload bytes are not copied
+    evbuffer_add_buffer(bufferevent_get_output(_bev), _corkedOutput);
+}
+
+std::error_code TCPConnection::Admit(std::size_t frameSize)
+{
+    if (0 == _backpressure._highWatermark || PendingOutput() + frameSize <= _backpressure._highWatermark)
+    {
+        return error::ErrorCode::SUCCESS;
+    }
+
+    switch (_backpressure._policy)
+    {
+    case BackpressurePolicy::DROP_OLDEST:
+        DropOldest(frameSize);
+        return error::ErrorCode::SUCCESS;
+
+    case BackpressurePolicy::DISCONNECT:
+        Overflow();
+        return error::ErrorCode::NET_DISCONNECTED;
+
+    default:
+        _outputBlocked = true;
+        return error::ErrorCode::NET_WOULD_BLOCK;
+    }
+}
+
+std::error_code TCPConnection::AdmitQueued(std::size_t payloadSize)
+{
+    auto state = State();
+    if (state != ConnectionState::CONNECTED && state != ConnectionState::CONNECTING)
+    {
+        return error::ErrorCode::NET_DISCONNECTED;
+    }
+
+    // Reserved before it is checked so concurrent senders can not overshoot
+    // together, the queue releases it once the loop took the frame. The size
+    // is the one OutboundQueue::Push charges, the raw frame.
+    std::size_t frameSize = Message::MESSAGE_HEADER_SIZE + payloadSize;
+    std::size_t queued    = _queuedBytes.fetch_add(frameSize, std::memory_order_seq_cst) + frameSize;
+    if (0 == _backpressure._highWatermark)
+    {
+        return error::ErrorCode::SUCCESS;
+    }
+
+    // the queued frames can not be dropped, so DROP_OLDEST bounds them alone
+    bool dropOldest = _backpressure._policy == BackpressurePolicy::DROP_OLDEST;
+    auto fits       = [&](std::size_t bytes) {
+        std::size_t output = dropOldest ? 0 : _outputBytes.load(std::memory_order_seq_cst);
+        return bytes + output <= _backpressure._highWatermark;
+    };
+
+    if (fits(queued))
+    {
+        return error::ErrorCode::SUCCESS;
+    }
+
+    if (_backpressure._policy == BackpressurePolicy::DISCONNECT)
+    {
+        _queuedBytes.fetch_sub(frameSize, std::memory_order_seq_cst);
+        if (!_queueOverflowed.exchange(true, std::memory_order_seq_cst))
+        {
+            Outbound()->Push(shared_from_this(), Header(), nullptr);
+        }
+        return error::ErrorCode::NET_DISCONNECTED;
+    }
+
+    // Flagged before the output is checked again: either the write callback
+    // sees the flag and reports OnWritable, or this check sees the output it
+    // published and the frame is admitted after all.
+    _queueBlocked.store(true, std::memory_order_seq_cst);
+    if (fits(_queuedBytes.load(std::memory_order_seq_cst)))
+    {
+        return error::ErrorCode::SUCCESS;
+    }
+
+    _queuedBytes.fetch_sub(frameSize, std::memory_order_seq_cst);
+    return error::ErrorCode::NET_WOULD_BLOCK;
+}
+
+void TCPConnection::Overflow()
+{
+    // The connection is closed by the event callback like a dropped one, which
+    // runs OnDisconnection and fails the calls and streams. It is deferred since
+    // the sender may be inside a callback of this connection.
+    if (_overflowed)
+    {
+        return;
+    }
+
+    LOG_WARN("output exceeds the high watermark, disconnect. pending:{}, connection:{}", PendingOutput(), ID());
+    _overflowed = true;
+    bufferevent_disable(_bev, EV_READ | EV_WRITE);
+    bufferevent_trigger_event(_bev, BEV_EVENT_WRITING | BEV_EVENT_ERROR, BEV_TRIG_DEFER_CALLBACKS);
+}
+
+void TCPConnection::PublishOutput()
+{
+    if (_backpressure._highWatermark > 0 && _outbound.load(std::memory_order_relaxed))
+    {
+        _outputBytes.store(PendingOutput(), std::memory_order_seq_cst);
+    }
+}
+
+void TCPConnection::TrackFrame(evbuffer* output, std::size_t frameSize)
+{
+    if (output == _pendingOutput)
+    {
+        _pendingFrames.push_back(frameSize);
+    }
+}
+
+void TCPConnection::DropOldest(std::size_t frameSize)
+{
+    // the bulk frames go first, the control frames are never dropped
+    if (_priority._enable)
+    {
+        DropLane(_lanes[(int)FramePriority::BULK], frameSize);
+        DropLane(_lanes[(int)FramePriority::INTERACTIVE], frameSize);
+    }
+
+    // only the pending frames are dropped, the socket output may be partially written
+    while (!_pendingFrames.empty() && PendingOutput() + frameSize > _backpressure._highWatermark)
+    {
+        evbuffer_drain(_pendingOutput, _pendingFrames.front());
+        _pendingFrames.pop_front();
+        ++_droppedFrames;
+    }
+
+    LOG_DEBUG("dropped the oldest frames. dropped:{}, pending:{}, connection:{}", DroppedFrames(), PendingOutput(), ID());
+}
+
+void TCPConnection::DropLane(Lane& lane, std::size_t frameSize)
+{
+    // a frame partially sent in fragments must be completed, it is set aside meanwhile
+    bool        started = &lane == &_lanes[(int)FramePriority::BULK] && _fragmentLeft > 0;
+    std::size_t first   = started ? 1 : 0;
+    std::size_t pending = PendingOutput();
+    evbuffer*   head    = nullptr;
+    while (lane._frames.size() > first && pending + frameSize > _backpressure._highWatermark)
+    {
+        if (started && !head)
+        {
+            head = evbuffer_new();
+            evbuffer_remove_buffer(lane._buffer, head, lane._frames.front());
+        }
+
+        evbuffer_drain(lane._buffer, lane._frames[first]);
+        pending -= lane._frames[first];
+        lane._frames.erase(lane._frames.begin() + first);
+        ++_droppedFrames;
+    }
+
+    if (head)
+    {
+        evbuffer_prepend_buffer(lane._buffer, head);
+        evbuffer_free(head);
+    }
+}
+
+FramePriority TCPConnection::Classify(const Header& header)
+{
+    if (header._msgType <= VIPER_NET_MESSAGE_PROTOCOL_BASE)
+    {
+        return FramePriority::CONTROL;
+    }
+
+    // a stream is a large message whatever the size of its chunks
+    if (header._version & (VIPER_NET_MESSAGE_FLAG_STREAM | VIPER_NET_MESSAGE_FLAG_FILE))
+    {
+        return FramePriority::BULK;
+    }
+
+    return header._dataSize > _priority._bulkThreshold ? FramePriority::BULK : FramePriority::INTERACTIVE;
+}
+
+void TCPConnection::PumpLanes()
+{
+    evbuffer* output = bufferevent_get_output(_bev);
+    while (evbuffer_get_length(output) < _priority._chunkSize)
+    {
+        // the highest lane with frames, a fragmented frame lets the others pass between its fragments
+        auto lane = std::find_if(_lanes.begin(), _lanes.end(), [](const Lane& candidate) {
+            return !candidate._frames.empty();
+        });
+        if (lane == _lanes.end())
+        {
+            return;
+        }
+
+        // without fragments from the peer a bulk frame is written whole, and so is a file the peer may land
+        bool bulk  = lane == _lanes.begin() + (int)FramePriority::BULK;
+        bool large = lane->_frames.front() > _priority._chunkSize + Message::MESSAGE_HEADER_SIZE;
+        if (bulk && _peerFragments && (_fragmentLeft > 0 || (large && !IsFileFrame(*lane))))
+        {
+            WriteFragment(*lane, output);
+            continue;
+        }
+
+        evbuffer_remove_buffer(lane->_buffer, output, lane->_frames.front());
+        lane->_frames.pop_front();
+    }
+}
+
+bool TCPConnection::IsFileFrame(Lane& lane)
+{
+    Header      header;
+    std::size_t headerSize = 0;
+    PeekHeader(lane._buffer, header, headerSize);
+    return header._version & VIPER_NET_MESSAGE_FLAG_FILE;
+}
+
+void TCPConnection::WriteFragment(Lane& lane, evbuffer* output)
+{
+    // the header of the frame is taken off once, every fragment carries a copy
+    if (0 == _fragmentLeft)
+    {
+        std::size_t headerSize = 0;
+        PeekHeader(lane._buffer, _fragmentHeader, headerSize);
+        evbuffer_drain(lane._buffer, headerSize);
+        _fragmentLeft         = _fragmentHeader._dataSize;
+        lane._frames.front() -= headerSize;
+    }
+
+    // the CRC32C trailer is part of the payload, it is checked on the reassembled frame
+    std::size_t size   = std::min(_fragmentLeft, _priority._chunkSize);
+    Header      header = _fragmentHeader;
+    header._version    = header._version | VIPER_NET_MESSAGE_FLAG_FRAGMENT;
+    if (size == _fragmentLeft)
+    {
+        header._version = header._version | VIPER_NET_MESSAGE_FLAG_LAST_FRAGMENT;
+    }
+
+    header._dataSize = size;
+
+    uint8_t wire[Message::MESSAGE_COMPACT_HEADER_MAX_SIZE];
+    evbuffer_add(output, wire, EncodeHeader(header, _peerCompact, wire));
+    evbuffer_remove_buffer(lane._buffer, output, size);
+
+    _fragmentLeft        -= size;
+    lane._frames.front() -= size;
+    if (0 == _fragmentLeft)
+    {
+        lane._frames.pop_front();
+    }
+}
+
+bool TCPConnection::ShouldCompress(const Header& header, std::size_t payloadSize)
+{
+    // the core messages stay raw, they are exchanged before the negotiation, and files may be landed as they are
+    // payloads above the decompression limit of the peer are sent raw
+    const auto& config = _compressor->Config();
+    return _peerCompression && header._msgType > VIPER_NET_MESSAGE_PROTOCOL_BASE &&
+           !(header._version & VIPER_NET_MESSAGE_FLAG_FILE) && payloadSize >= config._threshold &&
+           payloadSize <= config._maxDecompressedSize;
+}
+
+bool TCPConnection::CanSplice()
+{
+    // TLS, io_uring and shared memory connections do not receive the bytes as they are on the socket
+    return !bufferevent_get_underlying(_bev) && !bufferevent_openssl_get_ssl(_bev) &&
+           !bufferevent_pair_get_partner(_bev) && !ShmBackend::Owns(_bev) && bufferevent_getfd(_bev) >= 0;
+}
+
+std::error_code TCPConnection::LandFile(evbuffer* input)
+{
+    // the bytes read along with the header come from the input buffer
+    while (_fileLeft > 0 && evbuffer_get_length(input) > 0)
+    {
+        uint64_t size    = std::min<uint64_t>(_fileLeft, evbuffer_get_length(input));
+        int      written = evbuffer_write_atmost(input, _fileSink, size);
+        if (written <= 0)
+        {
+            LOG_WARN("failed to write the received file. errno:{}, connection:{}", errno, ID());
+            EndFile(error::ErrorCode::FILE_EXCEPTION);
+            return error::ErrorCode::FILE_EXCEPTION;
+        }
+
+        _fileLeft -= written;
+    }
+
+    if (0 == _fileLeft)
+    {
+        EndFile(error::ErrorCode::SUCCESS);
+        return error::ErrorCode::SUCCESS;
+    }
+
+    // the rest bypasses user space on a plain socket
+    if (!_splicing && CanSplice())
+    {
+        StartSplice();
+    }
+
+    return error::ErrorCode::SUCCESS;
+}
+
+std::error_code TCPConnection::StartSplice()
+{
+    if (_pipe[0] < 0)
+    {
+        if (pipe2(_pipe, O_NONBLOCK | O_CLOEXEC) != 0)
+        {
+            LOG_WARN("failed to create the splice pipe, the file is written from the input. errno:{}, connection:{}",
+                     errno, ID());
+            return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+        }
+
+        fcntl(_pipe[1], F_SETPIPE_SZ, VIPER_NET_TCP_CONNECTION_SPLICE_PIPE_SIZE);
+    }
+
+    if (!_spliceEvent)
+    {
+        _spliceEvent = event_new(bufferevent_get_base(_bev), bufferevent_getfd(_bev), EV_READ | EV_PERSIST,
+                                 &TCPConnection::SpliceCallback, this);
+    }
+
+    // the bufferevent must not read the socket meanwhile
+    bufferevent_disable(_bev, EV_READ);
+    event_add(_spliceEvent, nullptr);
+    _splicing = true;
+    return error::ErrorCode::SUCCESS;
+}
+
+void TCPConnection::Splice()
+{
+    evutil_socket_t fd = bufferevent_getfd(_bev);
+    while (_fileLeft > 0)
+    {
+        std::size_t size  = std::min<uint64_t>(_fileLeft, VIPER_NET_TCP_CONNECTION_SPLICE_PIPE_SIZE);
+        ssize_t     moved = splice(fd, nullptr, _pipe[1], nullptr, size, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (moved < 0 && (EAGAIN == errno || EINTR == errno))
+        {
+            break;
+        }
+
+        // the connection is closed through its event callback, deferred since the callback may free it
+        if (moved <= 0)
+        {
+            LOG_DEBUG("connection dropped while receiving a file. errno:{}, connection:{}", errno, ID());
+            EndFile(error::ErrorCode::NET_DISCONNECTED);
+            bufferevent_trigger_event(_bev, BEV_EVENT_READING | (0 == moved ? BEV_EVENT_EOF : BEV_EVENT_ERROR),
+                                      BEV_TRIG_DEFER_CALLBACKS);
+            return;
+        }
+
+        // the pipe is emptied into the file before more is taken from the socket
+        for (ssize_t left = moved; left > 0;)
+        {
+            ssize_t written = splice(_pipe[0], nullptr, _fileSink, nullptr, left, SPLICE_F_MOVE);
+            if (written <= 0)
+            {
+                // the rest of the payload can not be skipped reliably, the stream is lost
+                LOG_WARN("failed to splice the received file. errno:{}, connection:{}", errno, ID());
+                EndFile(error::ErrorCode::FILE_EXCEPTION);
+                bufferevent_trigger_event(_bev, BEV_EVENT_READING | BEV_EVENT_ERROR, BEV_TRIG_DEFER_CALLBACKS);
+                return;
+            }
+
+            left -= written;
+        }
+
+        _fileLeft  -= moved;
+        _readBytes += moved;
+    }
+
+    if (0 == _fileLeft)
+    {
+        EndFile(error::ErrorCode::SUCCESS);
+    }
+
+    // the read callback refreshes the idle timer and decodes what follows the file
+    bufferevent_trigger(_bev, EV_READ, BEV_TRIG_IGNORE_WATERMARKS | BEV_TRIG_DEFER_CALLBACKS);
+}
+
+void TCPConnection::EndFile(std::error_code errcode)
+{
+    if (_splicing)
+    {
+        event_del(_spliceEvent);
+        _splicing = false;
+        if (error::IsSuccess(errcode))
+        {
+            bufferevent_enable(_bev, EV_READ);
+        }
+    }
+
+    // reset before the callback, which may close the connection
+    auto   callback = std::move(_fileCallback);
+    Header header   = _fileHeader;
+    _fileCallback   = nullptr;
+    _fileSink       = -1;
+    _fileLeft       = 0;
+
+    LOG_DEBUG("file received. size:{}, errcode:{}, connection:{}", header._dataSize, errcode.value(), ID());
+    callback->OnFileEnd(shared_from_this(), header, errcode);
+}
+
+std::error_code TCPConnection::SendBuffer(const Header& header, evbuffer* buffer)
+{
+    std::size_t payloadSize = evbuffer_get_length(buffer);
+    if (ShouldCompress(header, payloadSize))
+    {
+        int count = evbuffer_peek(buffer, -1, nullptr, nullptr, 0);
+
+        std::vector<evbuffer_iovec> chunks(count);
+        evbuffer_peek(buffer, -1, nullptr, chunks.data(), count);
+
+        std::vector<iovec> iov;
+        for (auto& chunk : chunks)
+        {
+            iov.push_back({chunk.iov_base, chunk.iov_len});
+        }
+
+        auto errcode = SendCompressed(header, iov.data(), iov.size());
+        if (errcode != error::ErrorCode::NET_COMPRESS_FAILED)
+        {
+            return errcode;
+        }
+    }
+
+    if (_compressor && header._msgType > VIPER_NET_MESSAGE_PROTOCOL_BASE)
+    {
+        _compressor->CountRaw(payloadSize);
+    }
+
+    FramePayload payload;
+    payload._buffer     = buffer;
+    payload._moveBuffer = true;
+    return WriteFrame(header, payload);
+}
+
+std::error_code TCPConnection::SendCompressed(const Header& header, const iovec* iov, int iovcnt)
+{
+    auto errcode = _compressor->Compress(iov, iovcnt, _peerDictionaryID, _compressed);
+    if (!error::IsSuccess(errcode))
+    {
+        return errcode;
+    }
+
+    Header compressedHeader   = header;
+    compressedHeader._version = header._version | VIPER_NET_MESSAGE_FLAG_COMPRESSED;
+
+    FramePayload payload;
+    payload._buffer     = _compressed;
+    payload._moveBuffer = true;
+
+    // the compressed payload is left behind when the frame was not admitted
+    errcode = WriteFrame(compressedHeader, payload);
+    evbuffer_drain(_compressed, evbuffer_get_length(_compressed));
+    return errcode;
+}
+
+std::error_code TCPConnection::WriteFrame(Header header, const FramePayload& payload)
+{
+    std::vector<evbuffer_iovec> chunks;
+    if (payload._buffer)
+    {
+        int count = evbuffer_peek(payload._buffer, -1, nullptr, nullptr, 0);
+        chunks.resize(count);
+        evbuffer_peek(payload._buffer, -1, nullptr, chunks.data(), count);
+    }
+    else
+    {
+        for (int idx = 0; idx < payload._iovcnt; ++idx)
+        {
+            chunks.push_back({payload._iov[idx].iov_base, payload._iov[idx].iov_len});
+        }
+    }
+
+    header._dataSize = payload._fileSize;
+    for (auto& chunk : chunks)
+    {
+        header._dataSize += chunk.iov_len;
+    }
+
+    // a file is not read to be checksummed
+    bool withChecksum = _peerChecksum && !(header._version & VIPER_NET_MESSAGE_FLAG_FILE);
+    if (withChecksum)
+    {
+        header._version  = header._version | VIPER_NET_MESSAGE_FLAG_CRC32C;
+        header._dataSize = header._dataSize + Message::MESSAGE_CHECKSUM_SIZE;
+    }
+
+    uint8_t     wire[Message::MESSAGE_COMPACT_HEADER_MAX_SIZE];
+    std::size_t headerSize = EncodeHeader(header, _peerCompact, wire);
+    std::size_t frameSize  = headerSize + header._dataSize;
+
+    auto errcode = Admit(frameSize);
+    if (!error::IsSuccess(errcode))
+    {
+        return errcode;
+    }
+
+    Lane*     lane   = _priority._enable ? &_lanes[(int)Classify(header)] : nullptr;
+    evbuffer* output = lane ? lane->_buffer : OutputBuffer();
+
+    // A part which fails must not leave the ones before it in the stream, the peer
+    // would take the next frame for the rest of this one. A frame of copied bytes
+    // is written in place after its space was reserved, nothing can fail then;
+    // any other one is assembled aside and moved over whole.
+    bool inPlace = !payload._buffer && !payload._file && !payload._cleanup;
+    if (!inPlace && !_frame)
+    {
+        _frame = evbuffer_new();
+    }
+
+    evbuffer* frame = inPlace ? output : _frame;
+    if ((inPlace && evbuffer_expand(output, frameSize)) || evbuffer_add(frame, wire, headerSize))
+    {
+        return DiscardFrame(payload, chunks, 0);
+    }
+
+    // the checksum is taken before the chunks are handed over, they may be moved;
+    // it covers the full form of the header whichever form is sent
+    uint32_t checksum = 0;
+    if (withChecksum)
+    {
+        Header netHeader = header;
+        Hton(netHeader);
+
+        checksum = assist::CRC32C(&netHeader, Message::MESSAGE_HEADER_SIZE);
+        for (auto& chunk : chunks)
+        {
+            checksum = assist::CRC32C(chunk.iov_base, chunk.iov_len, checksum);
+        }
+    }
+
+    int         added = 0;
+    std::size_t idx   = 0;
+    if (payload._file)
+    {
+        // the segment is sent with sendfile only from a buffer marked to drain to the socket
+        if (output == bufferevent_get_output(_bev) && CanSplice())
+        {
+            evbuffer_set_flags(frame, EVBUFFER_FLAG_DRAINS_TO_FD);
+        }
+
+        added = evbuffer_add_file_segment(frame, payload._file, 0, payload._fileSize);
+        evbuffer_clear_flags(frame, EVBUFFER_FLAG_DRAINS_TO_FD);
+    }
+    else if (payload._buffer && payload._moveBuffer)
+    {
+        added = evbuffer_add_buffer(frame, payload._buffer);
+    }
+    else if (payload._buffer)
+    {
+        // A chain holding multicast segments, those shared from another buffer
+        // already, or file segments can not be shared and is copied instead.
+        if (evbuffer_add_buffer_reference(frame, payload._buffer) != 0)
+        {
+            for (; added == 0 && idx < chunks.size(); ++idx)
+            {
+                added = evbuffer_add(frame, chunks[idx].iov_base, chunks[idx].iov_len);
+            }
+        }
+    }
+    else
+    {
+        for (; idx < chunks.size(); ++idx)
+        {
+            if (payload._cleanup)
+            {
+                added = evbuffer_add_reference(frame, chunks[idx].iov_base, chunks[idx].iov_len,
+                                               payload._cleanup, payload._cleanupArg);
+            }
+            else
+            {
+                added = evbuffer_add(frame, chunks[idx].iov_base, chunks[idx].iov_len);
+            }
+
+            // a chunk whose reference failed was not taken, the cleanup still owes it
+            if (added)
+            {
+                break;
+            }
+        }
+    }
+
+    if (added)
+    {
+        return DiscardFrame(payload, chunks, idx);
+    }
+
+    if (withChecksum)
+    {
+        uint32_t trailer = htonl(checksum);
+        if (evbuffer_add(frame, &trailer, Message::MESSAGE_CHECKSUM_SIZE))
+        {
+            return DiscardFrame(payload, chunks, chunks.size());
+        }
+    }
+
+    if (!inPlace && evbuffer_add_buffer(output, frame))
+    {
+        return DiscardFrame(payload, chunks, chunks.size());
+    }
+
+    _writeBytes += frameSize;
+    PublishOutput();
+    if (!lane)
+    {
+        TrackFrame(output, frameSize);
+        return error::ErrorCode::SUCCESS;
+    }
+
+    lane->_frames.push_back(frameSize);
+    if (_corked)
+    {
+        ScheduleFlush();
+    }
+    else
+    {
+        PumpLanes();
+    }
+
+    return error::ErrorCode::SUCCESS;
+}
+
+std::error_code TCPConnection::DiscardFrame(const FramePayload& payload, const std::vector<evbuffer_iovec>& chunks,
+                                            std::size_t taken)
+{
+    LOG_WARN("failed to append a frame to the output. connection:{}", ID());
+
+    // releases the chunks referenced so far, the ones not taken yet are released here
+    if (_frame)
+    {
+        evbuffer_drain(_frame, evbuffer_get_length(_frame));
+    }
+
+    for (std::size_t idx = taken; payload._cleanup && idx < chunks.size(); ++idx)
+    {
+        payload._cleanup(chunks[idx].iov_base, chunks[idx].iov_len, payload._cleanupArg);
+    }
+
+    return error::ErrorCode::NET_SEND_FAILED;
 }
 
 void TCPConnection::BuildID()
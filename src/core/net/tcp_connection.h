@@ -17,18 +17,33 @@
 #ifndef _VIPER_CORE_NET_TCP_CONNECTION_H_
 #define _VIPER_CORE_NET_TCP_CONNECTION_H_
 
+#include "core/container/slot_map.h"
+#include "core/net/compression.h"
+#include "core/net/frame_decoder.h"
 #include "core/net/message.h"
+#include "core/net/message_pool.h"
+#include "core/net/outbound_queue.h"
+#include "core/net/rtt_estimator.h"
+#include "core/net/timing_wheel.h"
 
 #include <event2/buffer.h>
 #include <event2/bufferevent.h>
 #include <event2/event.h>
 #include <event2/util.h>
 
+#include <sys/uio.h>
+
+#include <array>
 #include <atomic>
+#include <cstddef>
 #include <cstdint>
+#include <deque>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <system_error>
+#include <unordered_set>
+#include <vector>
 
 namespace viper {
 namespace net {
@@ -37,9 +52,18 @@ namespace net {
 
 #define VIPER_NET_TCP_CONNECTION_TIMEOUT_SECOND_DFT           6
 #define VIPER_NET_TCP_CONNECTION_KEEPALIVE_TIMEOUT_SECOND_DFT 3
+#define VIPER_NET_TCP_CONNECTION_RTT_REFRESH_SECOND_DFT       30 // a busy connection still pings this often
+#define VIPER_NET_TCP_CONNECTION_DEAD_PEER_RTT_TIMEOUTS       4  // the unanswered ping timeouts before a peer is lost
+#define VIPER_NET_TCP_CONNECTION_READ_HIGH_WATERMARK          (10 * 1024 * 1024)
+#define VIPER_NET_TCP_CONNECTION_PRIORITY_CHUNK_SIZE_DFT      (64 * 1024) // the output refilled per write and the bulk fragment size
+#define VIPER_NET_TCP_CONNECTION_SPLICE_PIPE_SIZE             (1024 * 1024) // the bytes moved per splice from the socket
+
+#define VIPER_NET_EVENT_PRIORITY_COUNT                        3
 
 // clang-format on
 
+class TCPHandlerCallback;
+
 enum class ConnectionState : int
 {
     CONNECTING,
@@ -50,39 +74,518 @@ enum class ConnectionState : int
     UNKNOWN,
 };
 
+enum class BackpressurePolicy : int
+{
+    REJECT,      // Send returns NET_WOULD_BLOCK, OnWritable is called once the output drained
+    DROP_OLDEST, // the oldest queued frames which were not started yet are dropped
+    DISCONNECT,  // the connection is closed
+};
+
+enum class FramePriority : int
+{
+    CONTROL,     // the core messages, keepalive and hello
+    INTERACTIVE, // payloads up to the bulk threshold
+    BULK,        // larger payloads, fragmented when the peer supports it
+};
+
+// the key of a connection in the handler it belongs to
+using ConnectionHandle = container::SlotHandle;
+
+struct BackpressureConfig
+{
+    BackpressurePolicy _policy        = BackpressurePolicy::REJECT;
+    std::size_t        _lowWatermark  = 0;
+    std::size_t        _highWatermark = 0; // 0 means the output is unbounded
+};
+
+struct PriorityConfig
+{
+    bool        _enable        = false;
+    std::size_t _chunkSize     = VIPER_NET_TCP_CONNECTION_PRIORITY_CHUNK_SIZE_DFT;
+    std::size_t _bulkThreshold = VIPER_NET_TCP_CONNECTION_PRIORITY_CHUNK_SIZE_DFT;
+};
+
 class TCPConnection final : public std::enable_shared_from_this<TCPConnection>
 {
+    friend class OutboundQueue;
+
 public:
     TCPConnection(evutil_socket_t fd, sockaddr* address, int socklen);
     ~TCPConnection();
 
 public:
+    /**
+     * @brief ID the debug name of the connection, formatted from the remote address
+     *        the first time it is asked for
+     *
+     * @return const std::string&
+     */
     const std::string& ID();
+
+    /**
+     * @brief Handle the key of the connection in its handler, looked up with
+     *        TCPHandler::FindConnection. It changes when the connection migrates.
+     *
+     * @return ConnectionHandle
+     */
+    ConnectionHandle Handle();
+    void             BindHandle(ConnectionHandle handle);
+
     void               UpdateState(ConnectionState state);
-    bool               IsTimeout(int timeoutSec);
     ConnectionState    State();
     void               BindHandler(bufferevent* bev, void* handler);
     void*              GetHandler();
+
+    /**
+     * @brief BindOutbound the queue of the loop this connection belongs to. Send,
+     *        SendV and Reply called on any other thread push the frame to it and
+     *        return right away. The high watermark bounds the queued frames plus
+     *        the output as of the last write callback: past it REJECT returns
+     *        NET_WOULD_BLOCK and reports OnWritable later, DISCONNECT returns
+     *        NET_DISCONNECTED and closes the connection on the loop, and
+     *        DROP_OLDEST, which can not drop what is still queued, returns
+     *        NET_WOULD_BLOCK once the queued frames alone reach it. A queued frame
+     *        which fails on the loop anyway is counted in DroppedFrames. Frames of
+     *        one thread keep their order. Chunks passed to SendV with a cleanup
+     *        are released on the loop thread.
+     *
+     * @param queue the queue of the loop
+     */
+    void           BindOutbound(OutboundQueue* queue);
+    OutboundQueue* Outbound();
+    bufferevent*       GetBufferEvent();
     std::string        GetRemoteAddress();
-    std::error_code    Read(MessagePtr msg);
+    std::error_code    Read(MessagePool* pool, std::vector<MessagePtr>& msgs);
     std::error_code    Send(const Message& msg);
     std::error_code    Send(const MessagePtr msg);
 
+    /**
+     * @brief SendV send a frame whose payload is scattered over several chunks.
+     *        The header and every chunk are appended to the output as separate
+     *        evbuffer segments. With a cleanup callback the chunks are referenced,
+     *        not copied, and cleanup is called once per chunk after it is sent;
+     *        without one the chunks are copied. On NET_SEND_FAILED nothing of the
+     *        frame was sent and cleanup was called for every chunk already, on any
+     *        other error, e.g. NET_WOULD_BLOCK, the chunks stay with the caller.
+     *
+     * @param header the frame header in host byte order, _dataSize is filled in
+     * @param iov the payload chunks
+     * @param iovcnt the chunk count
+     * @param cleanup called with (data, len, cleanupArg) when a chunk is released
+     * @param cleanupArg the cleanup argument
+     * @return std::error_code
+     */
+    std::error_code SendV(const Header& header, const iovec* iov, int iovcnt,
+                          evbuffer_ref_cleanup_cb cleanup = nullptr, void* cleanupArg = nullptr);
+
+    /**
+     * @brief SendV send a frame whose payload the caller built in an evbuffer, for
+     *        a payload serialized in place. The segments are moved to the output,
+     *        or to the queue of the loop, without a copy.
+     *
+     * @param header the frame header in host byte order, _dataSize is filled in
+     * @param payload the payload, left empty when the frame was taken
+     * @return std::error_code
+     */
+    std::error_code SendV(const Header& header, evbuffer* payload);
+
+    /**
+     * @brief SendFile send a byte range of a file as the payload of one frame. On a
+     *        plain socket with nothing staged before it the bytes go from the page
+     *        cache to the socket with sendfile; behind the cork, queued frames or a
+     *        priority lane, and on the TLS, io_uring and shared memory backends, the
+     *        file is mapped instead, it is never read into a buffer. The frame is
+     *        flagged with VIPER_NET_MESSAGE_FLAG_FILE and is neither compressed nor
+     *        fragmented, and has no CRC32C trailer since that would need the bytes.
+     *
+     * @param path the file
+     * @param offset the first byte of the range
+     * @param length the byte count, 0 for the rest of the file
+     * @param msgType the message type of the frame
+     * @return std::error_code FILE_EXCEPTION when the file can not be opened,
+     *         INVALID_PARAMETER when the range is outside the file or the frame
+     *         would exceed MAX_MESSAGE_SIZE
+     */
+    std::error_code SendFile(const std::string& path, uint64_t offset, uint64_t length, uint32_t msgType);
+
+    /**
+     * @brief OfferFile hand a received file frame to OnFileBegin of the callback, a
+     *        descriptor it returns gets the payload: spliced from the socket on a
+     *        plain connection, written from the input buffer otherwise. Reading
+     *        resumes after OnFileEnd. Without a descriptor the frame is delivered
+     *        like any other. Called by the loops once the frames before it were
+     *        handled, nothing happens when the decoder did not stop at one.
+     *
+     * @param callback the callback of the handler or client
+     */
+    void OfferFile(std::shared_ptr<TCPHandlerCallback> callback);
+
+    /**
+     * @brief AbortFile end a file being received with NET_DISCONNECTED, called when
+     *        the connection closes
+     */
+    void AbortFile();
+
+    /**
+     * @brief OpenStream a new stream id for SendChunk, unique among the streams this
+     *        side opens on the connection
+     *
+     * @return uint64_t
+     */
+    uint64_t OpenStream();
+
+    /**
+     * @brief SendChunk send one chunk of a stream. A message too large to be held
+     *        at once is sent as a stream of chunks, the peer gets OnStreamBegin with
+     *        the first one, OnChunk with each and OnStreamEnd after the last, so
+     *        neither side holds more than the chunks in flight. The chunks of one
+     *        stream keep their order when they are sent from one thread, with a
+     *        backpressure policy the sender waits for OnWritable between them.
+     *
+     * @param header the _msgType and _tag of the stream in host byte order
+     * @param streamID the id from OpenStream, it is sent in _sequence
+     * @param iov the chunk payload
+     * @param iovcnt the payload chunk count
+     * @param last the chunk ends the stream
+     * @param cleanup see SendV
+     * @param cleanupArg see SendV
+     * @return std::error_code
+     */
+    std::error_code SendChunk(const Header& header, uint64_t streamID, const iovec* iov, int iovcnt, bool last,
+                              evbuffer_ref_cleanup_cb cleanup = nullptr, void* cleanupArg = nullptr);
+
+    /**
+     * @brief Reply answer a request sent with TCPClient::Call. The response carries
+     *        the message type and the sequence of the request.
+     *
+     * @param request the received request
+     * @param payload the response payload
+     * @param payloadSize the response payload size
+     * @return std::error_code
+     */
+    std::error_code Reply(const Message& request, const char* payload, uint32_t payloadSize);
+    std::error_code Reply(const MessagePtr request, const char* payload, uint32_t payloadSize);
+
+    /**
+     * @brief SetCork when enabled, everything sent during one event loop iteration
+     *        is staged and handed to the socket in a single flush at the end of
+     *        the iteration. Disabling the cork flushes immediately.
+     *
+     * @param enable
+     */
+    void SetCork(bool enable);
+
+    /**
+     * @brief SetBackpressure bound the bytes queued for the peer. Once the socket
+     *        output holds more than the low watermark, further frames wait in a
+     *        pending queue which is pumped by the write callback; a send which would
+     *        push the queued bytes above the high watermark is handled by the policy.
+     *        Must be called before BindHandler.
+     *
+     * @param config the watermarks and the policy
+     */
+    void SetBackpressure(const BackpressureConfig& config);
+
+    /**
+     * @brief SetPriority queue the frames in one lane per FramePriority. The socket
+     *        output is refilled up to one chunk at a time from the highest lane which
+     *        has frames, so a ping or a small reply waits for at most one chunk of a
+     *        large payload. Bulk frames are sent in chunk sized fragments once the
+     *        peer announced it reassembles them. The order is kept within a lane
+     *        only. Must be called before BindHandler.
+     *
+     * @param config the chunk size and the bulk threshold
+     */
+    void SetPriority(const PriorityConfig& config);
+
+    /**
+     * @brief PendingOutput return the bytes queued and not yet written to the socket
+     *
+     * @return std::size_t
+     */
+    std::size_t PendingOutput();
+
+    /**
+     * @brief Pump move pending frames to the socket output, called from the write callback
+     *
+     * @return true once after a send was rejected and the output drained below the
+     *         low watermark, the caller reports it through OnWritable.
+     */
+    bool Pump();
+
+    /**
+     * @brief DroppedFrames the frames dropped by DROP_OLDEST and the queued frames
+     *        of other threads which could not be written, may be read on any thread
+     *
+     * @return uint64_t
+     */
+    uint64_t DroppedFrames();
+
+    /**
+     * @brief SetCompressor enable zstd payload compression on this connection.
+     *        Compression is negotiated: frames are only compressed once the peer
+     *        sent a hello announcing it, so old peers keep receiving raw frames.
+     *        Must be called before BindHandler.
+     *
+     * @param compressor shared by the connections of one server or client
+     */
+    void SetCompressor(CompressorPtr compressor);
+
+    /**
+     * @brief SetChecksum ask the peer to protect the frames it sends with a CRC32C
+     *        trailer. The request is announced with the hello; frames received with
+     *        a trailer are always verified. Must be called before BindHandler.
+     *
+     * @param enable
+     */
+    void SetChecksum(bool enable);
+
+    /**
+     * @brief SetCompactHeader announce the compact header with the hello, frames
+     *        are sent with it once the peer announced it as well. A compact header
+     *        takes 3 bytes for a frame with a type and a size only, about 10 for a
+     *        stamped keepalive and 41 at most, instead of 40. Must be called
+     *        before BindHandler.
+     *
+     * @param enable
+     */
+    void SetCompactHeader(bool enable);
+
+    /**
+     * @brief SendHello announce the local capabilities to the peer, nothing is sent
+     *        when none is enabled
+     *
+     * @return std::error_code
+     */
+    std::error_code SendHello();
+
+    /**
+     * @brief OnHello apply the capabilities the peer announced
+     *
+     * @param header the hello header in host byte order
+     */
+    void OnHello(const Header& header);
+    bool IsCompressing();
+
+    /**
+     * @brief IdleTimer the node of this connection in the idle timing wheel of its
+     *        handler, rescheduled on every read
+     *
+     * @return TimerNode&
+     */
+    TimerNode& IdleTimer();
+
+    /**
+     * @brief SampleReadBytes return the bytes read from the peer since the last call
+     *
+     * @return uint64_t
+     */
+    uint64_t SampleReadBytes();
+
+    /**
+     * @brief ReadBytes the bytes read from the peer so far, WriteBytes the bytes of the
+     *        frames queued for it
+     *
+     * @return uint64_t
+     */
+    uint64_t ReadBytes();
+    uint64_t WriteBytes();
+
+    /**
+     * @brief ReceivedBytes the bytes which arrived from the peer so far, with the
+     *        ones still in the input waiting for the rest of their frame
+     *
+     * @return uint64_t
+     */
+    uint64_t ReceivedBytes();
+
+    /**
+     * @brief RTT the round trip time measured with the keepalive pings of this
+     *        connection, only the side which pings has samples
+     *
+     * @return RTTEstimator&
+     */
+    RTTEstimator& RTT();
+
+    /**
+     * @brief TrackInboundStream note a chunk of a stream the peer sent, called on the
+     *        loop thread
+     *
+     * @param streamID the stream id
+     * @param end the chunk is the last one of the stream
+     * @return true for the first chunk of the stream
+     */
+    bool TrackInboundStream(uint64_t streamID, bool end);
+
+    /**
+     * @brief TakeInboundStreams the streams of the peer which are still open, they
+     *        are forgotten
+     *
+     * @return std::vector<uint64_t>
+     */
+    std::vector<uint64_t> TakeInboundStreams();
+
+    /**
+     * @brief Detach stop the I/O of this connection on the loop it belongs to, the
+     *        corked output is flushed first. Called on the old loop thread.
+     */
+    void Detach();
+
+    /**
+     * @brief Attach move a detached connection to another event loop and resume
+     *        its I/O. Called on the new loop thread.
+     *
+     * @param base the event base of the new loop
+     * @param handler the handler of the new loop
+     * @return std::error_code
+     */
+    std::error_code Attach(event_base* base, void* handler);
+
 private:
-    void BuildID();
+    static void FlushCallback(evutil_socket_t fd, short events, void* ctx);
+    static void SpliceCallback(evutil_socket_t fd, short events, void* ctx);
 
 private:
-    std::atomic<ConnectionState> _state             = ConnectionState::UNKNOWN;
-    uint64_t                     _lastReadTimestamp = 0;
+    void            BuildID();
+    void            UpdateReadWatermark();
+    evbuffer*       OutputBuffer();
+    void            Flush();
+    std::error_code Admit(std::size_t frameSize);
+    std::error_code AdmitQueued(std::size_t payloadSize);
+    void            Overflow();
+    void            PublishOutput();
+    void            TrackFrame(evbuffer* output, std::size_t frameSize);
+    void            DropOldest(std::size_t frameSize);
+    bool            ShouldCompress(const Header& header, std::size_t payloadSize);
+    std::error_code SendCompressed(const Header& header, const iovec* iov, int iovcnt);
+    std::error_code SendBuffer(const Header& header, evbuffer* buffer);
+    bool            ShouldQueue();
+    void            ScheduleFlush();
+
+    // the lanes of the frames waiting for the socket output, see SetPriority
+    struct Lane
+    {
+        evbuffer*               _buffer = nullptr;
+        std::deque<std::size_t> _frames; // the frame sizes, the first one shrinks while it is fragmented
+    };
+
+    FramePriority Classify(const Header& header);
+    void          PumpLanes();
+    void          WriteFragment(Lane& lane, evbuffer* output);
+    void          DropLane(Lane& lane, std::size_t frameSize);
+    bool          IsFileFrame(Lane& lane);
 
-    std::string     _id;
-    evutil_socket_t _fd = EVUTIL_INVALID_SOCKET;
+    bool            CanSplice();
+    std::error_code LandFile(evbuffer* input);
+    std::error_code StartSplice();
+    void            Splice();
+    void            EndFile(std::error_code errcode);
+
+    // the payload of a frame, either chunks (referenced with a cleanup, copied
+    // otherwise) or an evbuffer (moved when owned, referenced otherwise)
+    struct FramePayload
+    {
+        const iovec*            _iov        = nullptr;
+        int                     _iovcnt     = 0;
+        evbuffer*               _buffer     = nullptr;
+        bool                    _moveBuffer = false;
+        evbuffer_ref_cleanup_cb _cleanup    = nullptr;
+        void*                   _cleanupArg = nullptr;
+        evbuffer_file_segment*  _file       = nullptr; // a file range, sent with sendfile when possible
+        std::size_t             _fileSize   = 0;
+    };
+
+    /**
+     * @brief WriteFrame the only place frames are appended to the output: fills in
+     *        _dataSize, applies backpressure and appends the CRC32C trailer when the
+     *        peer asked for it. The frame is appended whole or not at all.
+     *
+     * @param header the frame header in host byte order
+     * @param payload the frame payload
+     * @return std::error_code
+     */
+    std::error_code WriteFrame(Header header, const FramePayload& payload);
+
+    // drops what was assembled of a failed frame and releases the chunks from taken on
+    std::error_code DiscardFrame(const FramePayload& payload, const std::vector<evbuffer_iovec>& chunks,
+                                 std::size_t taken);
+
+private:
+    std::atomic<ConnectionState> _state = ConnectionState::UNKNOWN;
+    TimerNode                    _idleTimer;
+
+    std::string      _id;
+    std::once_flag   _idOnce;
+    ConnectionHandle _handle;
+    evutil_socket_t  _fd = EVUTIL_INVALID_SOCKET;
 
     std::string _remoteIP;
     uint16_t    _remotePort = 0;
 
-    void*        _handler = nullptr;
-    bufferevent* _bev     = nullptr;
+    void*                       _handler  = nullptr;
+    bufferevent*                _bev      = nullptr;
+    std::atomic<OutboundQueue*> _outbound = nullptr; // the frames sent from other threads
+
+    FrameDecoder _decoder;
+    std::size_t  _readLowWatermark = Message::MESSAGE_HEADER_SIZE;
+    uint64_t     _readBytes        = 0;
+    uint64_t     _sampledReadBytes = 0;
+    uint64_t     _writeBytes       = 0;
+    RTTEstimator _rtt;
+
+    bool      _corked         = false;
+    bool      _flushScheduled = false;
+    evbuffer* _corkedOutput   = nullptr;
+    event*    _flushEvent     = nullptr;
+    evbuffer* _frame          = nullptr; // a frame assembled aside, moved to the output whole
+
+    // output backpressure, frames behind a full socket output wait in the pending queue
+    BackpressureConfig      _backpressure;
+    bool                    _outputBlocked = false;
+    bool                    _overflowed    = false; // DISCONNECT closes once, through the event callback
+    evbuffer*               _pendingOutput = nullptr;
+    std::deque<std::size_t> _pendingFrames;
+    std::atomic<uint64_t>   _droppedFrames = 0;
+
+    // the admission of the frames sent from other threads, see AdmitQueued
+    std::atomic<std::size_t> _queuedBytes     = 0;
+    std::atomic<std::size_t> _outputBytes     = 0; // PendingOutput as of the last write callback
+    std::atomic_bool         _queueBlocked    = false;
+    std::atomic_bool         _queueOverflowed = false;
+
+    // priority lanes, _fragmentHeader is the frame of the bulk lane being fragmented
+    PriorityConfig      _priority;
+    std::array<Lane, 3> _lanes;
+    Header              _fragmentHeader;
+    std::size_t         _fragmentLeft  = 0;
+    bool                _peerFragments = false;
+
+    // streams, the ids this side opened and the ones the peer has open
+    std::atomic<uint64_t>        _lastStreamID = 0;
+    std::unordered_set<uint64_t> _inboundStreams;
+
+    // the file frame being received, see OfferFile
+    std::shared_ptr<TCPHandlerCallback> _fileCallback = nullptr;
+    Header                              _fileHeader;
+    int                                 _fileSink    = -1;
+    uint64_t                            _fileLeft    = 0;
+    bool                                _splicing    = false;
+    int                                 _pipe[2]     = {-1, -1};
+    event*                              _spliceEvent = nullptr;
+
+    // payload compression, _peerCompression is set by the hello of the peer
+    CompressorPtr _compressor       = nullptr;
+    bool          _peerCompression  = false;
+    uint32_t      _peerDictionaryID = 0;
+    evbuffer*     _compressed       = nullptr;
+
+    // CRC32C trailers, _checksum is requested from the peer, _peerChecksum by the peer
+    bool _checksum     = false;
+    bool _peerChecksum = false;
+
+    // compact headers, sent once both sides announced them
+    bool _compactHeader = false;
+    bool _peerCompact   = false;
 };
 
 using TCPConnectionPtr = std::shared_ptr<TCPConnection>;
@@ -1,4 +1,6 @@
 #include "core/net/tcp_handler.h"
+#include "core/assist/defer.h"
+#include "core/assist/time.h"
 #include "core/error/error.h"
 #include "core/log/log.h"
 #include "core/net/message.h"
@@ -8,14 +10,84 @@
 #include <event2/bufferevent.h>
 #include <event2/event.h>
 
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
 #include <future>
 #include <string>
 
 namespace viper {
 namespace net {
 
+void TCPHandlerCallback::Dispatch(TCPConnectionPtr conn, const std::vector<MessagePtr>& msgs)
+{
+    auto isChunk = [](const MessagePtr& msg) { return msg->GetHeader()._version & VIPER_NET_MESSAGE_FLAG_STREAM; };
+    if (std::none_of(msgs.begin(), msgs.end(), isChunk))
+    {
+        HandleBatch(conn, msgs);
+        return;
+    }
+
+    // the messages between the chunks are handed over in runs, so the order is kept
+    std::vector<MessagePtr> run;
+    for (const auto& msg : msgs)
+    {
+        if (!isChunk(msg))
+        {
+            run.push_back(msg);
+            continue;
+        }
+
+        if (!run.empty())
+        {
+            HandleBatch(conn, run);
+            run.clear();
+        }
+
+        DispatchChunk(conn, msg);
+    }
+
+    if (!run.empty())
+    {
+        HandleBatch(conn, run);
+    }
+}
+
+void TCPHandlerCallback::AbortStreams(TCPConnectionPtr conn)
+{
+    for (auto streamID : conn->TakeInboundStreams())
+    {
+        OnStreamEnd(conn, streamID, error::ErrorCode::NET_DISCONNECTED);
+    }
+
+    conn->AbortFile();
+}
+
+void TCPHandlerCallback::DispatchChunk(TCPConnectionPtr conn, const MessagePtr chunk)
+{
+    const auto& header = chunk->GetHeader();
+    bool        end    = header._version & VIPER_NET_MESSAGE_FLAG_STREAM_END;
+    if (conn->TrackInboundStream(header._sequence, end))
+    {
+        OnStreamBegin(conn, header);
+    }
+
+    OnChunk(conn, chunk);
+    if (end)
+    {
+        OnStreamEnd(conn, header._sequence, error::ErrorCode::SUCCESS);
+    }
+}
+
 TCPHandler::TCPHandler()
 {
+    _messagePool = std::make_shared<MessagePool>();
 }
 
 TCPHandler::~TCPHandler()
@@ -24,28 +96,48 @@ TCPHandler::~TCPHandler()
 
 void TCPHandler::CheckConnectionState(evutil_socket_t fd, short events, void* ctx)
 {
-    auto server = static_cast<TCPHandler*>(ctx);
+    auto handler = static_cast<TCPHandler*>(ctx);
+    auto nowMs   = assist::TimestampTickCountMillisecond();
+    auto now     = (nowMs - handler->_wheelStartTime) / VIPER_NET_TIMING_WHEEL_TICK_MS;
 
-    LOG_DEBUG("tcp server handler check the connection state, connection count: {}", server->_connections.Count());
+    handler->SampleLoad(nowMs);
 
-    server->_connections.Delete([server](std::string key, TCPConnectionPtr conn) -> bool {
-        if (conn->State() != ConnectionState::CONNECTED)
-        {
-            // delete this connection
-            return true;
-        }
+    // only the connections whose deadline falls into the elapsed ticks are visited
+    auto expired = handler->_idleWheel->Advance(now + 1, [handler](TimerNode* node) {
+        auto conn = static_cast<TCPConnection*>(node->_owner);
+        LOG_DEBUG("timeout. connection: {}", conn->ID());
+        handler->CloseConnection(conn, ConnectionState::TIMEOUT);
+    });
 
-        if (conn->IsTimeout(server->_timeoutSeconds.tv_sec))
-        {
-            LOG_DEBUG("timeout. connection: {}", conn->ID());
-            conn->UpdateState(ConnectionState::TIMEOUT);
-            return false;
-        }
+    if (expired > 0)
+    {
+        LOG_DEBUG("tcp server handler closed {} idle connections, connection count: {}", expired,
+                  handler->_idleWheel->Count());
+    }
+}
 
-        return false;
-    });
+void TCPHandler::WakeupCallback(evutil_socket_t fd, short events, void* ctx)
+{
+    auto handler = static_cast<TCPHandler*>(ctx);
+
+    uint64_t count = 0;
+    if (read(fd, &count, sizeof(count)) < 0)
+    {
+        return;
+    }
+
+    handler->_dispatches++;
+
+    std::vector<std::function<void()>> tasks;
+    {
+        std::lock_guard<std::mutex> lock(handler->_tasksMutex);
+        tasks.swap(handler->_tasks);
+    }
 
-    evtimer_add(server->_checkConnectionStateEvent, &server->_timeoutSeconds);
+    for (auto& task : tasks)
+    {
+        task();
+    }
 }
 
 void TCPHandler::SetTimeout(int timeoutSec)
@@ -55,55 +147,111 @@ void TCPHandler::SetTimeout(int timeoutSec)
 
 void TCPHandler::ReadCallback(bufferevent* bev, void* ctx)
 {
-    TCPConnection* conn = static_cast<TCPConnection*>(ctx);
+    TCPConnection* conn    = static_cast<TCPConnection*>(ctx);
+    auto           handler = static_cast<TCPHandler*>(conn->GetHandler());
+    auto&          batch   = handler->_batch;
+
+    handler->_dispatches++;
 
-    MessagePtr msg     = std::make_shared<Message>();
-    auto       errcode = conn->Read(msg);
+    // the time spent here is the busy time of the loop
+    auto start = assist::TimestampTickCountMicrosecond();
+    DEFER(handler->_busyTime += assist::TimestampTickCountMicrosecond() - start);
+
+    evbuffer*   input     = bufferevent_get_input(bev);
+    std::size_t available = evbuffer_get_length(input);
+    auto        errcode   = conn->Read(handler->_messagePool.get(), batch);
+
+    handler->_readBytes    += available - evbuffer_get_length(input);
+    handler->_readMessages += batch.size();
+    if (error::IsSuccess(errcode))
+    {
+        handler->_idleWheel->Schedule(&conn->IdleTimer());
+    }
+    else
+    {
+        // the stream can not be resynchronized, stop reading from it
+        LOG_WARN("invalid connection:{}, errcode:{}", conn->ID(), errcode.value());
+        conn->UpdateState(ConnectionState::INVALID);
+        bufferevent_disable(bev, EV_READ);
+    }
 
-    if (errcode == error::ErrorCode::SYSTEM_TRY_AGAIN)
+    if (batch.empty())
     {
         LOG_DEBUG("no more data to read, try again, connection:{}", conn->ID());
+        conn->OfferFile(handler->_functor);
         return;
     }
 
-    if (errcode == error::ErrorCode::NET_INVALID_MAGIC)
+    LOG_DEBUG("readed {} messages. connection:{}", batch.size(), conn->ID());
+
+    auto sharedConn = conn->shared_from_this();
+
+    std::size_t count = 0;
+    for (auto& msg : batch)
     {
-        LOG_WARN("invalid connection:{}", conn->ID());
-        conn->UpdateState(ConnectionState::INVALID);
-        return;
+        if (!handler->ProcessCoreMessage(sharedConn, msg))
+        {
+            batch[count++] = std::move(msg);
+        }
     }
+    batch.resize(count);
 
-    if (!error::IsSuccess(errcode))
+    if (!batch.empty())
     {
-        LOG_ERROR("failed to read data from connection:{}, errcode:{}", conn->GetRemoteAddress(), errcode.value());
+        handler->_functor->Dispatch(sharedConn, batch);
     }
 
-    LOG_DEBUG("readed a message. connection:{}", conn->ID());
+    // give the messages back to the pool
+    batch.clear();
 
-    auto handler    = static_cast<TCPHandler*>(conn->GetHandler());
-    auto sharedConn = conn->shared_from_this();
+    // a file frame is offered once the frames before it were handled
+    conn->OfferFile(handler->_functor);
+}
 
-    if (!handler->ProcessCoreMessage(sharedConn, msg))
+void TCPHandler::WriteCallback(bufferevent* bev, void* ctx)
+{
+    TCPConnection* conn    = static_cast<TCPConnection*>(ctx);
+    auto           handler = static_cast<TCPHandler*>(conn->GetHandler());
+
+    handler->_dispatches++;
+    if (!conn->Pump())
     {
-        handler->_functor->HandleData(sharedConn, msg);
+        return;
     }
+
+    handler->_functor->OnWritable(conn->shared_from_this());
 }
+
 void TCPHandler::EventCallback(bufferevent* bev, short events, void* ctx)
 {
-    TCPConnection* conn = static_cast<TCPConnection*>(ctx);
-    if (events & BEV_EVENT_EOF)
+    TCPConnection* conn    = static_cast<TCPConnection*>(ctx);
+    auto           handler = static_cast<TCPHandler*>(conn->GetHandler());
+
+    handler->_dispatches++;
+
+    // an accepted TLS connection reports it once its handshake completed
+    if (events & BEV_EVENT_CONNECTED)
     {
-        conn->UpdateState(ConnectionState::CONNECTED);
-        auto handler = static_cast<TCPHandler*>(conn->GetHandler());
-        handler->_functor->OnDisconnection(conn->shared_from_this());
-        handler->_connections.Delete(conn->ID());
-        bufferevent_free(bev);
+        SSL* ssl = handler->_tls ? bufferevent_openssl_get_ssl(bev) : nullptr;
+        if (ssl)
+        {
+            handler->_tls->OnHandshake(ssl);
+        }
+
         return;
     }
 
-    if (events & BEV_EVENT_ERROR)
+    // a reset peer reports an error instead of the end of file, both drop the connection
+    if (events & (BEV_EVENT_EOF | BEV_EVENT_ERROR))
     {
-        LOG_ERROR("make some exception from bufferevent");
+        std::string reason = handler->_tls ? TLSContext::ErrorString(bev) : "";
+        if (!reason.empty())
+        {
+            LOG_DEBUG("tls connection failed. error:{}, connection:{}", reason, conn->ID());
+        }
+
+        LOG_DEBUG("connection dropped. events:0x{:02X}, connection:{}", events, conn->ID());
+        handler->CloseConnection(conn, ConnectionState::DISCONNECTED);
     }
 }
 
@@ -112,25 +260,383 @@ void TCPHandler::SetCallback(TCPHandlerCallbackFunctor functor)
     _functor = functor;
 }
 
+void TCPHandler::SetBackpressure(const BackpressureConfig& config)
+{
+    _backpressure = config;
+}
+
+void TCPHandler::SetPriority(const PriorityConfig& config)
+{
+    _priority = config;
+}
+
+void TCPHandler::SetCompressor(CompressorPtr compressor)
+{
+    _compressor = compressor;
+}
+
+void TCPHandler::SetChecksum(bool enable)
+{
+    _checksum = enable;
+}
+
+void TCPHandler::SetCompactHeader(bool enable)
+{
+    _compact = enable;
+}
+
+void TCPHandler::SetCPUs(const std::vector<int>& cpus)
+{
+    _cpus = cpus;
+}
+
+void TCPHandler::SetBackend(NetBackend backend)
+{
+    _backend = backend;
+}
+
+void TCPHandler::SetBusyPoll(const BusyPollConfig& config)
+{
+    _busyPoll = config;
+}
+
+void TCPHandler::SetTLS(TLSContextPtr tls)
+{
+    _tls = tls;
+}
+
+void TCPHandler::SetBusyPollOptions(evutil_socket_t fd)
+{
+    // raising SO_BUSY_POLL above net.core.busy_read needs CAP_NET_ADMIN, the loop spins anyway
+    int pollUs = _busyPoll._socketPollUs;
+    if (pollUs > 0 && setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &pollUs, sizeof(pollUs)) != 0)
+    {
+        LOG_DEBUG("failed to set SO_BUSY_POLL. fd:{}, errno:{}", fd, errno);
+    }
+
+    int prefer = _busyPoll._preferBusyPoll ? 1 : 0;
+    if (prefer && setsockopt(fd, SOL_SOCKET, SO_PREFER_BUSY_POLL, &prefer, sizeof(prefer)) != 0)
+    {
+        LOG_DEBUG("failed to set SO_PREFER_BUSY_POLL. fd:{}, errno:{}", fd, errno);
+    }
+}
+
 void TCPHandler::BindConnection(evutil_socket_t fd, sockaddr* address, int socklen)
 {
+    // called by the listener thread, the connection is built on the loop thread
+    sockaddr_storage storage;
+    memset(&storage, 0, sizeof(storage));
+    memcpy(&storage, address, std::min<std::size_t>(socklen, sizeof(storage)));
+
+    // counted right away, so the placement of the next connections sees it
+    _connectionCount++;
+    RunInLoop([this, fd, storage, socklen]() mutable { Bind(fd, (sockaddr*)&storage, socklen); });
+}
+
+void TCPHandler::AcceptCallback(evconnlistener* listener, evutil_socket_t fd, sockaddr* address, int socklen, void* ctx)
+{
+    // accepted on the loop thread, the connection is bound right away
+    auto handler = static_cast<TCPHandler*>(ctx);
+    handler->_connectionCount++;
+    handler->Bind(fd, address, socklen);
+}
+
+void TCPHandler::Bind(evutil_socket_t fd, sockaddr* address, int socklen)
+{
+    // a UNIX socket only carries the handshake of a shared memory connection
+    bool local = AF_UNIX == address->sa_family;
+    if (local && !_shm)
+    {
+        _shm = std::make_unique<ShmBackend>();
+        _shm->Start(_base);
+    }
+
+    if (_busyPoll._enable && !local)
+    {
+        SetBusyPollOptions(fd);
+    }
+
     auto conn = std::make_shared<TCPConnection>(fd, address, socklen);
-    auto bev  = bufferevent_socket_new(_base, fd, BEV_OPT_CLOSE_ON_FREE);
+
+    bufferevent* bev = OpenBufferEvent(fd, local);
+    if (!bev)
+    {
+        LOG_ERROR("failed to create the bufferevent. fd:{}", fd);
+        _connectionCount--;
+        return;
+    }
 
     conn->UpdateState(ConnectionState::CONNECTED);
-    _functor->OnConnection(conn);
+    conn->SetBackpressure(_backpressure);
+    conn->SetPriority(_priority);
+    conn->SetCompressor(_compressor);
+    conn->SetChecksum(_checksum);
+    conn->SetCompactHeader(_compact);
+    conn->BindHandler(bev, this);
+    conn->BindOutbound(&_outbound);
 
-    bufferevent_setcb(bev, ReadCallback, nullptr, EventCallback, conn.get());
-    bufferevent_setwatermark(bev, EV_READ, Message::MESSAGE_HEADER_SIZE, 10 * 1024 * 1024);
+    bufferevent_setcb(bev, ReadCallback, WriteCallback, EventCallback, conn.get());
+    bufferevent_setwatermark(bev, EV_READ, Message::MESSAGE_HEADER_SIZE, VIPER_NET_TCP_CONNECTION_READ_HIGH_WATERMARK);
     bufferevent_enable(bev, EV_READ | EV_WRITE);
 
-    timeval timeout;
-    timeout.tv_sec  = _timeoutSeconds.tv_sec;
-    timeout.tv_usec = 0;
-    bufferevent_set_timeouts(bev, &timeout, &timeout);
+    // idle connections are found by the timing wheel, the bufferevent has no timeouts
+    _idleWheel->Schedule(&conn->IdleTimer());
 
-    conn->BindHandler(bev, this);
-    _connections.Push(conn->ID(), conn);
+    conn->SendHello();
+
+    // the connection is bound before the callback, so it may send right away
+    conn->BindHandle(_connections.Insert(conn));
+    _functor->OnConnection(conn);
+}
+
+bufferevent* TCPHandler::OpenBufferEvent(evutil_socket_t fd, bool local)
+{
+    if (local)
+    {
+        return _shm->Open(fd);
+    }
+
+    if (!_tls)
+    {
+        return _uring ? _uring->Open(fd) : bufferevent_socket_new(_base, fd, BEV_OPT_CLOSE_ON_FREE);
+    }
+
+    // with io_uring the TLS records are filtered on top of the bufferevent of the ring
+    bufferevent* io = _uring ? _uring->Open(fd) : nullptr;
+    if (_uring && !io)
+    {
+        return nullptr;
+    }
+
+    SSL* ssl = _tls->NewSSL();
+    if (!ssl)
+    {
+        if (io)
+        {
+            UringBackend::Release(io);
+            bufferevent_free(io);
+        }
+        else
+        {
+            evutil_closesocket(fd);
+        }
+
+        return nullptr;
+    }
+
+    bufferevent* bev = nullptr;
+    if (io)
+    {
+        bev = bufferevent_openssl_filter_new(_base, io, ssl, BUFFEREVENT_SSL_ACCEPTING, BEV_OPT_CLOSE_ON_FREE);
+    }
+    else
+    {
+        bev = bufferevent_openssl_socket_new(_base, fd, ssl, BUFFEREVENT_SSL_ACCEPTING, BEV_OPT_CLOSE_ON_FREE);
+    }
+
+    if (!bev)
+    {
+        return nullptr;
+    }
+
+    // a peer closing without close_notify is an end of file like on a plain connection
+    bufferevent_openssl_set_allow_dirty_shutdown(bev, 1);
+    return bev;
+}
+
+void TCPHandler::CloseConnection(TCPConnection* conn, ConnectionState state)
+{
+    _idleWheel->Cancel(&conn->IdleTimer());
+    _connectionCount--;
+    conn->UpdateState(state);
+
+    // the last reference is released when this function returns, which frees the bufferevent
+    auto sharedConn = conn->shared_from_this();
+    _functor->AbortStreams(sharedConn);
+    _functor->OnDisconnection(sharedConn);
+    _connections.Delete(conn->Handle());
+}
+
+TCPConnectionPtr TCPHandler::FindConnection(ConnectionHandle handle)
+{
+    auto conn = _connections.Find(handle);
+    return conn ? *conn : nullptr;
+}
+
+bool TCPHandler::MigrateHottest(TCPHandler* target, uint64_t maxBytesPerSecond)
+{
+    // the sockets belong to the ring of this loop, the TLS state can not be moved to another base
+    if (_uring || target->_uring || _tls)
+    {
+        return false;
+    }
+
+    auto now      = assist::TimestampTickCountMillisecond();
+    auto interval = std::max<uint64_t>(now - _migrationTime, 1);
+    _migrationTime = now;
+
+    TCPConnectionPtr hottest      = nullptr;
+    uint64_t         hottestBytes = 0;
+    _connections.Foreach([&](ConnectionHandle handle, TCPConnectionPtr& conn) {
+        uint64_t bytesPerSecond = conn->SampleReadBytes() * 1000 / interval;
+        if (conn->State() == ConnectionState::CONNECTED && bytesPerSecond > hottestBytes &&
+            bytesPerSecond <= maxBytesPerSecond && !ShmBackend::Owns(conn->GetBufferEvent()))
+        {
+            hottest      = conn;
+            hottestBytes = bytesPerSecond;
+        }
+    });
+
+    if (!hottest)
+    {
+        return false;
+    }
+
+    LOG_INFO("migrate connection {} to another tcp handler. bytes per second:{}", hottest->ID(), hottestBytes);
+
+    // the connection leaves this loop completely before the target picks it up
+    _idleWheel->Cancel(&hottest->IdleTimer());
+    _connections.Delete(hottest->Handle());
+    hottest->BindHandle(ConnectionHandle());
+    _connectionCount--;
+    hottest->Detach();
+
+    // frames sent from now on queue at the target, which writes them once it adopted the connection
+    hottest->BindOutbound(&target->_outbound);
+
+    target->_connectionCount++;
+    target->RunInLoop([target, hottest]() { target->Adopt(hottest); });
+    return true;
+}
+
+void TCPHandler::Adopt(TCPConnectionPtr conn)
+{
+    if (!error::IsSuccess(conn->Attach(_base, this)))
+    {
+        _connectionCount--;
+        _functor->OnDisconnection(conn);
+        return;
+    }
+
+    _idleWheel->Schedule(&conn->IdleTimer());
+    conn->BindHandle(_connections.Insert(conn));
+    _outbound.Drain();
+
+    // bytes which arrived before the move do not trigger a read event again
+    auto bev = conn->GetBufferEvent();
+    if (evbuffer_get_length(bufferevent_get_input(bev)) > 0)
+    {
+        ReadCallback(bev, conn.get());
+    }
+}
+
+void TCPHandler::SampleLoad(uint64_t now)
+{
+    if (0 == _loadSampleTime)
+    {
+        _loadSampleTime = now;
+        _migrationTime  = now;
+        return;
+    }
+
+    auto interval = now - _loadSampleTime;
+    if (0 == interval)
+    {
+        return;
+    }
+
+    _bytesPerSecond.store(_readBytes * 1000 / interval, std::memory_order_relaxed);
+    _messagesPerSecond.store(_readMessages * 1000 / interval, std::memory_order_relaxed);
+    _busyRatio.store(std::min(1.0, _busyTime / (interval * 1000.0)), std::memory_order_relaxed);
+
+    _readBytes      = 0;
+    _readMessages   = 0;
+    _busyTime       = 0;
+    _loadSampleTime = now;
+}
+
+std::error_code TCPHandler::Listen(const sockaddr* address, int socklen)
+{
+    evutil_socket_t fd = socket(address->sa_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        LOG_ERROR("failed to create the listening socket. errno:{}", errno);
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    int on = 1;
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0 || bind(fd, address, socklen) != 0 ||
+        listen(fd, SOMAXCONN) != 0)
+    {
+        LOG_ERROR("failed to listen with SO_REUSEPORT. errno:{}", errno);
+        close(fd);
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    // the socket is already in the reuseport group, the loop thread starts accepting
+    _listenFd = fd;
+    RunInLoop([this]() {
+        if (_uring)
+        {
+            _uring->Accept(_listenFd, [this](evutil_socket_t fd, sockaddr* address, int socklen) {
+                _connectionCount++;
+                Bind(fd, address, socklen);
+            });
+            return;
+        }
+
+        _listener = evconnlistener_new(_base, &TCPHandler::AcceptCallback, this, LEV_OPT_CLOSE_ON_FREE, -1, _listenFd);
+        if (!_listener)
+        {
+            LOG_ERROR("failed to create the listener. fd:{}", _listenFd);
+        }
+    });
+
+    return error::ErrorCode::SUCCESS;
+}
+
+evutil_socket_t TCPHandler::ListenFd()
+{
+    return _listenFd;
+}
+
+void TCPHandler::RunInLoop(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(_tasksMutex);
+        _tasks.push_back(std::move(task));
+    }
+
+    uint64_t one = 1;
+    if (write(_wakeupFd, &one, sizeof(one)) < 0)
+    {
+        LOG_WARN("failed to wake up the tcp handler. errno:{}", errno);
+    }
+}
+
+MessagePoolStats TCPHandler::GetMessagePoolStats()
+{
+    return _messagePool->Stats();
+}
+
+BusyPollStats TCPHandler::GetBusyPollStats()
+{
+    BusyPollStats stats;
+    stats._spins    = _spins.load(std::memory_order_relaxed);
+    stats._spinHits = _spinHits.load(std::memory_order_relaxed);
+    stats._parks    = _parks.load(std::memory_order_relaxed);
+    return stats;
+}
+
+HandlerLoad TCPHandler::Load()
+{
+    HandlerLoad load;
+    load._connections       = _connectionCount.load(std::memory_order_relaxed);
+    load._bytesPerSecond    = _bytesPerSecond.load(std::memory_order_relaxed);
+    load._messagesPerSecond = _messagesPerSecond.load(std::memory_order_relaxed);
+    load._busyRatio         = _busyRatio.load(std::memory_order_relaxed);
+    return load;
 }
 
 std::error_code TCPHandler::Start()
@@ -142,6 +648,63 @@ std::error_code TCPHandler::Start()
         return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
     }
 
+    // the lowest priority runs after the I/O callbacks, e.g. corked flushes
+    event_base_priority_init(_base, VIPER_NET_EVENT_PRIORITY_COUNT);
+
+    _wakeupFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_wakeupFd < 0)
+    {
+        LOG_ERROR("failed to create the wakeup eventfd. errno:{}", errno);
+        event_base_free(_base);
+        _base = nullptr;
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    _wakeupEvent = event_new(_base, _wakeupFd, EV_READ | EV_PERSIST, &TCPHandler::WakeupCallback, this);
+    event_add(_wakeupEvent, nullptr);
+
+    auto errcode = _outbound.Start(_base, this);
+    if (!error::IsSuccess(errcode))
+    {
+        event_free(_wakeupEvent);
+        close(_wakeupFd);
+        event_base_free(_base);
+        _wakeupEvent = nullptr;
+        _wakeupFd    = EVUTIL_INVALID_SOCKET;
+        _base        = nullptr;
+        return errcode;
+    }
+
+    if (NetBackend::IO_URING == _backend)
+    {
+        _uring  = std::make_unique<UringBackend>();
+        errcode = _uring->Start(_base);
+        if (!error::IsSuccess(errcode))
+        {
+            LOG_ERROR("failed to start the io_uring backend");
+            _uring.reset();
+            _outbound.Stop();
+            event_free(_wakeupEvent);
+            close(_wakeupFd);
+            event_base_free(_base);
+            _wakeupEvent = nullptr;
+            _wakeupFd    = EVUTIL_INVALID_SOCKET;
+            _base        = nullptr;
+            return errcode;
+        }
+    }
+
+    // A connection idles out once nothing was read for five timeout periods, the
+    // wheel holds one round of that.
+    uint64_t idleTicks = (uint64_t)_timeoutSeconds.tv_sec * 5 * 1000 / VIPER_NET_TIMING_WHEEL_TICK_MS;
+    _idleWheel         = std::make_unique<TimingWheel>(idleTicks);
+    _wheelStartTime    = assist::TimestampTickCountMillisecond();
+
+    timeval tick = {VIPER_NET_TIMING_WHEEL_TICK_MS / 1000, (VIPER_NET_TIMING_WHEEL_TICK_MS % 1000) * 1000};
+    _checkConnectionStateEvent = event_new(_base, -1, EV_PERSIST, &TCPHandler::CheckConnectionState, this);
+    evtimer_add(_checkConnectionStateEvent, &tick);
+
+    _running  = true;
     _asyncRun = std::async(std::launch::async, &TCPHandler::Run, this);
 
     return error::ErrorCode::SUCCESS;
@@ -154,31 +717,139 @@ std::error_code TCPHandler::Stop()
         return error::ErrorCode::SUCCESS;
     }
 
-    event_base_loopbreak(_base);
+    // the base is only freed once the loop thread left it
+    _running = false;
+    RunInLoop([this]() { event_base_loopbreak(_base); });
+    if (_asyncRun.valid())
+    {
+        _asyncRun.wait();
+    }
+
+    // the connections free their bufferevents, which needs the base
+    _connections.Clean();
+
+    // queued frames hold connections, which need the ring and the base
+    _outbound.Stop();
+
+    // the ring closes its sockets, the listening one is closed below
+    _uring.reset();
+    _shm.reset();
+
+    if (_listener)
+    {
+        evconnlistener_free(_listener);
+        _listener = nullptr;
+    }
+    else if (_listenFd != EVUTIL_INVALID_SOCKET)
+    {
+        close(_listenFd);
+    }
+    _listenFd = EVUTIL_INVALID_SOCKET;
+
+    _tasks.clear();
+
     event_free(_checkConnectionStateEvent);
+    event_free(_wakeupEvent);
+    close(_wakeupFd);
     event_base_free(_base);
 
     _base                      = nullptr;
     _checkConnectionStateEvent = nullptr;
+    _wakeupEvent               = nullptr;
+    _wakeupFd                  = EVUTIL_INVALID_SOCKET;
 
     return error::ErrorCode::SUCCESS;
 }
 
 void TCPHandler::Run()
 {
-    // set timer callback
-    _checkConnectionStateEvent = evtimer_new(_base, &TCPHandler::CheckConnectionState, this);
-    evtimer_add(_checkConnectionStateEvent, &_timeoutSeconds);
+    // the message pool and the connections are owned by the loop thread
+    _messagePool->BindThread();
+    _outbound.BindThread();
+
+    if (!_cpus.empty())
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (int cpu : _cpus)
+        {
+            CPU_SET(cpu, &cpus);
+        }
+
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+        {
+            LOG_WARN("failed to pin the tcp handler. first cpu:{}, cpus:{}", _cpus.front(), _cpus.size());
+        }
+    }
+
+    if (_busyPoll._enable)
+    {
+        RunBusyPoll();
+        return;
+    }
 
     // start event loop
     int exitedCode = 0;
     do {
         exitedCode = event_base_loop(_base, EVLOOP_NO_EXIT_ON_EMPTY);
-    } while (exitedCode != -1);
+    } while (exitedCode != -1 && _running);
 
     LOG_WARN("tcp handler run exited. exited code:{}", exitedCode);
 }
 
+void TCPHandler::RunBusyPoll()
+{
+    // the counters are published once per park, or every 1024 spins while the loop is hot
+    uint64_t spins    = 0;
+    uint64_t spinHits = 0;
+    auto     publish  = [&]() {
+        _spins.fetch_add(spins, std::memory_order_relaxed);
+        _spinHits.fetch_add(spinHits, std::memory_order_relaxed);
+        spins    = 0;
+        spinHits = 0;
+    };
+
+    int exitedCode = 0;
+    while (exitedCode != -1 && _running)
+    {
+        uint64_t lastWork = assist::TimestampTickCountMicrosecond();
+        uint64_t now      = lastWork;
+        while (_running && now - lastWork < (uint64_t)_busyPoll._spinUs)
+        {
+            uint64_t dispatches = _dispatches;
+            exitedCode          = event_base_loop(_base, EVLOOP_NONBLOCK | EVLOOP_NO_EXIT_ON_EMPTY);
+            if (-1 == exitedCode)
+            {
+                break;
+            }
+
+            now = assist::TimestampTickCountMicrosecond();
+            if (_dispatches != dispatches)
+            {
+                lastWork = now;
+                spinHits++;
+            }
+
+            if (0 == (++spins & 1023))
+            {
+                publish();
+            }
+        }
+
+        publish();
+        if (-1 == exitedCode || !_running)
+        {
+            break;
+        }
+
+        // nothing arrived within the budget, wait in the kernel until an event does
+        _parks.fetch_add(1, std::memory_order_relaxed);
+        exitedCode = event_base_loop(_base, EVLOOP_ONCE | EVLOOP_NO_EXIT_ON_EMPTY);
+    }
+
+    LOG_WARN("tcp handler busy poll exited. exited code:{}", exitedCode);
+}
+
 bool TCPHandler::ProcessCoreMessage(TCPConnectionPtr conn, MessagePtr msg)
 {
     const auto& header = msg->GetHeader();
@@ -189,18 +860,27 @@ bool TCPHandler::ProcessCoreMessage(TCPConnectionPtr conn, MessagePtr msg)
         return false;
     }
 
+    if (header._msgType == VIPER_NET_MESSAGE_PROTOCOL_HELLO)
+    {
+        conn->OnHello(header);
+        return true;
+    }
+
     if (header._msgType == VIPER_NET_MESSAGE_PROTOCOL_KEEPALIVE_PING)
     {
         LOG_DEBUG("received keepalive ping. client: {}", conn->GetRemoteAddress());
 
         static std::string data(VIPER_NET_MESSAGE_KEEPALIVE_PONG);
-        viper::net::Header   header;
-        header._dataSize = data.size();
-        header._msgType  = (uint32_t)VIPER_NET_MESSAGE_PROTOCOL_KEEPALIVE_PONG;
 
-        viper::net::Hton(header);
+        // the timestamp of the ping is echoed, the client takes the round trip time from it
+        viper::net::Header pong;
+        pong._dataSize  = data.size();
+        pong._msgType   = (uint32_t)VIPER_NET_MESSAGE_PROTOCOL_KEEPALIVE_PONG;
+        pong._timestamp = header._timestamp;
+
+        viper::net::Hton(pong);
 
-        viper::net::Message msg(header, data.data(), data.size());
+        viper::net::Message msg(pong, data.data(), data.size());
 
         auto errcode = conn->Send(msg);
 
@@ -17,18 +17,37 @@
 #ifndef _VIPER_CORE_NET_TCP_HANDLER_H_
 #define _VIPER_CORE_NET_TCP_HANDLER_H_
 
-#include "core/container/safe_map.h"
+#include "core/container/slot_map.h"
 #include "core/net/message.h"
+#include "core/net/message_pool.h"
+#include "core/net/outbound_queue.h"
+#include "core/net/shm_backend.h"
 #include "core/net/tcp_connection.h"
+#include "core/net/timing_wheel.h"
+#include "core/net/tls_context.h"
+#include "core/net/uring_backend.h"
 
 #include <event2/bufferevent.h>
+#include <event2/listener.h>
 
+#include <atomic>
+#include <functional>
 #include <future>
 #include <memory>
+#include <mutex>
+#include <system_error>
+#include <vector>
 
 namespace viper {
 namespace net {
 
+// clang-format off
+
+#define VIPER_NET_BUSY_POLL_SPIN_US_DFT   50
+#define VIPER_NET_BUSY_POLL_SOCKET_US_DFT 50
+
+// clang-format on
+
 class TCPHandlerCallback
 {
 public:
@@ -39,10 +58,147 @@ public:
     virtual void OnConnection(TCPConnectionPtr conn)                     = 0;
     virtual void OnDisconnection(TCPConnectionPtr conn)                  = 0;
     virtual void HandleData(TCPConnectionPtr conn, const MessagePtr msg) = 0;
+
+    /**
+     * @brief HandleBatch called with every frame decoded from one read event, in order.
+     *        The default implementation forwards each message to HandleData.
+     *
+     * @param conn the connection the messages were read from
+     * @param msgs the decoded messages
+     */
+    virtual void HandleBatch(TCPConnectionPtr conn, const std::vector<MessagePtr>& msgs)
+    {
+        for (const auto& msg : msgs)
+        {
+            HandleData(conn, msg);
+        }
+    }
+
+    /**
+     * @brief OnWritable called once the output of a connection whose send was
+     *        rejected with NET_WOULD_BLOCK drained below its low watermark.
+     *
+     * @param conn the writable connection
+     */
+    virtual void OnWritable(TCPConnectionPtr conn) {}
+
+    /**
+     * @brief OnStreamBegin called with the first chunk of a stream the peer sent with
+     *        TCPConnection::SendChunk, before it is passed to OnChunk
+     *
+     * @param conn the connection the stream arrives on
+     * @param header the header of the first chunk, _sequence is the stream id
+     */
+    virtual void OnStreamBegin(TCPConnectionPtr conn, const Header& header) {}
+
+    /**
+     * @brief OnChunk called with every chunk of a stream, in order. Only one chunk is
+     *        held at a time, a receiver which keeps the stream bounds its memory
+     *        itself. The default implementation forwards the chunk to HandleData.
+     *
+     * @param conn the connection the stream arrives on
+     * @param chunk the chunk, _sequence of its header is the stream id
+     */
+    virtual void OnChunk(TCPConnectionPtr conn, const MessagePtr chunk)
+    {
+        HandleData(conn, chunk);
+    }
+
+    /**
+     * @brief OnStreamEnd called after the last chunk of a stream
+     *
+     * @param conn the connection the stream arrived on
+     * @param streamID the stream id
+     * @param errcode NET_DISCONNECTED when the connection closed before the last chunk
+     */
+    virtual void OnStreamEnd(TCPConnectionPtr conn, uint64_t streamID, std::error_code errcode) {}
+
+    /**
+     * @brief OnFileBegin called with the header of a frame the peer sent with
+     *        TCPConnection::SendFile, before its payload is read. The payload is
+     *        written to the returned descriptor from its current position, spliced
+     *        from the socket on a plain connection; the descriptor must not be
+     *        opened with O_APPEND. The default implementation returns -1, the frame
+     *        is then delivered to HandleData like any other.
+     *
+     * @param conn the connection the file arrives on
+     * @param header the header of the frame, _dataSize is the file size
+     * @return int a writable descriptor which stays owned by the callback, or -1
+     */
+    virtual int OnFileBegin(TCPConnectionPtr conn, const Header& header)
+    {
+        return -1;
+    }
+
+    /**
+     * @brief OnFileEnd called once the payload was written to the descriptor of
+     *        OnFileBegin, which may be closed from now on
+     *
+     * @param conn the connection the file arrived on
+     * @param header the header of the frame
+     * @param errcode FILE_EXCEPTION when writing failed, NET_DISCONNECTED when the
+     *        connection closed first; the connection is closed in both cases
+     */
+    virtual void OnFileEnd(TCPConnectionPtr conn, const Header& header, std::error_code errcode) {}
+
+public:
+    /**
+     * @brief Dispatch hand the messages of one read event to HandleBatch and the
+     *        stream chunks among them to the stream callbacks, in order
+     *
+     * @param conn the connection the messages were read from
+     * @param msgs the decoded messages without the core messages
+     */
+    void Dispatch(TCPConnectionPtr conn, const std::vector<MessagePtr>& msgs);
+
+    /**
+     * @brief AbortStreams end the streams and the file still open on a closing connection
+     *
+     * @param conn the closing connection
+     */
+    void AbortStreams(TCPConnectionPtr conn);
+
+private:
+    void DispatchChunk(TCPConnectionPtr conn, const MessagePtr chunk);
 };
 
 using TCPHandlerCallbackFunctor = std::shared_ptr<TCPHandlerCallback>;
 
+/**
+ * @brief HandlerLoad the load of one handler, sampled once per timing wheel tick
+ */
+struct HandlerLoad
+{
+    std::size_t _connections       = 0;
+    uint64_t    _bytesPerSecond    = 0; // the bytes read
+    uint64_t    _messagesPerSecond = 0; // the frames decoded
+    double      _busyRatio         = 0; // the share of time the loop spent handling reads
+};
+
+/**
+ * @brief BusyPollConfig the loop polls without blocking while there is work and for
+ *        _spinUs after the last dispatched event, then parks in epoll_wait. It
+ *        trades one core per handler for the wakeup latency of small messages.
+ */
+struct BusyPollConfig
+{
+    bool _enable         = false;
+    int  _spinUs         = VIPER_NET_BUSY_POLL_SPIN_US_DFT;   // the spin budget before parking
+    int  _socketPollUs   = VIPER_NET_BUSY_POLL_SOCKET_US_DFT; // SO_BUSY_POLL of the accepted sockets, 0 skips it
+    bool _preferBusyPoll = true;                              // SO_PREFER_BUSY_POLL of the accepted sockets
+};
+
+/**
+ * @brief BusyPollStats the spin/park ratio is _spins / _parks, a low _spinHits
+ *        share means the budget mostly burns cpu
+ */
+struct BusyPollStats
+{
+    uint64_t _spins    = 0; // the non blocking loop iterations
+    uint64_t _spinHits = 0; // the iterations which dispatched an event
+    uint64_t _parks    = 0; // the blocking waits after the budget ran out
+};
+
 class TCPHandler final
 {
 public:
@@ -51,21 +207,84 @@ public:
 
 public:
     static void CheckConnectionState(evutil_socket_t fd, short events, void* ctx);
+    static void WakeupCallback(evutil_socket_t fd, short events, void* ctx);
+    static void AcceptCallback(evconnlistener* listener, evutil_socket_t fd, sockaddr* address, int socklen, void* ctx);
 
 public:
     static void ReadCallback(bufferevent* bev, void* ctx);
+    static void WriteCallback(bufferevent* bev, void* ctx);
     static void EventCallback(bufferevent* bev, short events, void* ctx);
 
 public:
-    void            SetTimeout(int timeoutSec);
-    void            SetCallback(TCPHandlerCallbackFunctor functor);
-    void            BindConnection(evutil_socket_t fd, sockaddr* address, int socklen);
-    std::error_code Start();
-    std::error_code Stop();
+    void             SetTimeout(int timeoutSec);
+    void             SetCallback(TCPHandlerCallbackFunctor functor);
+    void             SetBackpressure(const BackpressureConfig& config);
+    void             SetPriority(const PriorityConfig& config);
+    void             SetCompressor(CompressorPtr compressor);
+    void             SetChecksum(bool enable);
+    void             SetCompactHeader(bool enable);
+    void             SetCPUs(const std::vector<int>& cpus);
+    void             SetBackend(NetBackend backend);
+    void             SetBusyPoll(const BusyPollConfig& config);
+    void             SetTLS(TLSContextPtr tls);
+    void             BindConnection(evutil_socket_t fd, sockaddr* address, int socklen);
+    MessagePoolStats GetMessagePoolStats();
+    BusyPollStats    GetBusyPollStats();
+    HandlerLoad      Load();
+    std::error_code  Start();
+    std::error_code  Stop();
+
+    /**
+     * @brief Listen accept connections on a listening socket of this handler, bound
+     *        with SO_REUSEPORT so the kernel spreads the connections over every
+     *        handler listening on the same address. Must be called after Start.
+     *
+     * @param address the listen address
+     * @param socklen the address length
+     * @return std::error_code
+     */
+    std::error_code Listen(const sockaddr* address, int socklen);
+    evutil_socket_t ListenFd();
+
+    /**
+     * @brief RunInLoop run task on the event loop thread of this handler, it is
+     *        queued even when called from the loop thread itself
+     *
+     * @param task the task to run
+     */
+    void RunInLoop(std::function<void()> task);
+
+    /**
+     * @brief FindConnection look a connection of this handler up by its handle.
+     *        Called on the loop thread, like the callbacks.
+     *
+     * @param handle the handle of the connection
+     * @return TCPConnectionPtr nullptr when the connection is closed or moved away
+     */
+    TCPConnectionPtr FindConnection(ConnectionHandle handle);
+
+    /**
+     * @brief MigrateHottest move the connection which read the most since the last
+     *        migration to target, skipping connections reading more than maxBytes
+     *        per second so the hot spot is not just moved. Shared memory connections
+     *        stay on their loop. Called on the loop thread.
+     *
+     * @param target the handler to move the connection to
+     * @param maxBytesPerSecond the read rate limit of the moved connection
+     * @return true when a connection was moved, never with NetBackend::IO_URING
+     */
+    bool MigrateHottest(TCPHandler* target, uint64_t maxBytesPerSecond);
 
 private:
-    void Run();
-    bool ProcessCoreMessage(TCPConnectionPtr conn, MessagePtr msg);
+    void         Run();
+    void         RunBusyPoll();
+    void         SetBusyPollOptions(evutil_socket_t fd);
+    void         Bind(evutil_socket_t fd, sockaddr* address, int socklen);
+    bufferevent* OpenBufferEvent(evutil_socket_t fd, bool local);
+    void         CloseConnection(TCPConnection* conn, ConnectionState state);
+    void         Adopt(TCPConnectionPtr conn);
+    void         SampleLoad(uint64_t now);
+    bool         ProcessCoreMessage(TCPConnectionPtr conn, MessagePtr msg);
 
 private:
     timeval                   _timeoutSeconds            = {VIPER_NET_TCP_CONNECTION_TIMEOUT_SECOND_DFT, 0};
@@ -73,8 +292,57 @@ private:
     event*                    _checkConnectionStateEvent = nullptr;
     event_base*               _base                      = nullptr;
     std::future<void>         _asyncRun;
+    MessagePoolPtr            _messagePool               = nullptr;
+    std::vector<MessagePtr>   _batch;
+    BackpressureConfig        _backpressure;
+    PriorityConfig            _priority;
+    CompressorPtr             _compressor = nullptr;
+    bool                      _checksum   = false;
+    bool                      _compact    = false;
+    std::atomic_bool          _running    = false;
+    std::vector<int>          _cpus;                 // the loop thread is pinned to them when not empty
+    NetBackend                _backend    = NetBackend::LIBEVENT;
+    UringBackendPtr           _uring      = nullptr; // the socket I/O with NetBackend::IO_URING
+    ShmBackendPtr             _shm        = nullptr; // the I/O of same host connections, made on demand
+    TLSContextPtr             _tls        = nullptr; // shared by the handlers of a server
+
+    // the SO_REUSEPORT listening socket of this handler
+    evutil_socket_t _listenFd = EVUTIL_INVALID_SOCKET;
+    evconnlistener* _listener = nullptr;
+
+    // idle detection, connections are rescheduled on read and expire in their tick
+    std::unique_ptr<TimingWheel> _idleWheel      = nullptr;
+    uint64_t                     _wheelStartTime = 0;
+
+    // tasks posted from other threads, the eventfd wakes the loop up
+    evutil_socket_t                    _wakeupFd    = EVUTIL_INVALID_SOCKET;
+    event*                             _wakeupEvent = nullptr;
+    std::mutex                         _tasksMutex;
+    std::vector<std::function<void()>> _tasks;
+
+    // frames sent on the connections of this loop from other threads
+    OutboundQueue _outbound;
+
+    // the load figures, counted on the loop thread and published once per interval
+    uint64_t                 _readBytes         = 0;
+    uint64_t                 _readMessages      = 0;
+    uint64_t                 _busyTime          = 0; // microseconds
+    uint64_t                 _loadSampleTime    = 0; // milliseconds
+    uint64_t                 _migrationTime     = 0; // milliseconds
+    std::atomic<std::size_t> _connectionCount   = 0;
+    std::atomic<uint64_t>    _bytesPerSecond    = 0;
+    std::atomic<uint64_t>    _messagesPerSecond = 0;
+    std::atomic<double>      _busyRatio         = 0;
+
+    // busy polling, _dispatches counts the events the loop handled
+    BusyPollConfig        _busyPoll;
+    uint64_t              _dispatches = 0;
+    std::atomic<uint64_t> _spins      = 0;
+    std::atomic<uint64_t> _spinHits   = 0;
+    std::atomic<uint64_t> _parks      = 0;
 
-    container::SafeMap<std::string, TCPConnectionPtr> _connections;
+    // the connections of this loop, only touched on the loop thread
+    container::SlotMap<TCPConnectionPtr> _connections;
 };
 
 using TCPHandlerPtr = std::shared_ptr<TCPHandler>;
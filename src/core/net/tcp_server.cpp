@@ -5,18 +5,27 @@
 
 #include <event2/util.h>
 
-#include <cstring>
+#include <linux/filter.h>
 #include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
 #include <string>
+#include <thread>
 
 namespace viper {
 namespace net {
 
-TCPServer::TCPServer(const std::string& listenAddress, uint16_t port, int threadCount)
+TCPServer::TCPServer(const std::string& listenAddress, uint16_t port, int threadCount, NetBackend backend)
 {
     _listenAddress = listenAddress;
     _listenPort    = port;
     _threadCount   = threadCount;
+    _backend       = backend;
 }
 TCPServer::~TCPServer() {}
 
@@ -25,17 +34,98 @@ void TCPServer::AcceptCallback(struct evconnlistener* listener, evutil_socket_t
 {
     TCPServer* server = reinterpret_cast<TCPServer*>(ctx);
 
-    if (server->_handlers.empty())
+    auto handler = server->PickHandler();
+    if (!handler)
     {
         LOG_ERROR("do not set tcp server handler");
+        evutil_closesocket(fd);
         return;
     }
 
-    auto handlerIndex = server->_handlerIndex++ % server->_handlers.size();
-    auto handler      = server->_handlers.at(handlerIndex);
     handler->BindConnection(fd, address, socklen);
 }
 
+void TCPServer::RebalanceCallback(evutil_socket_t fd, short events, void* ctx)
+{
+    auto server = static_cast<TCPServer*>(ctx);
+    server->Rebalance();
+}
+
+TCPHandlerPtr TCPServer::PickHandler()
+{
+    std::lock_guard<std::mutex> lock(_handlersMutex);
+    if (_handlers.empty())
+    {
+        return nullptr;
+    }
+
+    if (_placement == PlacementPolicy::ROUND_ROBIN)
+    {
+        return _handlers[_handlerIndex++ % _handlers.size()];
+    }
+
+    // The busy ratios are compared in steps of a tenth, within a step the
+    // connection count decides; it is updated at once, the ratios once per tick.
+    TCPHandlerPtr best     = nullptr;
+    HandlerLoad   bestLoad;
+    for (auto& handler : _handlers)
+    {
+        auto load = handler->Load();
+        if (!best || (int)(load._busyRatio * 10) < (int)(bestLoad._busyRatio * 10) ||
+            ((int)(load._busyRatio * 10) == (int)(bestLoad._busyRatio * 10) && load._connections < bestLoad._connections))
+        {
+            best     = handler;
+            bestLoad = load;
+        }
+    }
+
+    return best;
+}
+
+void TCPServer::StopHandlers()
+{
+    std::vector<TCPHandlerPtr> handlers;
+    {
+        std::lock_guard<std::mutex> lock(_handlersMutex);
+        handlers.swap(_handlers);
+    }
+
+    for (auto& handler : handlers)
+    {
+        auto errcode = handler->Stop();
+        if (!error::IsSuccess(errcode))
+        {
+            LOG_WARN("failed to stop the tcp server handler. errcode:{}", errcode.value());
+        }
+    }
+}
+
+std::vector<int> TCPServer::SteeredCPUs(int index)
+{
+    // The steering program hands the connections processed on a cpu to the handler
+    // cpu % handlers, the handler runs on exactly those cpus. A handler beyond the
+    // cpu count gets no steered connections, it shares the cpu of index % cpus.
+    int              cpus = (int)std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int> steered;
+    for (int cpu = index; cpu < cpus; cpu += _threadCount)
+    {
+        steered.push_back(cpu);
+    }
+
+    if (steered.empty())
+    {
+        steered.push_back(index % cpus);
+    }
+
+    return steered;
+}
+
+std::vector<TCPHandlerPtr> TCPServer::Handlers()
+{
+    std::lock_guard<std::mutex> lock(_handlersMutex);
+    return _handlers;
+}
+
 void TCPServer::SetTimeout(int timeoutSec)
 {
     _timeoutSec = timeoutSec;
@@ -46,27 +136,198 @@ void TCPServer::SetCallback(TCPHandlerCallbackFunctor functor)
     _functor = functor;
 }
 
+void TCPServer::SetBackpressure(const BackpressureConfig& config)
+{
+    _backpressure = config;
+}
+
+void TCPServer::SetPriority(const PriorityConfig& config)
+{
+    _priority = config;
+}
+
+void TCPServer::SetCompression(const CompressionConfig& config)
+{
+    _compressor = config._enable ? std::make_shared<Compressor>(config) : nullptr;
+}
+
+void TCPServer::SetChecksum(bool enable)
+{
+    _checksum = enable;
+}
+
+void TCPServer::SetCompactHeader(bool enable)
+{
+    _compact = enable;
+}
+
+void TCPServer::SetReusePort(bool enable, bool cpuSteering)
+{
+    _reusePort   = enable;
+    _cpuSteering = enable && cpuSteering;
+}
+
+void TCPServer::SetPlacement(PlacementPolicy policy)
+{
+    _placement = policy;
+}
+
+void TCPServer::SetShmPath(const std::string& path)
+{
+    _shmPath = path;
+}
+
+std::error_code TCPServer::SetTLS(const TLSConfig& config)
+{
+    if (!config._enable)
+    {
+        _tls = nullptr;
+        return error::ErrorCode::SUCCESS;
+    }
+
+    auto tls     = std::make_shared<TLSContext>();
+    auto errcode = tls->Init(config, true);
+    if (!error::IsSuccess(errcode))
+    {
+        return errcode;
+    }
+
+    _tls = tls;
+    return error::ErrorCode::SUCCESS;
+}
+
+void TCPServer::SetBusyPoll(const BusyPollConfig& config)
+{
+    _busyPoll = config;
+}
+
+void TCPServer::SetRebalanceInterval(int intervalSec)
+{
+    _rebalanceInterval = intervalSec;
+}
+
+void TCPServer::Rebalance()
+{
+    auto handlers = Handlers();
+    if (handlers.size() < 2)
+    {
+        return;
+    }
+
+    std::vector<HandlerLoad> loads;
+    for (auto& handler : handlers)
+    {
+        loads.push_back(handler->Load());
+    }
+
+    std::size_t busiest = 0;
+    std::size_t idlest  = 0;
+    for (std::size_t idx = 1; idx < loads.size(); ++idx)
+    {
+        busiest = loads[idx]._busyRatio > loads[busiest]._busyRatio ? idx : busiest;
+        idlest  = loads[idx]._busyRatio < loads[idlest]._busyRatio ? idx : idlest;
+    }
+
+    if (loads[busiest]._busyRatio - loads[idlest]._busyRatio <= VIPER_NET_TCP_SERVER_REBALANCE_BUSY_GAP)
+    {
+        return;
+    }
+
+    // a connection carrying more than half the difference would only move the hot spot
+    uint64_t gap    = loads[busiest]._bytesPerSecond - std::min(loads[busiest]._bytesPerSecond, loads[idlest]._bytesPerSecond);
+    auto     source = handlers[busiest];
+    auto     target = handlers[idlest];
+    source->RunInLoop([source, target, gap]() { source->MigrateHottest(target.get(), gap / 2); });
+}
+
+std::vector<HandlerLoad> TCPServer::GetHandlerLoads()
+{
+    std::vector<HandlerLoad> loads;
+    for (auto& handler : Handlers())
+    {
+        loads.push_back(handler->Load());
+    }
+
+    return loads;
+}
+
+std::vector<MessagePoolStats> TCPServer::GetMessagePoolStats()
+{
+    std::vector<MessagePoolStats> stats;
+    for (auto& handler : Handlers())
+    {
+        stats.push_back(handler->GetMessagePoolStats());
+    }
+
+    return stats;
+}
+
+std::vector<BusyPollStats> TCPServer::GetBusyPollStats()
+{
+    std::vector<BusyPollStats> stats;
+    for (auto& handler : Handlers())
+    {
+        stats.push_back(handler->GetBusyPollStats());
+    }
+
+    return stats;
+}
+
+CompressionStats TCPServer::GetCompressionStats()
+{
+    return _compressor ? _compressor->Stats() : CompressionStats();
+}
+
+TLSStats TCPServer::GetTLSStats()
+{
+    return _tls ? _tls->Stats() : TLSStats();
+}
+
 std::error_code TCPServer::Run()
 {
+    std::vector<TCPHandlerPtr> handlers;
     for (int i = 0; i < _threadCount; ++i)
     {
         auto handler = std::make_shared<TCPHandler>();
         handler->SetTimeout(_timeoutSec);
         handler->SetCallback(_functor);
+        handler->SetBackpressure(_backpressure);
+        handler->SetPriority(_priority);
+        handler->SetCompressor(_compressor);
+        handler->SetChecksum(_checksum);
+        handler->SetCompactHeader(_compact);
+        handler->SetBackend(_backend);
+        handler->SetBusyPoll(_busyPoll);
+        handler->SetTLS(_tls);
+        if (_cpuSteering)
+        {
+            handler->SetCPUs(SteeredCPUs(i));
+        }
+
         auto errcode = handler->Start();
         if (!error::IsSuccess(errcode))
         {
             LOG_ERROR("failed to create tcp server handler. errcode:{}", errcode.value());
+            for (auto& started : handlers)
+            {
+                started->Stop();
+            }
             return errcode;
         }
 
-        _handlers.push_back(handler);
+        handlers.push_back(handler);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_handlersMutex);
+        _handlers = handlers;
     }
 
     _base = event_base_new();
     if (!_base)
     {
         LOG_ERROR("failed to create event base");
+        StopHandlers();
         return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
     }
 
@@ -82,32 +343,42 @@ std::error_code TCPServer::Run()
     if (evutil_getaddrinfo(_listenAddress.c_str(), port.c_str(), &hints, &serviceInfo))
     {
         LOG_ERROR("failed to get the service info. listen address:{}, listen port:{}", _listenAddress, port);
+        StopHandlers();
         event_base_free(_base);
         _base = nullptr;
         return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
     }
 
-    evutil_addrinfo* p = nullptr;
-    for (p = serviceInfo; p != nullptr; p = p->ai_next)
+    auto errcode = _reusePort ? ListenReusePort(serviceInfo) : Listen(serviceInfo);
+    freeaddrinfo(serviceInfo);
+
+    if (error::IsSuccess(errcode) && !_shmPath.empty())
     {
-        _listener = evconnlistener_new_bind(_base, AcceptCallback, this,
-                                            LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, -1,
-                                            p->ai_addr, p->ai_addrlen);
-        if (_listener)
-        {
-            break;
-        }
+        errcode = ListenShm();
     }
-    freeaddrinfo(serviceInfo);
 
-    if (!_listener)
+    if (!error::IsSuccess(errcode))
     {
         LOG_ERROR("failed to create listener");
 
+        if (_listener)
+        {
+            evconnlistener_free(_listener);
+            _listener = nullptr;
+        }
+
+        // the handlers which joined the reuseport group already would keep accepting
+        StopHandlers();
         event_base_free(_base);
         _base = nullptr;
-        freeaddrinfo(serviceInfo);
-        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+        return errcode;
+    }
+
+    if (_rebalanceInterval > 0)
+    {
+        timeval interval = {_rebalanceInterval, 0};
+        _rebalanceEvent  = event_new(_base, -1, EV_PERSIST, &TCPServer::RebalanceCallback, this);
+        evtimer_add(_rebalanceEvent, &interval);
     }
 
     // start the event loop
@@ -118,31 +389,163 @@ std::error_code TCPServer::Run()
 
     LOG_WARN("tcp server listener run exited. exited code:{}", exitedCode);
 
-    evconnlistener_free(_listener);
+    if (_listener)
+    {
+        evconnlistener_free(_listener);
+    }
+
+    if (_shmListener)
+    {
+        evconnlistener_free(_shmListener);
+        unlink(_shmPath.c_str());
+    }
+
+    if (_rebalanceEvent)
+    {
+        event_free(_rebalanceEvent);
+    }
     event_base_free(_base);
 
-    _base     = nullptr;
-    _listener = nullptr;
+    _base           = nullptr;
+    _listener       = nullptr;
+    _shmListener    = nullptr;
+    _rebalanceEvent = nullptr;
 
     return error::ErrorCode::SUCCESS;
 }
 
-std::error_code TCPServer::Close()
+std::error_code TCPServer::Listen(evutil_addrinfo* serviceInfo)
 {
-    if (!_base)
+    for (evutil_addrinfo* p = serviceInfo; p != nullptr; p = p->ai_next)
     {
-        return error::ErrorCode::SUCCESS;
+        _listener = evconnlistener_new_bind(_base, AcceptCallback, this,
+                                            LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, -1,
+                                            p->ai_addr, p->ai_addrlen);
+        if (_listener)
+        {
+            return error::ErrorCode::SUCCESS;
+        }
     }
 
-    for (auto& handler : _handlers)
+    return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+}
+
+std::error_code TCPServer::ListenReusePort(evutil_addrinfo* serviceInfo)
+{
+    auto handlers = Handlers();
+    if (handlers.empty())
     {
-        auto errcode = handler->Stop();
-        if (!error::IsSuccess(errcode))
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    // every handler binds the first address the first handler could bind
+    for (evutil_addrinfo* p = serviceInfo; p != nullptr; p = p->ai_next)
+    {
+        if (!error::IsSuccess(handlers.front()->Listen(p->ai_addr, p->ai_addrlen)))
         {
-            LOG_WARN("failed to stop the tcp server handler. errcode:{}", errcode.value());
+            continue;
+        }
+
+        for (std::size_t idx = 1; idx < handlers.size(); ++idx)
+        {
+            auto errcode = handlers[idx]->Listen(p->ai_addr, p->ai_addrlen);
+            if (!error::IsSuccess(errcode))
+            {
+                return errcode;
+            }
+        }
+
+        if (_cpuSteering)
+        {
+            AttachCPUSteering();
         }
+
+        LOG_INFO("{} tcp server handlers listen with SO_REUSEPORT. cpu steering:{}", handlers.size(), _cpuSteering);
+        return error::ErrorCode::SUCCESS;
+    }
+
+    return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+}
+
+std::error_code TCPServer::ListenShm()
+{
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (_shmPath.size() >= sizeof(address.sun_path))
+    {
+        LOG_ERROR("the shared memory socket path is too long. path:{}", _shmPath);
+        return error::ErrorCode::INVALID_PARAMETER;
+    }
+    memcpy(address.sun_path, _shmPath.c_str(), _shmPath.size());
+
+    // left behind by a server which did not exit cleanly
+    unlink(_shmPath.c_str());
+
+    evutil_socket_t fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        LOG_ERROR("failed to create the shared memory socket. path:{}, errno:{}", _shmPath, errno);
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    // A client maps the rings of the connection, so only the user of the server may
+    // connect. The socket file takes the mode of the socket when it is bound, which
+    // leaves no window where it is open to others.
+    if (fchmod(fd, S_IRUSR | S_IWUSR) != 0 || bind(fd, (sockaddr*)&address, sizeof(address)) != 0)
+    {
+        LOG_ERROR("failed to bind the shared memory socket. path:{}, errno:{}", _shmPath, errno);
+        evutil_closesocket(fd);
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    // the accepted sockets go to the handlers like the tcp ones, which set up the rings
+    _shmListener = evconnlistener_new(_base, AcceptCallback, this, LEV_OPT_CLOSE_ON_FREE, -1, fd);
+    if (!_shmListener)
+    {
+        LOG_ERROR("failed to listen on the shared memory socket. path:{}, errno:{}", _shmPath, errno);
+        evutil_closesocket(fd);
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    LOG_INFO("tcp server accepts shared memory clients. path:{}", _shmPath);
+    return error::ErrorCode::SUCCESS;
+}
+
+void TCPServer::AttachCPUSteering()
+{
+    auto handlers = Handlers();
+
+    // The sockets of a reuseport group are indexed in the order they started
+    // listening, which is the handler order; the program picks the handler of
+    // the cpu the connection is processed on, the one SteeredCPUs pinned there.
+    // Every handler started, so the group has _threadCount sockets.
+    sock_filter code[] = {
+        {BPF_LD | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU)},
+        {BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)_threadCount},
+        {BPF_RET | BPF_A, 0, 0, 0},
+    };
+
+    sock_fprog program;
+    program.len    = sizeof(code) / sizeof(code[0]);
+    program.filter = code;
+
+    // a failure is not fatal, the kernel keeps hashing the connections over the group
+    auto fd = handlers.front()->ListenFd();
+    if (setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &program, sizeof(program)) != 0)
+    {
+        LOG_WARN("failed to attach the reuseport cpu steering program. errno:{}", errno);
+    }
+}
+
+std::error_code TCPServer::Close()
+{
+    if (!_base)
+    {
+        return error::ErrorCode::SUCCESS;
     }
-    _handlers.clear();
+
+    StopHandlers();
 
     event_base_loopbreak(_base);
     return error::ErrorCode::SUCCESS;
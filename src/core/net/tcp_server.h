@@ -26,26 +26,139 @@
 #include <cstdint>
 #include <event2/util.h>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 namespace viper {
 namespace net {
 
+// clang-format off
+
+#define VIPER_NET_TCP_SERVER_REBALANCE_BUSY_GAP 0.2
+
+// clang-format on
+
+enum class PlacementPolicy : int
+{
+    ROUND_ROBIN,  // the handlers take turns
+    LEAST_LOADED, // the handler with the lowest busy ratio, then the fewest connections
+};
+
+/**
+ * @brief TCPServer the libevent backend writes to the sockets with writev, which raises
+ *        SIGPIPE when the client dropped the connection. The process disposition is
+ *        left to the application, which ignores SIGPIPE, e.g. with
+ *        signal(SIGPIPE, SIG_IGN), unless it handles the signal itself. The
+ *        io_uring and shared memory backends send with MSG_NOSIGNAL.
+ */
 class TCPServer final
 {
 public:
-    TCPServer(const std::string& listenAddress, uint16_t port, int threadCount = 3);
+    /**
+     * @brief TCPServer
+     *
+     * @param listenAddress the listen address
+     * @param port the listen port
+     * @param threadCount the number of tcp handlers
+     * @param backend the socket I/O of the handlers, the callbacks are the same with both
+     */
+    TCPServer(const std::string& listenAddress, uint16_t port, int threadCount = 3,
+              NetBackend backend = NetBackend::LIBEVENT);
     ~TCPServer();
 
 public:
     static void AcceptCallback(struct evconnlistener* listener, evutil_socket_t fd,
                                sockaddr* address, int socklen, void* ctx);
+    static void RebalanceCallback(evutil_socket_t fd, short events, void* ctx);
 
 public:
-    void            SetTimeout(int timeoutSec);
-    void            SetCallback(TCPHandlerCallbackFunctor functor);
-    std::error_code Run();
-    std::error_code Close();
+    void                          SetTimeout(int timeoutSec);
+    void                          SetCallback(TCPHandlerCallbackFunctor functor);
+    void                          SetBackpressure(const BackpressureConfig& config);
+    void                          SetPriority(const PriorityConfig& config);
+    void                          SetCompression(const CompressionConfig& config);
+    void                          SetChecksum(bool enable);
+    void                          SetCompactHeader(bool enable);
+
+    /**
+     * @brief SetReusePort let every handler accept on its own SO_REUSEPORT socket
+     *        instead of the single listener thread, the kernel spreads the
+     *        connections over the handlers. With cpuSteering the handler threads
+     *        are pinned to cpus and a connection goes to the handler of the cpu
+     *        it arrived on, the handler i takes the cpus i, i + handlers and so on.
+     *
+     * @param enable
+     * @param cpuSteering attach a SO_ATTACH_REUSEPORT_CBPF program
+     */
+    void SetReusePort(bool enable, bool cpuSteering = false);
+
+    void SetPlacement(PlacementPolicy policy);
+
+    /**
+     * @brief SetShmPath also accept same host clients on a UNIX socket at path, their
+     *        frames go through shared memory rings instead of the network stack.
+     *        They reach the same callbacks as the tcp connections, see
+     *        TCPClient::ConnectShm.
+     *
+     * @param path the socket path, an existing file is replaced, only the user of
+     *        the server may connect to it
+     */
+    void SetShmPath(const std::string& path);
+
+    /**
+     * @brief SetTLS accept the tcp clients over TLS. The handlers share one session
+     *        cache and ticket key, so a reconnecting client resumes its session on
+     *        any of them. The shared memory clients stay on the plain socket.
+     *
+     * @param config the certificate and the session settings, disabled by default
+     * @return std::error_code FILE_EXCEPTION when the certificate can not be loaded
+     */
+    std::error_code SetTLS(const TLSConfig& config);
+
+    /**
+     * @brief SetBusyPoll let the handler loops spin before they park, best combined
+     *        with SetReusePort(true, true) so every handler owns a core
+     *
+     * @param config the spin budget and the socket options
+     */
+    void SetBusyPoll(const BusyPollConfig& config);
+
+    /**
+     * @brief SetRebalanceInterval call Rebalance periodically
+     *
+     * @param intervalSec the interval in seconds, 0 disables it
+     */
+    void SetRebalanceInterval(int intervalSec);
+
+    /**
+     * @brief Rebalance move one hot connection from the busiest handler to the least
+     *        busy one, when their busy ratios differ by more than
+     *        VIPER_NET_TCP_SERVER_REBALANCE_BUSY_GAP. The connection keeps its
+     *        socket and buffered data, only its event loop changes.
+     */
+    void Rebalance();
+
+    std::vector<HandlerLoad>      GetHandlerLoads();
+    std::vector<MessagePoolStats> GetMessagePoolStats();
+    std::vector<BusyPollStats>    GetBusyPollStats();
+    CompressionStats              GetCompressionStats();
+    TLSStats                      GetTLSStats();
+    std::error_code               Run();
+    std::error_code               Close();
+
+private:
+    std::error_code Listen(evutil_addrinfo* serviceInfo);
+    std::error_code ListenReusePort(evutil_addrinfo* serviceInfo);
+    std::error_code ListenShm();
+    void            AttachCPUSteering();
+    TCPHandlerPtr   PickHandler();
+    void            StopHandlers();
+
+    // the cpus the handler at index is pinned to with cpu steering
+    std::vector<int> SteeredCPUs(int index);
+
+    // a copy of the handlers, safe on any thread while Run starts them or Close clears them
+    std::vector<TCPHandlerPtr> Handlers();
 
 private:
     int         _timeoutSec  = VIPER_NET_TCP_CONNECTION_TIMEOUT_SECOND_DFT;
@@ -53,11 +166,29 @@ private:
     std::string _listenAddress;
     uint16_t    _listenPort = 0;
 
-    TCPHandlerCallbackFunctor _functor  = nullptr;
-    event_base*               _base     = nullptr;
-    evconnlistener*           _listener = nullptr;
+    BackpressureConfig        _backpressure;
+    PriorityConfig            _priority;
+    CompressorPtr             _compressor  = nullptr;
+    TLSContextPtr             _tls         = nullptr;
+    bool                      _checksum    = false;
+    bool                      _compact     = false;
+    bool                      _reusePort   = false; // a SO_REUSEPORT listener per handler
+    bool                      _cpuSteering = false;
+    NetBackend                _backend     = NetBackend::LIBEVENT;
+    BusyPollConfig            _busyPoll;
+    TCPHandlerCallbackFunctor _functor     = nullptr;
+    event_base*               _base        = nullptr;
+    evconnlistener*           _listener    = nullptr;
+    std::string               _shmPath;
+    evconnlistener*           _shmListener = nullptr; // the UNIX socket of the shared memory clients
+
+    PlacementPolicy _placement         = PlacementPolicy::LEAST_LOADED;
+    int             _rebalanceInterval = 0;
+    event*          _rebalanceEvent    = nullptr;
 
+    // published by Run once every handler started, read by the stats of any thread
     std::atomic_uint64_t       _handlerIndex = 0;
+    std::mutex                 _handlersMutex;
     std::vector<TCPHandlerPtr> _handlers;
 };
 
@@ -0,0 +1,145 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#include "core/net/timing_wheel.h"
+
+#include <algorithm>
+
+namespace viper {
+namespace net {
+
+TimingWheel::TimingWheel(uint64_t timeoutTicks)
+{
+    // tick 0 marks an unscheduled node, so the smallest timeout is one tick
+    _timeout = std::max<uint64_t>(timeoutTicks, 1);
+
+    uint64_t size = 1;
+    while (size <= _timeout)
+    {
+        size <<= 1;
+    }
+
+    _mask = size - 1;
+    _now  = 1;
+    _slots.resize(size);
+    for (auto& head : _slots)
+    {
+        head._prev = &head;
+        head._next = &head;
+    }
+}
+
+void TimingWheel::Link(TimerNode* head, TimerNode* node)
+{
+    node->_prev        = head->_prev;
+    node->_next        = head;
+    head->_prev->_next = node;
+    head->_prev        = node;
+}
+
+void TimingWheel::Unlink(TimerNode* node)
+{
+    node->_prev->_next = node->_next;
+    node->_next->_prev = node->_prev;
+    node->_prev        = nullptr;
+    node->_next        = nullptr;
+}
+
+void TimingWheel::Schedule(TimerNode* node)
+{
+    uint64_t expire = _now + _timeout;
+    if (node->_expire == expire)
+    {
+        return;
+    }
+
+    if (node->_expire != 0)
+    {
+        Unlink(node);
+        --_count;
+    }
+
+    node->_expire = expire;
+    Link(&_slots[expire & _mask], node);
+    ++_count;
+}
+
+void TimingWheel::Cancel(TimerNode* node)
+{
+    if (0 == node->_expire)
+    {
+        return;
+    }
+
+    Unlink(node);
+    node->_expire = 0;
+    --_count;
+}
+
+std::size_t TimingWheel::Advance(uint64_t now, const std::function<void(TimerNode*)>& expired)
+{
+    if (now <= _now)
+    {
+        return 0;
+    }
+
+    // after a stall longer than one round every slot is visited once
+    uint64_t    steps   = std::min(now - _now, _mask + 1);
+    std::size_t expires = 0;
+    for (uint64_t tick = _now + 1; tick <= _now + steps; ++tick)
+    {
+        TimerNode& head = _slots[tick & _mask];
+
+        // the due nodes are moved out first, the callback may cancel any of them
+        TimerNode due;
+        due._prev = &due;
+        due._next = &due;
+        for (TimerNode* node = head._next; node != &head;)
+        {
+            TimerNode* next = node->_next;
+            if (node->_expire <= now)
+            {
+                Unlink(node);
+                Link(&due, node);
+            }
+            node = next;
+        }
+
+        while (due._next != &due)
+        {
+            TimerNode* node = due._next;
+            Cancel(node);
+            expired(node);
+            ++expires;
+        }
+    }
+
+    _now = now;
+    return expires;
+}
+
+uint64_t TimingWheel::Now()
+{
+    return _now;
+}
+
+std::size_t TimingWheel::Count()
+{
+    return _count;
+}
+
+} // namespace net
+} // namespace viper
@@ -0,0 +1,108 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#ifndef _VIPER_CORE_NET_TIMING_WHEEL_H_
+#define _VIPER_CORE_NET_TIMING_WHEEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace viper {
+namespace net {
+
+// clang-format off
+
+#define VIPER_NET_TIMING_WHEEL_TICK_MS 1000
+
+// clang-format on
+
+/**
+ * @brief TimerNode the intrusive link of an object in a TimingWheel, embedded
+ *        in the object it times out.
+ */
+struct TimerNode
+{
+    TimerNode* _prev   = nullptr;
+    TimerNode* _next   = nullptr;
+    uint64_t   _expire = 0; // the tick the node expires at, 0 when it is not scheduled
+    void*      _owner  = nullptr;
+};
+
+/**
+ * @brief TimingWheel a hashed timing wheel for one fixed timeout.
+ *
+ * Every node expires exactly timeout ticks after it was last scheduled, so the
+ * wheel only needs more slots than the timeout to hold every deadline in a
+ * single round. Scheduling, rescheduling and cancelling are O(1) list splices,
+ * and advancing one tick only visits the nodes which expire in it.
+ *
+ * The wheel is not thread safe, it belongs to one event loop.
+ */
+class TimingWheel final
+{
+public:
+    explicit TimingWheel(uint64_t timeoutTicks);
+
+    TimingWheel(const TimingWheel&)            = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+public:
+    /**
+     * @brief Schedule (re)arm node to expire timeout ticks from now, a node which
+     *        already expires in that tick is left in place
+     *
+     * @param node the node to schedule
+     */
+    void Schedule(TimerNode* node);
+
+    /**
+     * @brief Cancel remove node from the wheel, nothing happens if it is not scheduled
+     *
+     * @param node the node to cancel
+     */
+    void Cancel(TimerNode* node);
+
+    /**
+     * @brief Advance move the wheel to tick now. Every node due is cancelled before
+     *        it is passed to expired, which may schedule or cancel any node.
+     *
+     * @param now the current tick
+     * @param expired called once per expired node
+     * @return std::size_t the number of expired nodes
+     */
+    std::size_t Advance(uint64_t now, const std::function<void(TimerNode*)>& expired);
+
+    uint64_t    Now();
+    std::size_t Count();
+
+private:
+    static void Link(TimerNode* head, TimerNode* node);
+    static void Unlink(TimerNode* node);
+
+private:
+    std::vector<TimerNode> _slots; // the list heads, circular
+    uint64_t               _mask    = 0;
+    uint64_t               _timeout = 0;
+    uint64_t               _now     = 0;
+    std::size_t            _count   = 0;
+};
+
+} // namespace net
+} // namespace viper
+
+#endif
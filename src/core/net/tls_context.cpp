@@ -0,0 +1,282 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#include "core/net/tls_context.h"
+#include "core/assist/time.h"
+#include "core/error/error.h"
+#include "core/log/log.h"
+
+#include <openssl/err.h>
+#include <openssl/x509v3.h>
+
+#include <arpa/inet.h>
+
+namespace viper {
+namespace net {
+
+namespace {
+
+std::string LastError()
+{
+    char reason[256] = {0};
+    ERR_error_string_n(ERR_get_error(), reason, sizeof(reason));
+    return reason;
+}
+
+} // namespace
+
+// kept with the SSL, so a connection closed before its handshake completed is counted
+struct TLSContext::Handshake
+{
+    TLSContext* _context = nullptr;
+    uint64_t    _start   = 0; // microseconds
+    bool        _done    = false;
+};
+
+TLSContext::~TLSContext()
+{
+    if (_session)
+    {
+        SSL_SESSION_free(_session);
+        _session = nullptr;
+    }
+
+    if (_ctx)
+    {
+        SSL_CTX_free(_ctx);
+        _ctx = nullptr;
+    }
+}
+
+std::string TLSContext::ErrorString(bufferevent* bev)
+{
+    unsigned long code = bufferevent_get_openssl_error(bev);
+    if (0 == code)
+    {
+        return "";
+    }
+
+    char reason[256] = {0};
+    ERR_error_string_n(code, reason, sizeof(reason));
+    return reason;
+}
+
+std::error_code TLSContext::Init(const TLSConfig& config, bool server)
+{
+    _server     = server;
+    _verifyPeer = config._verifyPeer;
+    _serverName = config._serverName;
+
+    _ctx = SSL_CTX_new(server ? TLS_server_method() : TLS_client_method());
+    if (!_ctx)
+    {
+        LOG_ERROR("failed to create the tls context. error:{}", LastError());
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    SSL_CTX_set_min_proto_version(_ctx, TLS1_2_VERSION);
+    SSL_CTX_set_app_data(_ctx, this);
+
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    // a peer closing without close_notify ends the connection like on a plain socket
+    SSL_CTX_set_options(_ctx, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+
+    if (server && config._certFile.empty())
+    {
+        LOG_ERROR("the tls server needs a certificate");
+        return error::ErrorCode::INVALID_PARAMETER;
+    }
+
+    if (!config._certFile.empty())
+    {
+        if (SSL_CTX_use_certificate_chain_file(_ctx, config._certFile.c_str()) != 1 ||
+            SSL_CTX_use_PrivateKey_file(_ctx, config._keyFile.c_str(), SSL_FILETYPE_PEM) != 1 ||
+            SSL_CTX_check_private_key(_ctx) != 1)
+        {
+            LOG_ERROR("failed to load the tls certificate. certificate:{}, key:{}, error:{}", config._certFile,
+                      config._keyFile, LastError());
+            return error::ErrorCode::FILE_EXCEPTION;
+        }
+    }
+
+    bool verify = server ? !config._caFile.empty() : config._verifyPeer;
+    if (verify)
+    {
+        int loaded = config._caFile.empty() ? SSL_CTX_set_default_verify_paths(_ctx)
+                                            : SSL_CTX_load_verify_locations(_ctx, config._caFile.c_str(), nullptr);
+        if (loaded != 1)
+        {
+            LOG_ERROR("failed to load the tls ca. ca:{}, error:{}", config._caFile, LastError());
+            return error::ErrorCode::FILE_EXCEPTION;
+        }
+
+        SSL_CTX_set_verify(_ctx, server ? SSL_VERIFY_PEER | SSL_VERIFY_FAIL_IF_NO_PEER_CERT : SSL_VERIFY_PEER, nullptr);
+    }
+
+    if (server)
+    {
+        // one cache and one ticket key for every handler, the tickets need no cache lookup
+        static const unsigned char sessionContext[] = "viper";
+        SSL_CTX_set_session_id_context(_ctx, sessionContext, sizeof(sessionContext) - 1);
+        SSL_CTX_set_session_cache_mode(_ctx, SSL_SESS_CACHE_SERVER);
+        SSL_CTX_sess_set_cache_size(_ctx, config._sessionCacheSize);
+        SSL_CTX_set_timeout(_ctx, config._sessionTimeoutSec);
+    }
+    else
+    {
+        // with TLS 1.3 the session arrives after the handshake, the callback keeps it
+        SSL_CTX_set_session_cache_mode(_ctx, SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+        SSL_CTX_sess_set_new_cb(_ctx, &TLSContext::NewSessionCallback);
+    }
+
+    return error::ErrorCode::SUCCESS;
+}
+
+SSL* TLSContext::NewSSL(const std::string& host)
+{
+    SSL* ssl = SSL_new(_ctx);
+    if (!ssl)
+    {
+        LOG_ERROR("failed to create the tls state. error:{}", LastError());
+        return nullptr;
+    }
+
+    auto handshake      = new Handshake();
+    handshake->_context = this;
+    handshake->_start   = assist::TimestampTickCountMicrosecond();
+    SSL_set_ex_data(ssl, HandshakeIndex(), handshake);
+
+    if (_server)
+    {
+        return ssl;
+    }
+
+    // an address is checked against the certificate as such, a name is sent with SNI as well
+    std::string name = _serverName.empty() ? host : _serverName;
+    in6_addr    address;
+    bool        literal = inet_pton(AF_INET, name.c_str(), &address) == 1 ||
+                          inet_pton(AF_INET6, name.c_str(), &address) == 1;
+    if (!literal && !name.empty())
+    {
+        SSL_set_tlsext_host_name(ssl, name.c_str());
+    }
+
+    if (_verifyPeer && !name.empty())
+    {
+        if (literal)
+        {
+            X509_VERIFY_PARAM_set1_ip_asc(SSL_get0_param(ssl), name.c_str());
+        }
+        else
+        {
+            SSL_set1_host(ssl, name.c_str());
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(_sessionMutex);
+    if (_session)
+    {
+        SSL_set_session(ssl, _session);
+    }
+
+    return ssl;
+}
+
+void TLSContext::OnHandshake(SSL* ssl)
+{
+    auto handshake = static_cast<Handshake*>(SSL_get_ex_data(ssl, HandshakeIndex()));
+    if (!handshake || handshake->_done)
+    {
+        return;
+    }
+
+    handshake->_done = true;
+    uint64_t elapsed = assist::TimestampTickCountMicrosecond() - handshake->_start;
+
+    _handshakes++;
+    _handshakeTimeUs += elapsed;
+    if (SSL_session_reused(ssl))
+    {
+        _resumed++;
+    }
+
+    uint64_t max = _maxHandshakeTimeUs.load(std::memory_order_relaxed);
+    while (elapsed > max && !_maxHandshakeTimeUs.compare_exchange_weak(max, elapsed, std::memory_order_relaxed))
+    {
+    }
+
+    LOG_DEBUG("tls handshake completed. version:{}, resumed:{}, elapsed us:{}", SSL_get_version(ssl),
+              SSL_session_reused(ssl), elapsed);
+}
+
+TLSStats TLSContext::Stats()
+{
+    TLSStats stats;
+    stats._handshakes         = _handshakes.load(std::memory_order_relaxed);
+    stats._resumed            = _resumed.load(std::memory_order_relaxed);
+    stats._failures           = _failures.load(std::memory_order_relaxed);
+    stats._handshakeTimeUs    = _handshakeTimeUs.load(std::memory_order_relaxed);
+    stats._maxHandshakeTimeUs = _maxHandshakeTimeUs.load(std::memory_order_relaxed);
+    return stats;
+}
+
+int TLSContext::NewSessionCallback(SSL* ssl, SSL_SESSION* session)
+{
+    auto context = static_cast<TLSContext*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+
+    // A copy is kept, freeing the connection without a close_notify marks its own
+    // session as not resumable, and libevent may free it after the next connect.
+    SSL_SESSION* copy = SSL_SESSION_dup(session);
+    if (!copy)
+    {
+        return 0;
+    }
+
+    std::lock_guard<std::mutex> lock(context->_sessionMutex);
+    if (context->_session)
+    {
+        SSL_SESSION_free(context->_session);
+    }
+
+    context->_session = copy;
+    return 0;
+}
+
+void TLSContext::FreeHandshake(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int idx, long argl, void* argp)
+{
+    auto handshake = static_cast<Handshake*>(ptr);
+    if (!handshake)
+    {
+        return;
+    }
+
+    if (!handshake->_done)
+    {
+        handshake->_context->_failures++;
+    }
+
+    delete handshake;
+}
+
+int TLSContext::HandshakeIndex()
+{
+    static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, &TLSContext::FreeHandshake);
+    return index;
+}
+
+} // namespace net
+} // namespace viper
@@ -0,0 +1,138 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#ifndef _VIPER_CORE_NET_TLS_CONTEXT_H_
+#define _VIPER_CORE_NET_TLS_CONTEXT_H_
+
+#include <openssl/ssl.h>
+
+#include <event2/bufferevent.h>
+#include <event2/bufferevent_ssl.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+
+namespace viper {
+namespace net {
+
+// clang-format off
+
+#define VIPER_NET_TLS_SESSION_CACHE_SIZE_DFT  20480
+#define VIPER_NET_TLS_SESSION_TIMEOUT_SEC_DFT 7200
+
+// clang-format on
+
+struct TLSConfig
+{
+    bool        _enable            = false;
+    bool        _verifyPeer        = true; // the client checks the server certificate and name
+    int         _sessionCacheSize  = VIPER_NET_TLS_SESSION_CACHE_SIZE_DFT;
+    int         _sessionTimeoutSec = VIPER_NET_TLS_SESSION_TIMEOUT_SEC_DFT;
+    std::string _certFile;   // PEM, the own certificate chain, required by the server
+    std::string _keyFile;    // PEM, the key of the own certificate
+    std::string _caFile;     // PEM, the server asks for client certificates when set
+    std::string _serverName; // the name the client sends and checks, the remote address by default
+};
+
+struct TLSStats
+{
+    uint64_t _handshakes         = 0; // completed handshakes
+    uint64_t _resumed            = 0; // of them abbreviated with a resumed session
+    uint64_t _failures           = 0; // connections closed before their handshake completed
+    uint64_t _handshakeTimeUs    = 0; // summed from accept or connect to completion
+    uint64_t _maxHandshakeTimeUs = 0;
+};
+
+/**
+ * @brief TLSContext the TLS settings and sessions shared by the connections of a
+ *        TCPServer or a TCPClient.
+ *
+ * The server keeps one session cache and one ticket key for all of its handlers,
+ * so a client resumes on whichever handler it lands. The client keeps the last
+ * session the server issued and offers it on the next connect, which makes the
+ * handshake after a reconnect an abbreviated one.
+ */
+class TLSContext final
+{
+public:
+    TLSContext() = default;
+    ~TLSContext();
+
+    TLSContext(const TLSContext&)            = delete;
+    TLSContext& operator=(const TLSContext&) = delete;
+
+public:
+    /**
+     * @brief ErrorString the reason of the last TLS error of a bufferevent
+     *
+     * @param bev the bufferevent of a connection
+     * @return std::string empty when there was none
+     */
+    static std::string ErrorString(bufferevent* bev);
+
+public:
+    std::error_code Init(const TLSConfig& config, bool server);
+
+    /**
+     * @brief NewSSL the state of one connection, owned by its bufferevent
+     *
+     * @param host the remote host the client checks the certificate against
+     * @return SSL* nullptr on failure
+     */
+    SSL* NewSSL(const std::string& host = "");
+
+    /**
+     * @brief OnHandshake count a completed handshake, called on BEV_EVENT_CONNECTED
+     *
+     * @param ssl the state of the connection
+     */
+    void     OnHandshake(SSL* ssl);
+    TLSStats Stats();
+
+private:
+    struct Handshake;
+
+    static int  NewSessionCallback(SSL* ssl, SSL_SESSION* session);
+    static void FreeHandshake(void* parent, void* ptr, CRYPTO_EX_DATA* ad, int idx, long argl, void* argp);
+    static int  HandshakeIndex();
+
+private:
+    SSL_CTX*    _ctx        = nullptr;
+    bool        _server     = false;
+    bool        _verifyPeer = false;
+    std::string _serverName;
+
+    // the session the client resumes, replaced by every new one the server issues
+    std::mutex   _sessionMutex;
+    SSL_SESSION* _session = nullptr;
+
+    std::atomic<uint64_t> _handshakes         = 0;
+    std::atomic<uint64_t> _resumed            = 0;
+    std::atomic<uint64_t> _failures           = 0;
+    std::atomic<uint64_t> _handshakeTimeUs    = 0;
+    std::atomic<uint64_t> _maxHandshakeTimeUs = 0;
+};
+
+using TLSContextPtr = std::shared_ptr<TLSContext>;
+
+} // namespace net
+} // namespace viper
+
+#endif
@@ -0,0 +1,291 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#ifndef _VIPER_CORE_NET_TYPED_HANDLER_H_
+#define _VIPER_CORE_NET_TYPED_HANDLER_H_
+
+#include "core/error/error.h"
+#include "core/log/log.h"
+#include "core/net/message.h"
+#include "core/net/message_dispatcher.h"
+#include "core/net/tcp_connection.h"
+
+#include <google/protobuf/arena.h>
+#include <google/protobuf/io/zero_copy_stream.h>
+#include <google/protobuf/message_lite.h>
+
+#include <event2/buffer.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+// The protobuf codec of the TCP path. It is header only, so the core library does
+// not depend on protobuf; the targets including it link libprotobuf.
+
+namespace viper {
+namespace net {
+
+// clang-format off
+
+#define VIPER_NET_PROTO_ARENA_BLOCK_SIZE (64 * 1024) // the first arena block of a thread, kept across resets
+
+// clang-format on
+
+/**
+ * @brief ThreadArena the arena the requests are parsed on, one per thread, so one
+ *        per loop and one per worker queue consumer. A reset keeps the first
+ *        block, requests fitting it never reach the allocator.
+ *
+ * @return google::protobuf::Arena&
+ */
+inline google::protobuf::Arena& ThreadArena()
+{
+    thread_local std::unique_ptr<char[]> block(new char[VIPER_NET_PROTO_ARENA_BLOCK_SIZE]);
+    thread_local google::protobuf::Arena arena(block.get(), VIPER_NET_PROTO_ARENA_BLOCK_SIZE);
+    return arena;
+}
+
+/**
+ * @brief PayloadInputStream reads a chained payload in place, segment by segment,
+ *        so it is parsed without being made contiguous first.
+ */
+class PayloadInputStream final : public google::protobuf::io::ZeroCopyInputStream
+{
+public:
+    PayloadInputStream(evbuffer* payload, uint32_t payloadSize)
+    {
+        int count = evbuffer_peek(payload, payloadSize, nullptr, nullptr, 0);
+        _chunks.resize(count);
+        evbuffer_peek(payload, payloadSize, nullptr, _chunks.data(), count);
+
+        // the last segment may reach past the payload
+        std::size_t left = payloadSize;
+        for (auto& chunk : _chunks)
+        {
+            chunk.iov_len = std::min(chunk.iov_len, left);
+            left          = left - chunk.iov_len;
+        }
+    }
+
+public:
+    bool Next(const void** data, int* size) override
+    {
+        while (_chunk < _chunks.size() && _offset == _chunks[_chunk].iov_len)
+        {
+            ++_chunk;
+            _offset = 0;
+        }
+
+        if (_chunk >= _chunks.size())
+        {
+            return false;
+        }
+
+        *data   = static_cast<const char*>(_chunks[_chunk].iov_base) + _offset;
+        *size   = static_cast<int>(_chunks[_chunk].iov_len - _offset);
+        _offset = _chunks[_chunk].iov_len;
+        _count += *size;
+        return true;
+    }
+
+    void BackUp(int count) override
+    {
+        _offset -= count;
+        _count -= count;
+    }
+
+    bool Skip(int count) override
+    {
+        const void* data = nullptr;
+        int         size = 0;
+        while (count > 0 && Next(&data, &size))
+        {
+            if (size > count)
+            {
+                BackUp(size - count);
+            }
+
+            count -= std::min(size, count);
+        }
+
+        return 0 == count;
+    }
+
+    int64_t ByteCount() const override
+    {
+        return _count;
+    }
+
+private:
+    std::vector<evbuffer_iovec> _chunks;
+    std::size_t                 _chunk  = 0;
+    std::size_t                 _offset = 0;
+    int64_t                     _count  = 0;
+};
+
+/**
+ * @brief ParsePayload parse the payload of a frame into a protobuf message, a
+ *        chained payload is read in place
+ *
+ * @param msg the received frame
+ * @param proto the message to parse into
+ * @return bool false when the payload is not a valid message
+ */
+inline bool ParsePayload(const Message& msg, google::protobuf::MessageLite& proto)
+{
+    if (msg.IsChained())
+    {
+        PayloadInputStream stream(msg.GetPayloadBuffer(), msg.GetPayloadSize());
+        return proto.ParseFromZeroCopyStream(&stream);
+    }
+
+    return proto.ParseFromArray(msg.GetPayload(), msg.GetPayloadSize());
+}
+
+/**
+ * @brief SendProto serialize a protobuf message into an evbuffer of its own and
+ *        move it to the output, the bytes are written once
+ *
+ * @param conn the connection to send on
+ * @param header the frame header in host byte order
+ * @param proto the message
+ * @return std::error_code INVALID_PARAMETER when the message exceeds MAX_MESSAGE_SIZE
+ */
+inline std::error_code SendProto(TCPConnectionPtr conn, const Header& header, const google::protobuf::MessageLite& proto)
+{
+    std::size_t size = proto.ByteSizeLong();
+    if (size > Message::MAX_MESSAGE_SIZE)
+    {
+        LOG_ERROR("the message is too large to be sent. size:{}, msg type:{}", size, header._msgType);
+        return error::ErrorCode::INVALID_PARAMETER;
+    }
+
+    evbuffer* payload = evbuffer_new();
+    if (size > 0)
+    {
+        evbuffer_iovec space;
+        if (evbuffer_reserve_space(payload, size, &space, 1) != 1)
+        {
+            evbuffer_free(payload);
+            return error::ErrorCode::NET_SEND_FAILED;
+        }
+
+        proto.SerializeWithCachedSizesToArray(static_cast<uint8_t*>(space.iov_base));
+        space.iov_len = size;
+        evbuffer_commit_space(payload, &space, 1);
+    }
+
+    auto errcode = conn->SendV(header, payload);
+    evbuffer_free(payload);
+    return errcode;
+}
+
+inline std::error_code SendProto(TCPConnectionPtr conn, uint32_t msgType, const google::protobuf::MessageLite& proto)
+{
+    Header header;
+    header._msgType = msgType;
+    return SendProto(conn, header, proto);
+}
+
+/**
+ * @brief ReplyProto answer a request sent with TCPClient::Call with a protobuf
+ *        message, see TCPConnection::Reply
+ *
+ * @param conn the connection the request arrived on
+ * @param request the received request
+ * @param reply the response
+ * @return std::error_code
+ */
+inline std::error_code ReplyProto(TCPConnectionPtr conn, const MessagePtr request, const google::protobuf::MessageLite& reply)
+{
+    Header header;
+    header._version  = VIPER_NET_MESSAGE_FLAG_RESPONSE;
+    header._msgType  = request->GetHeader()._msgType;
+    header._sequence = request->GetHeader()._sequence;
+    return SendProto(conn, header, reply);
+}
+
+/**
+ * @brief TypedHandler a MessageHandler which hands the payload to its functor
+ *        parsed as ProtoT. The request is created on the arena of the calling
+ *        thread and the arena is reset once the functor returns, so decoding does
+ *        not allocate; the request must not be kept past the call, copy it for
+ *        that. A payload which does not parse is logged and dropped.
+ *
+ * @tparam ProtoT the generated protobuf message type of the frames
+ */
+template <typename ProtoT>
+class TypedHandler final
+{
+public:
+    using Functor = std::function<void(TCPConnectionPtr conn, const MessagePtr msg, const ProtoT& request)>;
+
+public:
+    explicit TypedHandler(Functor functor)
+        : _functor(std::move(functor))
+    {
+    }
+
+public:
+    void operator()(TCPConnectionPtr conn, const MessagePtr msg) const
+    {
+        auto& arena   = ThreadArena();
+        auto  request = google::protobuf::Arena::CreateMessage<ProtoT>(&arena);
+        if (ParsePayload(*msg, *request))
+        {
+            _functor(conn, msg, *request);
+        }
+        else
+        {
+            LOG_WARN("failed to parse the payload. msg type:{}, type:{}, {}", msg->GetHeader()._msgType,
+                     request->GetTypeName(), conn->ID());
+        }
+
+        arena.Reset();
+    }
+
+private:
+    Functor _functor;
+};
+
+/**
+ * @brief RegisterTypedHandler route the frames of one message type to functor,
+ *        parsed as ProtoT
+ *
+ * @tparam ProtoT the generated protobuf message type of the frames
+ * @param dispatcher the dispatcher of the server or client
+ * @param msgType the message type, see MessageDispatcher::RegisterHandler
+ * @param functor called with the connection, the frame and the parsed request
+ * @param mode where the functor runs
+ * @return std::error_code
+ */
+template <typename ProtoT>
+std::error_code RegisterTypedHandler(MessageDispatcher& dispatcher, uint32_t msgType,
+                                     typename TypedHandler<ProtoT>::Functor functor,
+                                     ExecutionMode                          mode = ExecutionMode::INLINE)
+{
+    return dispatcher.RegisterHandler(msgType, TypedHandler<ProtoT>(std::move(functor)), mode);
+}
+
+} // namespace net
+} // namespace viper
+
+#endif
@@ -0,0 +1,643 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#include "core/net/uring_backend.h"
+#include "core/error/error.h"
+#include "core/log/log.h"
+
+#include <event2/buffer.h>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+namespace viper {
+namespace net {
+
+namespace {
+
+// the operation is kept in the low bits of the user data, next to the socket pointer
+enum : uint64_t
+{
+    OP_ACCEPT  = 1,
+    OP_RECV    = 2,
+    OP_SEND    = 3,
+    OP_CONNECT = 4,
+    OP_CANCEL  = 5,
+    OP_MASK    = 7,
+};
+
+} // namespace
+
+struct UringBackend::Socket
+{
+    UringBackend*    _backend = nullptr;
+    evutil_socket_t  _fd      = EVUTIL_INVALID_SOCKET;
+    bufferevent*     _io      = nullptr; // the backend side of the pair
+    int              _inflight      = 0; // the operations the kernel still holds
+    bool             _recvArmed     = false;
+    bool             _recvPaused    = false; // the connection did not consume its input yet
+    bool             _sending       = false;
+    bool             _connecting    = false;
+    bool             _closing       = false;
+    bool             _retired       = false;
+    short            _pendingEvents = 0; // reported once the received data was consumed
+    msghdr           _msg;
+    iovec            _iov[VIPER_NET_URING_SEND_IOV_MAX];
+    sockaddr_storage _peer;
+};
+
+UringBackend::~UringBackend()
+{
+    Stop();
+}
+
+std::error_code UringBackend::Start(event_base* base)
+{
+    auto errcode = _ring.Init(VIPER_NET_URING_ENTRIES);
+    if (!error::IsSuccess(errcode))
+    {
+        return errcode;
+    }
+
+    errcode = _ring.SetupBuffers(0, VIPER_NET_URING_BUFFER_COUNT, VIPER_NET_URING_BUFFER_SIZE);
+    if (!error::IsSuccess(errcode))
+    {
+        return errcode;
+    }
+
+    _eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_eventFd < 0)
+    {
+        LOG_ERROR("failed to create the io_uring eventfd. errno:{}", errno);
+        return error::ErrorCode::SYSTEM_LIB_EXCEPTION;
+    }
+
+    errcode = _ring.RegisterEventFd(_eventFd);
+    if (!error::IsSuccess(errcode))
+    {
+        return errcode;
+    }
+
+    _base            = base;
+    _completionEvent = event_new(_base, _eventFd, EV_READ | EV_PERSIST, &UringBackend::CompletionCallback, this);
+    event_add(_completionEvent, nullptr);
+
+    // the submissions of one loop iteration are handed to the kernel after the other callbacks ran
+    _submitEvent = event_new(_base, -1, 0, &UringBackend::SubmitCallback, this);
+    if (event_base_get_npriorities(_base) > 1)
+    {
+        event_priority_set(_submitEvent, event_base_get_npriorities(_base) - 1);
+    }
+
+    return error::ErrorCode::SUCCESS;
+}
+
+void UringBackend::Stop()
+{
+    if (_stopped)
+    {
+        return;
+    }
+    _stopped = true;
+
+    for (auto sock : _sockets)
+    {
+        close(sock->_fd);
+        bufferevent_free(sock->_io);
+        delete sock;
+    }
+    _sockets.clear();
+    _retired.clear();
+
+    if (_completionEvent)
+    {
+        event_free(_completionEvent);
+        _completionEvent = nullptr;
+    }
+
+    if (_submitEvent)
+    {
+        event_free(_submitEvent);
+        _submitEvent = nullptr;
+    }
+
+    if (_eventFd >= 0)
+    {
+        close(_eventFd);
+        _eventFd = -1;
+    }
+}
+
+std::error_code UringBackend::Accept(evutil_socket_t listenFd, AcceptHandler handler)
+{
+    _listenFd      = listenFd;
+    _acceptHandler = std::move(handler);
+    ArmAccept();
+
+    return error::ErrorCode::SUCCESS;
+}
+
+bufferevent* UringBackend::Open(evutil_socket_t fd)
+{
+    Socket* sock = NewSocket(fd);
+    if (!sock)
+    {
+        return nullptr;
+    }
+
+    ArmRecv(sock);
+    return bufferevent_pair_get_partner(sock->_io);
+}
+
+bufferevent* UringBackend::Connect(evutil_socket_t fd, const sockaddr* address, int socklen)
+{
+    Socket* sock = NewSocket(fd);
+    if (!sock)
+    {
+        return nullptr;
+    }
+
+    io_uring_sqe* sqe = _ring.GetSQE();
+    if (!sqe)
+    {
+        LOG_ERROR("the io_uring submission queue is full, connect failed");
+
+        // nothing is in flight yet, the socket is closed with the next submit
+        sock->_closing = true;
+        bufferevent_disable(sock->_io, EV_READ | EV_WRITE);
+        bufferevent_free(bufferevent_pair_get_partner(sock->_io));
+        Retire(sock);
+        ScheduleSubmit();
+        return nullptr;
+    }
+
+    memcpy(&sock->_peer, address, std::min<std::size_t>(socklen, sizeof(sock->_peer)));
+    sqe->opcode    = IORING_OP_CONNECT;
+    sqe->fd        = fd;
+    sqe->addr      = (uint64_t)&sock->_peer;
+    sqe->off       = socklen;
+    sqe->user_data = (uint64_t)sock | OP_CONNECT;
+
+    sock->_connecting = true;
+    sock->_inflight++;
+    ScheduleSubmit();
+
+    return bufferevent_pair_get_partner(sock->_io);
+}
+
+bool UringBackend::Release(bufferevent* bev)
+{
+    // a socket bufferevent has no partner
+    bufferevent* io = bufferevent_pair_get_partner(bev);
+    if (!io)
+    {
+        return false;
+    }
+
+    bufferevent_data_cb readcb = nullptr;
+    void*               ctx    = nullptr;
+    bufferevent_getcb(io, &readcb, nullptr, nullptr, &ctx);
+    if (readcb != &UringBackend::SendCallback)
+    {
+        return false;
+    }
+
+    auto sock      = static_cast<Socket*>(ctx);
+    auto backend   = sock->_backend;
+    sock->_closing = true;
+    bufferevent_disable(io, EV_READ | EV_WRITE);
+
+    // everything still in flight on the socket completes with ECANCELED
+    io_uring_sqe* sqe = backend->_ring.GetSQE();
+    if (sqe)
+    {
+        sqe->opcode       = IORING_OP_ASYNC_CANCEL;
+        sqe->fd           = sock->_fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data    = (uint64_t)sock | OP_CANCEL;
+        sock->_inflight++;
+    }
+
+    backend->Retire(sock);
+    backend->ScheduleSubmit();
+    return true;
+}
+
+void UringBackend::CompletionCallback(evutil_socket_t fd, short events, void* ctx)
+{
+    auto backend = static_cast<UringBackend*>(ctx);
+
+    uint64_t count = 0;
+    if (read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN)
+    {
+        LOG_WARN("failed to read the io_uring eventfd. errno:{}", errno);
+    }
+
+    backend->_ring.Reap([backend](const io_uring_cqe& cqe) { backend->OnCompletion(cqe); });
+    backend->ScheduleSubmit();
+}
+
+void UringBackend::SubmitCallback(evutil_socket_t fd, short events, void* ctx)
+{
+    auto backend              = static_cast<UringBackend*>(ctx);
+    backend->_submitScheduled = false;
+
+    // the sockets are freed here, never from inside one of their own callbacks
+    for (auto sock : backend->_retired)
+    {
+        close(sock->_fd);
+        bufferevent_free(sock->_io);
+        backend->_sockets.erase(sock);
+        delete sock;
+    }
+    backend->_retired.clear();
+
+    int submitted = backend->_ring.Submit();
+    if (submitted < 0)
+    {
+        // the entries stay published and go with the next submit
+        LOG_WARN("failed to submit to io_uring. errno:{}", -submitted);
+    }
+}
+
+void UringBackend::SendCallback(bufferevent* bev, void* ctx)
+{
+    auto sock = static_cast<Socket*>(ctx);
+    if (sock->_closing)
+    {
+        return;
+    }
+
+    // libevent calls again while the input is above the watermark, so it is paused
+    if (sock->_sending || sock->_connecting)
+    {
+        bufferevent_disable(bev, EV_READ);
+        return;
+    }
+
+    sock->_backend->ArmSend(sock);
+}
+
+void UringBackend::DrainCallback(bufferevent* bev, void* ctx)
+{
+    auto sock    = static_cast<Socket*>(ctx);
+    auto backend = sock->_backend;
+    if (sock->_closing)
+    {
+        return;
+    }
+
+    // the connection consumed what was received, an end of file can be reported now
+    if (sock->_pendingEvents)
+    {
+        short events          = sock->_pendingEvents;
+        sock->_pendingEvents  = 0;
+        backend->Notify(sock, events);
+        return;
+    }
+
+    if (sock->_recvPaused && !sock->_recvArmed)
+    {
+        sock->_recvPaused = false;
+        backend->ArmRecv(sock);
+    }
+}
+
+UringBackend::Socket* UringBackend::NewSocket(evutil_socket_t fd)
+{
+    bufferevent* pair[2] = {nullptr, nullptr};
+    if (bufferevent_pair_new(_base, 0, pair) != 0)
+    {
+        LOG_ERROR("failed to create the bufferevent pair. fd:{}", fd);
+        close(fd);
+        return nullptr;
+    }
+
+    auto sock      = new Socket();
+    sock->_backend = this;
+    sock->_fd      = fd;
+    sock->_io      = pair[1];
+
+    // the pair stops moving output over at the watermark, the rest stays with the
+    // connection, where its backpressure sees it
+    bufferevent_setcb(sock->_io, &UringBackend::SendCallback, &UringBackend::DrainCallback, nullptr, sock);
+    bufferevent_setwatermark(sock->_io, EV_READ, 0, VIPER_NET_URING_SEND_BATCH);
+    bufferevent_enable(sock->_io, EV_READ | EV_WRITE);
+
+    _sockets.insert(sock);
+    return sock;
+}
+
+void UringBackend::ArmRecv(Socket* sock)
+{
+    io_uring_sqe* sqe = _ring.GetSQE();
+    if (!sqe)
+    {
+        LOG_ERROR("the io_uring submission queue is full, fd:{}", sock->_fd);
+        Notify(sock, BEV_EVENT_ERROR | BEV_EVENT_READING);
+        return;
+    }
+
+    // multishot, the receive stays armed and the kernel picks a provided buffer per completion
+    sqe->opcode    = IORING_OP_RECV;
+    sqe->fd        = sock->_fd;
+    sqe->ioprio    = IORING_RECV_MULTISHOT;
+    sqe->flags     = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = _ring.BufferGroup();
+    sqe->user_data = (uint64_t)sock | OP_RECV;
+
+    sock->_recvArmed = true;
+    sock->_inflight++;
+    ScheduleSubmit();
+}
+
+void UringBackend::ArmSend(Socket* sock)
+{
+    evbuffer*      input = bufferevent_get_input(sock->_io);
+    evbuffer_iovec chunks[VIPER_NET_URING_SEND_IOV_MAX];
+    int            count = std::min(evbuffer_peek(input, -1, nullptr, chunks, VIPER_NET_URING_SEND_IOV_MAX),
+                                    VIPER_NET_URING_SEND_IOV_MAX);
+    if (count <= 0)
+    {
+        return;
+    }
+
+    io_uring_sqe* sqe = _ring.GetSQE();
+    if (!sqe)
+    {
+        LOG_ERROR("the io_uring submission queue is full, fd:{}", sock->_fd);
+        Notify(sock, BEV_EVENT_ERROR | BEV_EVENT_WRITING);
+        return;
+    }
+
+    for (int idx = 0; idx < count; ++idx)
+    {
+        sock->_iov[idx].iov_base = chunks[idx].iov_base;
+        sock->_iov[idx].iov_len  = chunks[idx].iov_len;
+    }
+
+    memset(&sock->_msg, 0, sizeof(sock->_msg));
+    sock->_msg.msg_iov    = sock->_iov;
+    sock->_msg.msg_iovlen = count;
+
+    sqe->opcode    = IORING_OP_SENDMSG;
+    sqe->fd        = sock->_fd;
+    sqe->addr      = (uint64_t)&sock->_msg;
+    sqe->len       = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = (uint64_t)sock | OP_SEND;
+
+    sock->_sending = true;
+    sock->_inflight++;
+
+    // nothing is moved over while the send is in flight
+    bufferevent_disable(sock->_io, EV_READ);
+    ScheduleSubmit();
+}
+
+void UringBackend::ArmAccept()
+{
+    io_uring_sqe* sqe = _ring.GetSQE();
+    if (!sqe)
+    {
+        LOG_ERROR("the io_uring submission queue is full, accept failed");
+        return;
+    }
+
+    sqe->opcode       = IORING_OP_ACCEPT;
+    sqe->fd           = _listenFd;
+    sqe->ioprio       = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    sqe->user_data    = OP_ACCEPT;
+    ScheduleSubmit();
+}
+
+void UringBackend::OnCompletion(const io_uring_cqe& cqe)
+{
+    auto op   = cqe.user_data & OP_MASK;
+    auto sock = reinterpret_cast<Socket*>(cqe.user_data & ~OP_MASK);
+
+    switch (op)
+    {
+    case OP_ACCEPT:
+        OnAccept(cqe);
+        return;
+
+    case OP_RECV:
+        OnRecv(sock, cqe);
+        break;
+
+    case OP_SEND:
+        OnSend(sock, cqe);
+        break;
+
+    case OP_CONNECT:
+        OnConnect(sock, cqe);
+        break;
+
+    case OP_CANCEL:
+        sock->_inflight--;
+        break;
+
+    default:
+        LOG_WARN("unknown io_uring completion. user data:{}", cqe.user_data);
+        return;
+    }
+
+    if (sock->_closing)
+    {
+        Retire(sock);
+    }
+}
+
+void UringBackend::OnRecv(Socket* sock, const io_uring_cqe& cqe)
+{
+    if (!(cqe.flags & IORING_CQE_F_MORE))
+    {
+        sock->_recvArmed = false;
+        sock->_inflight--;
+    }
+
+    if (cqe.flags & IORING_CQE_F_BUFFER)
+    {
+        // copied into the pair, which hands it to the connection, and the buffer goes back at once
+        uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        if (cqe.res > 0 && !sock->_closing)
+        {
+            bufferevent_write(sock->_io, _ring.Buffer(bid), cqe.res);
+        }
+        _ring.RecycleBuffer(bid);
+    }
+
+    if (sock->_closing)
+    {
+        return;
+    }
+
+    if (0 == cqe.res || (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -ECANCELED))
+    {
+        Notify(sock, (0 == cqe.res ? BEV_EVENT_EOF : BEV_EVENT_ERROR) | BEV_EVENT_READING);
+        return;
+    }
+
+    // a connection which does not keep up stops the receive, like a full socket bufferevent
+    bool backlogged = evbuffer_get_length(bufferevent_get_output(sock->_io)) > VIPER_NET_URING_RECV_BACKLOG;
+    if (backlogged && sock->_recvArmed && !sock->_recvPaused)
+    {
+        io_uring_sqe* sqe = _ring.GetSQE();
+        if (sqe)
+        {
+            sqe->opcode    = IORING_OP_ASYNC_CANCEL;
+            sqe->addr      = (uint64_t)sock | OP_RECV;
+            sqe->user_data = (uint64_t)sock | OP_CANCEL;
+            sock->_inflight++;
+            ScheduleSubmit();
+        }
+    }
+
+    sock->_recvPaused = backlogged;
+    if (!sock->_recvArmed && !backlogged)
+    {
+        ArmRecv(sock);
+    }
+}
+
+void UringBackend::OnSend(Socket* sock, const io_uring_cqe& cqe)
+{
+    sock->_sending = false;
+    sock->_inflight--;
+    if (sock->_closing)
+    {
+        return;
+    }
+
+    if (cqe.res < 0)
+    {
+        Notify(sock, BEV_EVENT_ERROR | BEV_EVENT_WRITING);
+        return;
+    }
+
+    evbuffer* input = bufferevent_get_input(sock->_io);
+    evbuffer_drain(input, cqe.res);
+    if (evbuffer_get_length(input) > 0)
+    {
+        ArmSend(sock);
+        return;
+    }
+
+    // pulls the output the connection wrote meanwhile, which calls SendCallback
+    bufferevent_enable(sock->_io, EV_READ);
+}
+
+void UringBackend::OnConnect(Socket* sock, const io_uring_cqe& cqe)
+{
+    sock->_connecting = false;
+    sock->_inflight--;
+    if (sock->_closing)
+    {
+        return;
+    }
+
+    if (cqe.res < 0)
+    {
+        Notify(sock, BEV_EVENT_ERROR);
+        return;
+    }
+
+    ArmRecv(sock);
+    Notify(sock, BEV_EVENT_CONNECTED);
+
+    // frames written while connecting
+    if (!sock->_closing && !sock->_sending)
+    {
+        bufferevent_enable(sock->_io, EV_READ);
+        ArmSend(sock);
+    }
+}
+
+void UringBackend::OnAccept(const io_uring_cqe& cqe)
+{
+    if (cqe.res >= 0)
+    {
+        sockaddr_storage address;
+        socklen_t        socklen = sizeof(address);
+        if (getpeername(cqe.res, (sockaddr*)&address, &socklen) == 0)
+        {
+            _acceptHandler(cqe.res, (sockaddr*)&address, socklen);
+        }
+        else
+        {
+            close(cqe.res);
+        }
+    }
+    else
+    {
+        LOG_WARN("failed to accept a connection. errno:{}", -cqe.res);
+    }
+
+    if (!(cqe.flags & IORING_CQE_F_MORE) && !_stopped)
+    {
+        ArmAccept();
+    }
+}
+
+void UringBackend::Notify(Socket* sock, short events)
+{
+    bufferevent* bev = bufferevent_pair_get_partner(sock->_io);
+    if (!bev)
+    {
+        return;
+    }
+
+    // the received data is delivered before the end of the stream
+    if ((events & BEV_EVENT_READING) && evbuffer_get_length(bufferevent_get_output(sock->_io)) > 0)
+    {
+        sock->_pendingEvents = events;
+        return;
+    }
+
+    bufferevent_trigger_event(bev, events, 0);
+}
+
+void UringBackend::Retire(Socket* sock)
+{
+    if (sock->_inflight > 0 || sock->_retired)
+    {
+        return;
+    }
+
+    sock->_retired = true;
+    _retired.push_back(sock);
+    ScheduleSubmit();
+}
+
+void UringBackend::ScheduleSubmit()
+{
+    if (_submitScheduled || !_submitEvent)
+    {
+        return;
+    }
+
+    _submitScheduled = true;
+    event_active(_submitEvent, EV_WRITE, 0);
+}
+
+} // namespace net
+} // namespace viper
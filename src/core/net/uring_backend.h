@@ -0,0 +1,167 @@
+/**
+ * Copyright 2025 Viper authors.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+**/
+
+#ifndef _VIPER_CORE_NET_URING_BACKEND_H_
+#define _VIPER_CORE_NET_URING_BACKEND_H_
+
+#include "core/net/io_uring.h"
+
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/util.h>
+
+#include <sys/socket.h>
+
+#include <functional>
+#include <memory>
+#include <system_error>
+#include <unordered_set>
+#include <vector>
+
+namespace viper {
+namespace net {
+
+// clang-format off
+
+#define VIPER_NET_URING_ENTRIES      1024
+#define VIPER_NET_URING_BUFFER_COUNT 1024
+#define VIPER_NET_URING_BUFFER_SIZE  (16 * 1024)
+#define VIPER_NET_URING_SEND_IOV_MAX 64
+#define VIPER_NET_URING_SEND_BATCH   (256 * 1024)
+#define VIPER_NET_URING_RECV_BACKLOG (10 * 1024 * 1024)
+
+// clang-format on
+
+enum class NetBackend : int
+{
+    LIBEVENT, // socket bufferevents, epoll readiness plus a read or write per event
+    IO_URING, // io_uring completions, submitted once per loop iteration
+};
+
+/**
+ * @brief UringBackend the socket I/O of one event loop on io_uring.
+ *
+ * Every socket is represented by a bufferevent pair: the connection uses one
+ * side exactly like a socket bufferevent, the backend the other one. Received
+ * data is written into the backend side and arrives as input of the connection
+ * side; whatever the connection writes arrives on the backend side and is sent
+ * with one sendmsg per socket at a time. Receives are multishot with provided
+ * buffers, accepts are multishot, and all submissions of one loop iteration go
+ * to the kernel in a single io_uring_enter.
+ *
+ * The completions are signaled through an eventfd watched by the loop, so
+ * timers and the other events keep working unchanged.
+ */
+class UringBackend final
+{
+public:
+    using AcceptHandler = std::function<void(evutil_socket_t fd, sockaddr* address, int socklen)>;
+
+    UringBackend() = default;
+    ~UringBackend();
+
+    UringBackend(const UringBackend&)            = delete;
+    UringBackend& operator=(const UringBackend&) = delete;
+
+public:
+    std::error_code Start(event_base* base);
+
+    /**
+     * @brief Stop close every socket, called after the loop exited
+     */
+    void Stop();
+
+    /**
+     * @brief Accept accept connections on a listening socket with a multishot accept
+     *
+     * @param listenFd the listening socket
+     * @param handler called on the loop thread with every accepted socket
+     * @return std::error_code
+     */
+    std::error_code Accept(evutil_socket_t listenFd, AcceptHandler handler);
+
+    /**
+     * @brief Open start the I/O of a connected socket
+     *
+     * @param fd the socket, owned by the backend from now on
+     * @return bufferevent* the bufferevent of the connection
+     */
+    bufferevent* Open(evutil_socket_t fd);
+
+    /**
+     * @brief Connect connect a socket, the bufferevent reports BEV_EVENT_CONNECTED
+     *        or BEV_EVENT_ERROR like bufferevent_socket_connect
+     *
+     * @param fd a non blocking socket, owned by the backend from now on
+     * @param address the remote address
+     * @param socklen the address length
+     * @return bufferevent* the bufferevent of the connection
+     */
+    bufferevent* Connect(evutil_socket_t fd, const sockaddr* address, int socklen);
+
+    /**
+     * @brief Release close the socket behind a bufferevent returned by Open or
+     *        Connect, called before the bufferevent is freed
+     *
+     * @param bev the bufferevent of a connection
+     * @return true when bev belongs to an io_uring backend
+     */
+    static bool Release(bufferevent* bev);
+
+private:
+    struct Socket;
+
+    static void CompletionCallback(evutil_socket_t fd, short events, void* ctx);
+    static void SubmitCallback(evutil_socket_t fd, short events, void* ctx);
+    static void SendCallback(bufferevent* bev, void* ctx);
+    static void DrainCallback(bufferevent* bev, void* ctx);
+
+private:
+    Socket* NewSocket(evutil_socket_t fd);
+    void    ArmRecv(Socket* sock);
+    void    ArmSend(Socket* sock);
+    void    ArmAccept();
+    void    OnCompletion(const io_uring_cqe& cqe);
+    void    OnRecv(Socket* sock, const io_uring_cqe& cqe);
+    void    OnSend(Socket* sock, const io_uring_cqe& cqe);
+    void    OnConnect(Socket* sock, const io_uring_cqe& cqe);
+    void    OnAccept(const io_uring_cqe& cqe);
+    void    Notify(Socket* sock, short events);
+    void    Retire(Socket* sock);
+    void    ScheduleSubmit();
+
+private:
+    IOUring     _ring;
+    event_base* _base            = nullptr;
+    int         _eventFd         = -1;
+    event*      _completionEvent = nullptr;
+    event*      _submitEvent     = nullptr;
+    bool        _submitScheduled = false;
+    bool        _stopped         = false;
+
+    evutil_socket_t _listenFd = EVUTIL_INVALID_SOCKET;
+    AcceptHandler   _acceptHandler;
+
+    std::unordered_set<Socket*> _sockets;
+    std::vector<Socket*>        _retired; // closed sockets freed at the end of the iteration
+};
+
+using UringBackendPtr = std::unique_ptr<UringBackend>;
+
+} // namespace net
+} // namespace viper
+
+#endif